@@ -0,0 +1,14 @@
+#include "Accelerationcurve.h"
+
+// Ten consecutive intervals of the curve, starting at index
+#define CURVE_10(index) \
+  (unsigned int)curve_interval(index), (unsigned int)curve_interval(index+1), (unsigned int)curve_interval(index+2), (unsigned int)curve_interval(index+3), \
+  (unsigned int)curve_interval(index+4), (unsigned int)curve_interval(index+5), (unsigned int)curve_interval(index+6), (unsigned int)curve_interval(index+7), \
+  (unsigned int)curve_interval(index+8), (unsigned int)curve_interval(index+9)
+
+const unsigned int acceleration_curve[ACCELERATION_CURVE_LENGTH] PROGMEM = {
+  CURVE_10(0), CURVE_10(10), CURVE_10(20), CURVE_10(30), CURVE_10(40),
+  CURVE_10(50), CURVE_10(60), CURVE_10(70), CURVE_10(80), CURVE_10(90)
+};
+
+static_assert(ACCELERATION_CURVE_LENGTH == 100, "Initializer of acceleration_curve has 100 intervals");
@@ -0,0 +1,48 @@
+#ifndef Accelerationcurve_h
+#define Accelerationcurve_h
+
+#include <Arduino.h>
+
+#define ACCELERATION_CURVE_LENGTH 100
+#define ACCELERATION_SPEED 4000 // Steps per second per second of the default curve
+
+// The default acceleration curve is calculated by the compiler with the equations of the accelstepper library. Calculations are done in float, like the Arduino did at start up.
+// C++11 constexpr functions can only be a single return statement, so loops are written as recursion.
+
+constexpr float curve_sqrt(float value, float guess, int iterations) {
+  // Newton's method, converges well within 20 iterations for the values used here
+  return iterations == 0 ? guess : curve_sqrt(value, (guess + value / guess) / 2.0f, iterations - 1);
+}
+
+constexpr float curve_next_interval(float previous, int index) {
+  return previous - ((2.0f * previous) / ((4.0f * index) + 1.0f)); // Equation 13
+}
+
+constexpr float curve_interval(int index) {
+  return index == 0 ? 0.676f * curve_sqrt(2.0f / ACCELERATION_SPEED, 1.0f, 20) * 1000000.0f // Equation 15
+                    : curve_next_interval(curve_interval(index - 1), index);
+}
+
+// Step interval in micro seconds at the end of the curve, to calculate speed factors of hand-specific curves
+constexpr unsigned int acceleration_curve_end_interval = (unsigned int)curve_interval(ACCELERATION_CURVE_LENGTH - 1);
+
+constexpr float curve_sum(int index) {
+  return index < 0 ? 0.0f : (unsigned int)curve_interval(index) + curve_sum(index - 1);
+}
+
+// Time the curve takes relative to the same steps at its end interval. An instruction that follows the curve over any number of steps takes about
+// as much longer than at its end speed, to predict durations without stepping through the curve.
+constexpr float acceleration_curve_time_factor = curve_sum(ACCELERATION_CURVE_LENGTH - 1) / (ACCELERATION_CURVE_LENGTH * float(acceleration_curve_end_interval));
+
+// The same for a curve stretched over more steps than it has intervals. It is interpolated, so between two intervals the mean is halfway them.
+constexpr float acceleration_curve_stretched_time_factor = (curve_sum(ACCELERATION_CURVE_LENGTH - 1) - (unsigned int)curve_interval(0) / 2.0f +
+  (unsigned int)curve_interval(ACCELERATION_CURVE_LENGTH - 1) / 2.0f) / (ACCELERATION_CURVE_LENGTH * float(acceleration_curve_end_interval));
+
+// Step intervals in micro seconds of the default curve, in flash
+extern const unsigned int acceleration_curve[ACCELERATION_CURVE_LENGTH] PROGMEM;
+
+inline unsigned int acceleration_curve_interval(uint8_t index) {
+  return pgm_read_word(&acceleration_curve[index]);
+}
+
+#endif
@@ -0,0 +1,329 @@
+#include "Animationscript.h"
+#include "Clockgeometry.h"
+#include "settings.h"
+
+// Arguments
+#define SCRIPT_HANDS(mask) uint8_t((mask) & 0xFF), uint8_t(((mask) >> 8) & 0xFF), uint8_t(((mask) >> 16) & 0xFF)
+#define SCRIPT_WORD(value) uint8_t(int(value) & 0xFF), uint8_t((int(value) >> 8) & 0xFF)
+#define SCRIPT_INTERVAL(speed) SCRIPT_WORD(1000000L/(unsigned int)(speed)) // Steps per second to step interval, like set_instruction() is called with
+
+// Codes with their arguments, to write scripts
+#define DIRECTION(hands, direction) SCRIPT_DIRECTION, SCRIPT_HANDS(hands), uint8_t(direction)
+#define TARGET(hands, position) SCRIPT_TARGET, SCRIPT_HANDS(hands), SCRIPT_WORD(position)
+#define TARGET_ADD(hands, steps) SCRIPT_TARGET_ADD, SCRIPT_HANDS(hands), SCRIPT_WORD(steps)
+#define TARGET_CURRENT(hands) SCRIPT_TARGET_CURRENT, SCRIPT_HANDS(hands)
+#define FRAME_POSITIONS() SCRIPT_FRAME_POSITIONS
+#define TIME_POSITIONS() SCRIPT_TIME_POSITIONS
+#define GET_TIME() SCRIPT_GET_TIME
+#define CRUISE(hands, steps, speed) SCRIPT_CRUISE, SCRIPT_HANDS(hands), SCRIPT_WORD(steps), SCRIPT_INTERVAL(speed)
+#define DELAY(hands, steps, speed) SCRIPT_DELAY, SCRIPT_HANDS(hands), SCRIPT_WORD(steps), SCRIPT_INTERVAL(speed)
+#define SAME_SPEED(steps, speed) SCRIPT_SAME_SPEED, SCRIPT_WORD(steps), SCRIPT_WORD(speed)
+#define EQUAL_DURATION(extra_rotations, max_speed, accel, decel) SCRIPT_EQUAL_DURATION, uint8_t(extra_rotations), SCRIPT_WORD(max_speed), uint8_t(accel), uint8_t(decel)
+#define WITH_DELAYS(extra_rotations, max_speed, accel, decel, delay_at_start) SCRIPT_WITH_DELAYS, uint8_t(extra_rotations), SCRIPT_WORD(max_speed), uint8_t(accel), uint8_t(decel), uint8_t(delay_at_start)
+#define S_CURVE(extra_rotations, max_speed, acceleration, jerk) SCRIPT_S_CURVE, uint8_t(extra_rotations), SCRIPT_WORD(max_speed), SCRIPT_WORD(acceleration), SCRIPT_WORD((jerk)/100)
+#define TIME_OPTIMAL(extra_rotations, sync) SCRIPT_TIME_OPTIMAL, uint8_t(extra_rotations), uint8_t(sync)
+#define PATTERN_TARGET(hands, pattern, first, step) SCRIPT_PATTERN_TARGET, SCRIPT_HANDS(hands), uint8_t(pattern), SCRIPT_WORD(first), SCRIPT_WORD(step)
+#define PATTERN_DELAY(hands, pattern, first, step, speed) SCRIPT_PATTERN_DELAY, SCRIPT_HANDS(hands), uint8_t(pattern), SCRIPT_WORD(first), SCRIPT_WORD(step), SCRIPT_INTERVAL(speed)
+#define PATTERN_DIRECTION(hands, pattern, direction) SCRIPT_PATTERN_DIRECTION, SCRIPT_HANDS(hands), uint8_t(pattern), uint8_t(direction)
+#define MIRROR(hands) SCRIPT_MIRROR, SCRIPT_HANDS(hands)
+#define COORDINATED(extra_rotations, max_speed, accel, decel) SCRIPT_COORDINATED, uint8_t(extra_rotations), SCRIPT_WORD(max_speed), uint8_t(accel), uint8_t(decel)
+#define SHOW_TIME_EQUAL_DURATION(time, extra_rotations, max_speed, accel, decel) SCRIPT_SHOW_TIME_EQUAL_DURATION, uint8_t(time), uint8_t(extra_rotations), SCRIPT_WORD(max_speed), uint8_t(accel), uint8_t(decel)
+#define SHOW_TIME_WITH_DELAYS(time, extra_rotations, max_speed, accel, decel) SCRIPT_SHOW_TIME_WITH_DELAYS, uint8_t(time), uint8_t(extra_rotations), SCRIPT_WORD(max_speed), uint8_t(accel), uint8_t(decel)
+#define RUN() SCRIPT_RUN
+#define RUN_COORDINATED() SCRIPT_RUN_COORDINATED
+#define WAIT(ms) SCRIPT_WAIT, SCRIPT_WORD(ms)
+#define WAIT_FOR_NEW_MINUTE() SCRIPT_WAIT_FOR_NEW_MINUTE
+#define END() SCRIPT_END
+
+#define CW 1
+#define CCW 0
+#define SYNC_START 0 // Sync policies of TIME_OPTIMAL
+#define SYNC_ARRIVE 1
+#define SYNC_INDEPENDENT 2
+#define GET_TIME_NOW 99 // Time of show time codes
+#define TIME_ALREADY_FETCHED 98
+
+// Hand groups used by several animations, hands are numbered as in settings.h
+#define CORNER_HANDS hand_mask(0, 1, 4, 5, 8, 9, 12, 13, 16, 17) // hand%4 < 2
+#define SIDE_HANDS hand_mask(2, 3, 6, 7, 10, 11, 14, 15) // hand%4 >= 2
+
+///////////////////////////////////////////////////////////////////////////////// LONG ANIMATIONS /////////////////////////////////////////////////////////////////////////
+
+const uint8_t script_long_1[] PROGMEM = { // Stretch and turn
+  DIRECTION(ALL_HANDS, CW),
+  TARGET(ODD_HANDS, int(steps_per_revolution*.5)),
+  TARGET(EVEN_HANDS, steps_per_revolution),
+  WITH_DELAYS(/*extra rotations*/ 0, /*max_speed*/ 600, /*accel*/ 90, /*decel*/ 0, /*delay at start*/ true), // Stretch
+  SAME_SPEED(steps_per_revolution*2, 600), // Rotations
+  SHOW_TIME_EQUAL_DURATION(GET_TIME_NOW, /*extra rotations*/ 0, /*max_speed*/ 600, /*accel*/ 0, /*decel*/ 20),
+  RUN(),
+  END()
+};
+
+const uint8_t script_long_2[] PROGMEM = { // Opposite rotation
+  DIRECTION(EVEN_HANDS, CW),
+  DIRECTION(ODD_HANDS, CCW),
+  TARGET(ALL_HANDS, 0),
+  WITH_DELAYS(/*extra rotations*/ 1, /*max_speed*/ 800, /*accel*/ 100, /*decel*/ 0, /*delay at start*/ true),
+  SAME_SPEED(steps_per_revolution*2, 800), // Rotate
+  SHOW_TIME_EQUAL_DURATION(GET_TIME_NOW, /*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 0, /*decel*/ 20),
+  RUN(),
+  END()
+};
+
+const uint8_t script_long_4[] PROGMEM = { // Opposite rotation with different speeds
+  DIRECTION(EVEN_HANDS, CW),
+  DIRECTION(ODD_HANDS, CCW),
+  TARGET(ALL_HANDS, 0),
+  WITH_DELAYS(/*extra rotations*/ 1, /*max_speed*/ 800, /*accel*/ 100, /*decel*/ 0, /*delay at start*/ true),
+  CRUISE(EVEN_HANDS, steps_per_revolution*1.5, int(1.15/2.0*800)), // Rotate
+  CRUISE(ODD_HANDS, steps_per_revolution*2, 800),
+  SHOW_TIME_EQUAL_DURATION(GET_TIME_NOW, /*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 0, /*decel*/ 40),
+  RUN(),
+  END()
+};
+
+const uint8_t script_long_5[] PROGMEM = { // Opposite rotation oriented to center simultaniously
+  DIRECTION(ODD_HANDS, CCW),
+  DIRECTION(EVEN_HANDS | hand_mask(16, 17), CW),
+  PATTERN_TARGET(FRAME_HANDS, PATTERN_RING, int(steps_per_revolution*.5), int(steps_per_revolution*.125)), // Point to the middle
+  TARGET(hand_mask(16), int(steps_per_revolution)),
+  TARGET(hand_mask(17), int(steps_per_revolution*.5)),
+  WITH_DELAYS(/*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 100, /*decel*/ 0, /*delay at start*/ true),
+  SAME_SPEED(steps_per_revolution*2, 800), // Rotate
+  SHOW_TIME_EQUAL_DURATION(GET_TIME_NOW, /*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 0, /*decel*/ 40),
+  RUN(),
+  END()
+};
+
+const uint8_t script_long_6[] PROGMEM = { // Frame turns in one minute
+  DIRECTION(CORNER_HANDS, CW),
+  DIRECTION(SIDE_HANDS, CCW),
+  CRUISE(FRAME_HANDS, steps_per_revolution, 80),
+  DELAY(hand_mask(16, 17), steps_per_revolution, 80),
+  SHOW_TIME_EQUAL_DURATION(GET_TIME_NOW, /*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 50, /*decel*/ 50),
+  RUN(),
+  END()
+};
+
+const uint8_t script_long_7[] PROGMEM = { // Stretched rotation with each clock different speeds
+  DIRECTION(ALL_HANDS, CW),
+  TARGET(EVEN_HANDS, 0),
+  TARGET(ODD_HANDS, int(.5*steps_per_revolution)),
+  WITH_DELAYS(/*extra rotations*/ 1, /*max_speed*/ 800, /*accel*/ 100, /*decel*/ 0, /*delay at start*/ true),
+  // All hands rotate for 10 seconds, the closer to the middle the slower
+  CRUISE(hand_mask(12, 13), steps_per_revolution, steps_per_revolution/10.0),
+  CRUISE(hand_mask(10, 11, 14, 15), int(steps_per_revolution*1.5), int(steps_per_revolution*1.5)/10.0),
+  CRUISE(hand_mask(0, 1, 16, 17, 8, 9), int(steps_per_revolution*2), int(steps_per_revolution*2)/10.0),
+  CRUISE(hand_mask(2, 3, 6, 7), int(steps_per_revolution*2.5), int(steps_per_revolution*2.5)/10.0),
+  CRUISE(hand_mask(4, 5), int(steps_per_revolution*3), int(steps_per_revolution*3)/10.0),
+  SHOW_TIME_WITH_DELAYS(GET_TIME_NOW, /*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 0, /*decel*/ 20),
+  RUN(),
+  END()
+};
+
+const uint8_t script_long_9[] PROGMEM = { // Opposite rotation oriented to center after each other
+  DIRECTION(ALL_HANDS, CW),
+  TARGET(FRAME_HANDS, int(steps_per_revolution*.5)),
+  TARGET(hand_mask(16, 17), int(steps_per_revolution)),
+  WITH_DELAYS(/*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 100, /*decel*/ 0, /*delay at start*/ true),
+  SAME_SPEED(steps_per_revolution*2, 800), // Rotate
+  SHOW_TIME_EQUAL_DURATION(GET_TIME_NOW, /*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 0, /*decel*/ 20),
+  RUN(),
+  END()
+};
+
+const uint8_t script_long_10[] PROGMEM = { // Stretch and turn variation
+  DIRECTION(ALL_HANDS, CW),
+  TARGET(ODD_HANDS, int(steps_per_revolution*.75)),
+  TARGET(EVEN_HANDS, int(steps_per_revolution*.25)),
+  TARGET_ADD(hand_mask(10, 11, 14, 15), -120),
+  TARGET_ADD(hand_mask(0, 1, 8, 9, 16, 17), -240),
+  TARGET_ADD(hand_mask(2, 3, 6, 7), -360),
+  TARGET_ADD(hand_mask(4, 5), -480),
+  WITH_DELAYS(/*extra rotations*/ 0, /*max_speed*/ 600, /*accel*/ 90, /*decel*/ 0, /*delay at start*/ true), // Stretch
+  SAME_SPEED(steps_per_revolution*2, 600), // Rotations
+  SHOW_TIME_EQUAL_DURATION(GET_TIME_NOW, /*extra rotations*/ 1, /*max_speed*/ 600, /*accel*/ 0, /*decel*/ 20),
+  RUN(),
+  END()
+};
+
+const uint8_t script_long_11[] PROGMEM = { // Stretch and each column opposite rotation
+  TARGET(ODD_HANDS, 0),
+  TARGET(EVEN_HANDS, int(steps_per_revolution*.5)),
+  DIRECTION(hand_mask(12, 13), CCW),
+  DIRECTION(hand_mask(10, 11, 14, 15), CW),
+  DIRECTION(hand_mask(0, 1, 8, 9, 16, 17), CCW),
+  DIRECTION(hand_mask(2, 3, 6, 7), CW),
+  DIRECTION(hand_mask(4, 5), CCW),
+  WITH_DELAYS(/*extra rotations*/ 1, /*max_speed*/ 400, /*accel*/ 60, /*decel*/ 0, /*delay at start*/ true), // Stretch
+  SAME_SPEED(steps_per_revolution*2, 400), // Rotations
+  SHOW_TIME_EQUAL_DURATION(GET_TIME_NOW, /*extra rotations*/ 1, /*max_speed*/ 400, /*accel*/ 0, /*decel*/ 20),
+  RUN(),
+  END()
+};
+
+///////////////////////////////////////////////////////////////////////////////// SHORT ANIMATIONS /////////////////////////////////////////////////////////////////////////
+
+const uint8_t script_short_1[] PROGMEM = { // Turn all hands equally
+  DIRECTION(ALL_HANDS, CW),
+  GET_TIME(),
+  FRAME_POSITIONS(),
+  TIME_POSITIONS(),
+  COORDINATED(/*extra rotations*/ 1, /*max_speed*/ 400, /*accel*/ 10, /*decel*/ 20), // All hands arrive on the same tick
+  RUN_COORDINATED(),
+  END()
+};
+
+const uint8_t script_short_2[] PROGMEM = { // One revolution different start and end times
+  DIRECTION(ALL_HANDS, CW),
+  TARGET(ALL_HANDS, int(steps_per_revolution*.25)),
+  WITH_DELAYS(/*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 100, /*decel*/ 0, /*delay at start*/ true),
+  SHOW_TIME_WITH_DELAYS(GET_TIME_NOW, /*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 0, /*decel*/ 70),
+  RUN(),
+  END()
+};
+
+const uint8_t script_short_3[] PROGMEM = { // Turn hands outside and back
+  DIRECTION(EVEN_HANDS, CCW),
+  DIRECTION(ODD_HANDS | hand_mask(16), CW),
+  TARGET(hand_mask(0, 1), steps_per_revolution),
+  TARGET(hand_mask(2, 3), int(steps_per_revolution*.125)),
+  TARGET(hand_mask(4, 5), int(steps_per_revolution*.25)),
+  TARGET(hand_mask(6, 7), int(steps_per_revolution*.375)),
+  TARGET(hand_mask(8, 9), int(steps_per_revolution*.5)),
+  TARGET(hand_mask(10, 11), int(steps_per_revolution*.625)),
+  TARGET(hand_mask(12, 13), int(steps_per_revolution*.75)),
+  TARGET(hand_mask(14, 15), int(steps_per_revolution*.875)),
+  TIME_POSITIONS(),
+  TIME_OPTIMAL(/*extra rotations*/ 0, SYNC_ARRIVE), // As fast as the motors allow, all hands arrive together
+  RUN(),
+  WAIT_FOR_NEW_MINUTE(),
+  DIRECTION(EVEN_HANDS, CW),
+  DIRECTION(ODD_HANDS, CCW),
+  DIRECTION(hand_mask(16, 17), CW),
+  FRAME_POSITIONS(),
+  EQUAL_DURATION(/*extra rotations*/ 0, /*max_speed*/ 500, /*accel*/ 40, /*decel*/ 40),
+  SHOW_TIME_EQUAL_DURATION(TIME_ALREADY_FETCHED, /*extra rotations*/ 0, /*max_speed*/ 50, /*accel*/ 50, /*decel*/ 50),
+  RUN(),
+  END()
+};
+
+const uint8_t script_short_6[] PROGMEM = { // Turn hands inwards and back
+  DIRECTION(EVEN_HANDS, CW),
+  DIRECTION(ODD_HANDS, CCW),
+  DIRECTION(hand_mask(16, 17), CW),
+  TARGET(hand_mask(0, 1), int(steps_per_revolution*.5)),
+  TARGET(hand_mask(2, 3), int(steps_per_revolution*.625)),
+  TARGET(hand_mask(4, 5), int(steps_per_revolution*.75)),
+  TARGET(hand_mask(6, 7), int(steps_per_revolution*.875)),
+  TARGET(hand_mask(8, 9), steps_per_revolution),
+  TARGET(hand_mask(10, 11), int(steps_per_revolution*.125)),
+  TARGET(hand_mask(12, 13), int(steps_per_revolution*.25)),
+  TARGET(hand_mask(14, 15), int(steps_per_revolution*.375)),
+  TIME_POSITIONS(),
+  EQUAL_DURATION(/*extra rotations*/ 0, /*max_speed*/ 500, /*accel*/ 40, /*decel*/ 40),
+  RUN(),
+  WAIT_FOR_NEW_MINUTE(),
+  DIRECTION(EVEN_HANDS, CCW),
+  DIRECTION(ODD_HANDS | hand_mask(16), CW),
+  FRAME_POSITIONS(),
+  EQUAL_DURATION(/*extra rotations*/ 0, /*max_speed*/ 500, /*accel*/ 40, /*decel*/ 40),
+  SHOW_TIME_EQUAL_DURATION(TIME_ALREADY_FETCHED, /*extra rotations*/ 0, /*max_speed*/ 50, /*accel*/ 50, /*decel*/ 50),
+  RUN(),
+  END()
+};
+
+const uint8_t script_short_7[] PROGMEM = { // Turn corners first
+  DELAY(SIDE_HANDS, int(steps_per_revolution/2), 600),
+  SHOW_TIME_EQUAL_DURATION(TIME_ALREADY_FETCHED, /*extra rotations*/ 1, /*max_speed*/ 600, /*accel*/ 15, /*decel*/ 15),
+  RUN(),
+  END()
+};
+
+const uint8_t script_short_8[] PROGMEM = { // Corners out, straights in
+  DIRECTION(hand_mask(1, 2, 5, 6, 9, 10, 13, 14, 17), CW), // hand%4 == 1 or 2
+  DIRECTION(hand_mask(0, 3, 4, 7, 8, 11, 12, 15, 16), CCW),
+  TARGET(hand_mask(0, 1), steps_per_revolution),
+  TARGET(hand_mask(2, 3), int(steps_per_revolution*.625)),
+  TARGET(hand_mask(4, 5), int(steps_per_revolution*.25)),
+  TARGET(hand_mask(6, 7), int(steps_per_revolution*.875)),
+  TARGET(hand_mask(8, 9), int(steps_per_revolution*0.5)),
+  TARGET(hand_mask(10, 11), int(steps_per_revolution*.125)),
+  TARGET(hand_mask(12, 13), int(steps_per_revolution*.75)),
+  TARGET(hand_mask(14, 15), int(steps_per_revolution*.375)),
+  TARGET_CURRENT(hand_mask(16, 17)),
+  EQUAL_DURATION(/*extra rotations*/ 0, /*max_speed*/ 500, /*accel*/ 40, /*decel*/ 40),
+  RUN(),
+  WAIT(1500),
+  DIRECTION(hand_mask(1, 2, 5, 6, 9, 10, 13, 14), CCW),
+  DIRECTION(hand_mask(0, 3, 4, 7, 8, 11, 12, 15, 16, 17), CW),
+  FRAME_POSITIONS(),
+  EQUAL_DURATION(/*extra rotations*/ 0, /*max_speed*/ 500, /*accel*/ 40, /*decel*/ 40),
+  SHOW_TIME_EQUAL_DURATION(TIME_ALREADY_FETCHED, /*extra rotations*/ 0, /*max_speed*/ 50, /*accel*/ 50, /*decel*/ 50),
+  RUN(),
+  END()
+};
+
+const uint8_t script_short_9[] PROGMEM = { // Corners in, straights out
+  DIRECTION(hand_mask(1, 2, 5, 6, 9, 10, 13, 14, 17), CCW), // hand%4 == 1 or 2
+  DIRECTION(hand_mask(0, 3, 4, 7, 8, 11, 12, 15, 16), CW),
+  TARGET(hand_mask(0, 1), int(steps_per_revolution*0.5)),
+  TARGET(hand_mask(2, 3), int(steps_per_revolution*.125)),
+  TARGET(hand_mask(4, 5), int(steps_per_revolution*.75)),
+  TARGET(hand_mask(6, 7), int(steps_per_revolution*.375)),
+  TARGET(hand_mask(8, 9), int(steps_per_revolution)),
+  TARGET(hand_mask(10, 11), int(steps_per_revolution*.625)),
+  TARGET(hand_mask(12, 13), int(steps_per_revolution*.25)),
+  TARGET(hand_mask(14, 15), int(steps_per_revolution*.875)),
+  TARGET_CURRENT(hand_mask(16, 17)),
+  EQUAL_DURATION(/*extra rotations*/ 0, /*max_speed*/ 500, /*accel*/ 40, /*decel*/ 40),
+  RUN(),
+  WAIT_FOR_NEW_MINUTE(),
+  DIRECTION(hand_mask(1, 2, 5, 6, 9, 10, 13, 14), CW),
+  DIRECTION(hand_mask(0, 3, 4, 7, 8, 11, 12, 15), CCW),
+  DIRECTION(hand_mask(16, 17), CW),
+  FRAME_POSITIONS(),
+  EQUAL_DURATION(/*extra rotations*/ 0, /*max_speed*/ 500, /*accel*/ 40, /*decel*/ 40),
+  SHOW_TIME_EQUAL_DURATION(TIME_ALREADY_FETCHED, /*extra rotations*/ 0, /*max_speed*/ 50, /*accel*/ 50, /*decel*/ 50),
+  RUN(),
+  END()
+};
+
+const uint8_t script_short_12[] PROGMEM = { // One rotation after each other
+  DIRECTION(ALL_HANDS, CW),
+  DELAY(hand_mask(0), 0, 900), // Quarter of a revolution later for each next hand
+  DELAY(hand_mask(1), steps_per_revolution/4*1, 900),
+  DELAY(hand_mask(2), steps_per_revolution/4*2, 900),
+  DELAY(hand_mask(3), steps_per_revolution/4*3, 900),
+  DELAY(hand_mask(4), steps_per_revolution/4*4, 900),
+  DELAY(hand_mask(5), steps_per_revolution/4*5, 900),
+  DELAY(hand_mask(6), steps_per_revolution/4*6, 900),
+  DELAY(hand_mask(7), steps_per_revolution/4*7, 900),
+  DELAY(hand_mask(8), steps_per_revolution/4*8, 900),
+  DELAY(hand_mask(9), steps_per_revolution/4*9, 900),
+  DELAY(hand_mask(10), steps_per_revolution/4*10, 900),
+  DELAY(hand_mask(11), steps_per_revolution/4*11, 900),
+  DELAY(hand_mask(12), steps_per_revolution/4*12, 900),
+  DELAY(hand_mask(13), steps_per_revolution/4*13, 900),
+  DELAY(hand_mask(14), steps_per_revolution/4*14, 900),
+  DELAY(hand_mask(15), steps_per_revolution/4*15, 900),
+  DELAY(hand_mask(16), steps_per_revolution/4*16, 900),
+  DELAY(hand_mask(17), steps_per_revolution/4*17, 900),
+  SHOW_TIME_EQUAL_DURATION(TIME_ALREADY_FETCHED, /*extra rotations*/ 1, /*max_speed*/ 900, /*accel*/ 50, /*decel*/ 50),
+  RUN(),
+  END()
+};
+
+const uint8_t script_short_13[] PROGMEM = { // One rotation, each row after another
+  DIRECTION(ALL_HANDS, CW),
+  DELAY(hand_mask(2, 3, 14, 15), steps_per_revolution/3, 900),
+  DELAY(hand_mask(4, 5, 12, 13, 16, 17), steps_per_revolution/3*2, 900),
+  DELAY(hand_mask(6, 7, 10, 11), steps_per_revolution/3*3, 900),
+  DELAY(hand_mask(8, 9), steps_per_revolution/3*4, 900),
+  TARGET(ALL_HANDS, int(steps_per_revolution*0.5)),
+  WITH_DELAYS(/*extra rotations*/ 0, /*max_speed*/ 900, /*accel*/ 100, /*decel*/ 0, /*delay at start*/ true),
+  SHOW_TIME_WITH_DELAYS(TIME_ALREADY_FETCHED, /*extra rotations*/ 0, /*max_speed*/ 900, /*accel*/ 0, /*decel*/ 100),
+  RUN(),
+  END()
+};
@@ -0,0 +1,74 @@
+#ifndef Animationscript_h
+#define Animationscript_h
+
+#include <Arduino.h>
+
+// Animations as a list of byte codes in flash, played by Clockception::play_script(). Each code is followed by its arguments:
+// hands as an 18 bit mask in 3 bytes, numbers as 2 bytes little endian and fractions as a byte in percent.
+
+enum
+{
+    SCRIPT_END = 0,
+    SCRIPT_DIRECTION, // hands, direction (0 = CCW, 1 = CW)
+    SCRIPT_TARGET, // hands, position in steps
+    SCRIPT_TARGET_ADD, // hands, steps to add to the target position
+    SCRIPT_TARGET_CURRENT, // hands, target is the current position
+    SCRIPT_FRAME_POSITIONS, // set_clock_frame_positions()
+    SCRIPT_TIME_POSITIONS, // set_time_positions()
+    SCRIPT_GET_TIME, // get_time()
+    SCRIPT_CRUISE, // hands, steps, interval in micro seconds
+    SCRIPT_DELAY, // hands, steps, interval in micro seconds
+    SCRIPT_SAME_SPEED, // steps, speed: calculate_run_with_same_speed()
+    SCRIPT_EQUAL_DURATION, // extra rotations, max speed, accel, decel: calculate_animation_equal_duration()
+    SCRIPT_WITH_DELAYS, // extra rotations, max speed, accel, decel, delay at start: calculate_animation_with_delays()
+    SCRIPT_COORDINATED, // extra rotations, max speed, accel, decel: calculate_animation_coordinated()
+    SCRIPT_SHOW_TIME_EQUAL_DURATION, // time (99 = get time, 98 = already fetched), extra rotations, max speed, accel, decel: show_time_equal_duration()
+    SCRIPT_SHOW_TIME_WITH_DELAYS, // time, extra rotations, max speed, accel, decel: show_time_with_delays()
+    SCRIPT_RUN, // run_animation()
+    SCRIPT_RUN_COORDINATED, // run_coordinated_animation()
+    SCRIPT_WAIT, // milli seconds: wait()
+    SCRIPT_WAIT_FOR_NEW_MINUTE, // wait_for_new_minute()
+    SCRIPT_S_CURVE, // extra rotations, max speed, acceleration, jerk in 100 steps/s^3: calculate_animation_s_curve()
+    SCRIPT_TIME_OPTIMAL, // extra rotations, sync (0 = start together, 1 = arrive together, 2 = independent): calculate_animation_time_optimal()
+    SCRIPT_PATTERN_TARGET, // hands, pattern, first, step: pattern_targets(), patterns are in Clockgeometry.h
+    SCRIPT_PATTERN_DELAY, // hands, pattern, first, step, interval in micro seconds: pattern_delays()
+    SCRIPT_PATTERN_DIRECTION, // hands, pattern, direction of the even places: pattern_directions()
+    SCRIPT_MIRROR // hands: pattern_mirror()
+};
+
+// Hand masks
+constexpr uint32_t hand_mask() {
+  return 0;
+}
+
+template<typename... Hands>
+constexpr uint32_t hand_mask(int hand, Hands... hands) {
+  return (1UL << hand) | hand_mask(hands...);
+}
+
+#define ALL_HANDS 0x3FFFFUL
+#define FRAME_HANDS 0x0FFFFUL // All hands except the hour and minute hand of the clock in the middle
+#define EVEN_HANDS 0x15555UL // Hands with hand%2 == 0
+#define ODD_HANDS 0x2AAAAUL
+
+// Scripts of the animations, in flash
+extern const uint8_t script_long_1[] PROGMEM;
+extern const uint8_t script_long_2[] PROGMEM;
+extern const uint8_t script_long_4[] PROGMEM;
+extern const uint8_t script_long_5[] PROGMEM;
+extern const uint8_t script_long_6[] PROGMEM;
+extern const uint8_t script_long_7[] PROGMEM;
+extern const uint8_t script_long_9[] PROGMEM;
+extern const uint8_t script_long_10[] PROGMEM;
+extern const uint8_t script_long_11[] PROGMEM;
+extern const uint8_t script_short_1[] PROGMEM;
+extern const uint8_t script_short_2[] PROGMEM;
+extern const uint8_t script_short_3[] PROGMEM;
+extern const uint8_t script_short_6[] PROGMEM;
+extern const uint8_t script_short_7[] PROGMEM;
+extern const uint8_t script_short_8[] PROGMEM;
+extern const uint8_t script_short_9[] PROGMEM;
+extern const uint8_t script_short_12[] PROGMEM;
+extern const uint8_t script_short_13[] PROGMEM;
+
+#endif
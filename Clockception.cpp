@@ -1,23 +1,78 @@
 #include "Clockception.h"
+#include "Accelerationcurve.h"
+#include "Instructionpool.h"
+#include "Stepstatistics.h"
+#include "Cycleprofile.h"
+#include "Telemetry.h"
+#include "Animationscript.h"
+#include "Clockgeometry.h"
+#include "Syncbus.h"
+#include "Timebase.h"
 #include "settings.h"
+#include <avr/sleep.h>
+
+constexpr bool motor_pins_on_ports(int hand) {
+  // Checks recursively that all step and direction pins can be written directly to a port
+  return hand >= nr_of_hands || (pin_port(motors[hand][0]) != NO_PORT && pin_port(motors[hand][1]) != NO_PORT && motor_pins_on_ports(hand+1));
+}
+static_assert(motor_pins_on_ports(0), "Motor pin in settings.h is not a digital pin of the Arduino Mega");
+
+const Clockception::Animation_entry Clockception::_animation_table[26] PROGMEM = {
+  {LONG_1, script_long_1, 0, 0},
+  {LONG_2, script_long_2, 0, 0},
+  {LONG_3, 0, &Clockception::animation_long_3, &Clockception::plan_long_3},
+  {LONG_4, script_long_4, 0, 0},
+  {LONG_5, script_long_5, 0, 0},
+  {LONG_6, script_long_6, 0, 0},
+  {LONG_7, script_long_7, 0, 0},
+  {LONG_8, 0, &Clockception::run_animation, &Clockception::plan_long_8},
+  {LONG_9, script_long_9, 0, 0},
+  {LONG_10, script_long_10, 0, 0},
+  {LONG_11, script_long_11, 0, 0},
+  {LONG_12, 0, &Clockception::animation_long_12, &Clockception::plan_long_12},
+  {LONG_13, 0, &Clockception::animation_long_12, &Clockception::plan_long_12}, // Long 13 plays long 12, like the switch this table replaced
+  {SHORT_1, script_short_1, 0, 0},
+  {SHORT_2, script_short_2, 0, 0},
+  {SHORT_3, script_short_3, 0, 0},
+  {SHORT_4, 0, &Clockception::run_animation, &Clockception::plan_short_4},
+  {SHORT_5, 0, &Clockception::run_animation, &Clockception::plan_short_5},
+  {SHORT_6, script_short_6, 0, 0},
+  {SHORT_7, script_short_7, 0, 0},
+  {SHORT_8, script_short_8, 0, 0},
+  {SHORT_9, script_short_9, 0, 0},
+  {SHORT_10, 0, &Clockception::animation_short_10, &Clockception::plan_short_10},
+  {SHORT_11, 0, &Clockception::animation_short_10, &Clockception::plan_short_11},
+  {SHORT_12, script_short_12, 0, 0},
+  {SHORT_13, script_short_13, 0, 0}
+};
 
 Clockception::Clockception() {
   _max_speed = 1000.0;
-  _default_acceleration_curve_length = 100;
   _current_animation = 0;
+  _pending_event = NO_EVENT;
+  _last_button_check = 0;
+  _events_enabled = false;
+  _planned_animation = 0;
+  _planning_ahead = false;
+  _active_hands = 0;
+  _budget_left = 0;
+  _on_budget = false;
+  _predicted_movements = 0;
+  _next_movement = 0;
+  _predicting = false;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////// UTILITY /////////////////////////////////////////////////////////////////////////
 void Clockception::init() { 
   reset_drivers();
-  calculate_default_acceleration_curve();
 
   Serial.println(F("Creating clockhands"));
   for(int hand=0; hand<nr_of_hands; hand++) {
-    hands[hand] = new Clockhand(hand, motors[hand][0], motors[hand][1], motor_inverted[hand], steps_per_revolution, _acceleration_curves[hand]);
-    hands[hand]->clear_instructions();
-    hands[hand]->set_direction(true);
+    hands[hand].begin(hand, motors[hand][0], motors[hand][1], motor_inverted[hand], steps_per_revolution);
+    step_scheduler.attach_hand(hand, motors[hand][0], motors[hand][1]);
+    hands[hand].clear_instructions();
+    hands[hand].set_direction(true);
   }
 
   // Initiate RTC
@@ -27,50 +82,24 @@ void Clockception::init() {
     Serial.flush();
     while (1) delay(10);
   }
+  time_base.begin(rtc, rtc_sqw_pin);
+  get_time();
+  _last_minute = _minute; // No animation was shown yet, the first one starts on the next minute
 
   // Initiate buttons
   button_back = new Button(button_back_pin);
   button_forward = new Button(button_forward_pin);
   button_set = new Button(button_set_pin);
-}
-
-void Clockception::calculate_default_acceleration_curve() {
-  // Calculate the standard acceleration curve, of which all the hand-specific curves are derived. Equations from the accelstepper library.
-  int acceleration_speed = 4000;
-  
-  _cn = 0.676 * sqrt(2.0 / acceleration_speed) * 1000000.0; // Equation 15
-  _default_acceleration_curve[0] = int(_cn);
-  _total_acceleration_duration +=  _default_acceleration_curve[0];
-  //stepsToStop = (long)((_max_speed * _max_speed) / (2.0 * _acceleration_speed));
-
-  for(int i=1; i<_default_acceleration_curve_length; i++) { // Calculate the rest of the curve
-    _cn = _cn - ((2.0 * _cn) / ((4.0 * i) + 1.0));
-    _default_acceleration_curve[i] = int(_cn);
-    _total_acceleration_duration += _default_acceleration_curve[i];
-  }
 
-  _total_acceleration_duration = int(_total_acceleration_duration / 1000.0); // To ms instead of ns
-
-  _default_acceleration_curve_end_speed = _default_acceleration_curve[_default_acceleration_curve_length-1]; // Set end speed variable to calculate speed factors of hand-specific curves.
+  sync_bus.begin(sync_unit, sync_units, sync_baud);
 }
 
-void Clockception::calculate_corrected_curves() {
-  // Multiply the default curve with a factor so each hand will finish at the exact same time, depending on the amount of steps to take. Due to this factor, end speed of each hand will differ.
-  // If end speeds would be equal, each hand would finish at a different time.
-  for(int i=0; i<_default_acceleration_curve_length; i++) {
-      for(int hand=0; hand<nr_of_hands; hand++) {
-        _acceleration_curves[hand][i] = int(_default_acceleration_curve[i]*hands[hand]->_acceleration_speed_factor);
-      }
-    }
+Clockhand *Clockception::get_hand(int hand) {
+  return &hands[hand];
 }
 
 bool Clockception::hands_finished() {
-  // Check if all hands are finished
-  bool finished = true;
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(!hands[hand]->movement_finished()) finished = false;
-  }
-  return finished;
+  return _active_hands == 0;
 }
 
 void Clockception::disable_drivers() {
@@ -97,49 +126,345 @@ int Clockception::normalize(int value, int max, int min) {
 ///////////////////////////////////////////////////////////////////////////////// ANIMATION UTILITY /////////////////////////////////////////////////////////////////////////
 
 void Clockception::run_animation() {
-  Serial.print("Run animation ");
-  Serial.println(_current_animation);
+  if(_predicting) { // Only the duration counts, the hands are put where the movement ends
+    float max_speedup;
+    unsigned long predicted = movement_prediction(max_speedup);
+    add_prediction(predicted, max_speedup);
+    for(int hand=0; hand<nr_of_hands; hand++) hands[hand].skip_movement();
+    clear_all_instructions();
+    return;
+  }
+  _next_movement++;
 
-  _time_start_animation = millis();  // Set start time to check for maximal execution time.
-  
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    hands[hand]->get_next_instruction(); // Get first instruction
+  if(!instructions_complete()) {
+    telemetry.log(TELEMETRY_ANIMATION_SKIPPED, _current_animation, 0); // Animation does not fit in the instruction pool, skip it
+    clear_all_instructions();
+    return;
   }
 
-  while(!hands_finished()) { // Check if movement is complete
+  if(_pending_event != NO_EVENT) { // Button was pushed, skip the rest of the animation so the event is handled right away
+    clear_all_instructions();
+    return;
+  }
 
+  _time_start_animation = millis();  // Set start time to check for maximal execution time.
+  telemetry.log(TELEMETRY_ANIMATION_START, _current_animation, _time_start_animation);
+#ifdef STEP_STATISTICS
+  step_statistics.start_animation(_current_animation, _time_start_animation);
+#endif
+  unsigned long loops = 0;
+  
+  float max_speedup;
+  unsigned long predicted = movement_prediction(max_speedup);
+  float speedup = budget_speedup(predicted, max_speedup);
+  if(speedup > 1) {
+    for(int hand=0; hand<nr_of_hands; hand++) hands[hand].scale_speed(speedup);
+    // Loop time of a cruise step does not scale. What that fixed part is follows from the durations before and after, the rest is sped up to make up for it.
+    unsigned long scaled = 0;
     for(int hand=0; hand<nr_of_hands; hand++) {
-      hands[hand]->run_hand(); // Step hand if step is due
+      unsigned long duration = hands[hand].predicted_duration();
+      if(duration > scaled) scaled = duration;
+    }
+    float target = predicted / speedup;
+    float fixed = (speedup * scaled - predicted) / (speedup - 1);
+    float correction = fixed > 0 && fixed < target ? (scaled - fixed) / (target - fixed) : 1;
+    if(correction * speedup > max_speedup) correction = max_speedup / speedup;
+    if(correction > 1) {
+      for(int hand=0; hand<nr_of_hands; hand++) hands[hand].scale_speed(correction);
     }
+  }
+
+  _active_hands = 0;
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    hands[hand].start_movement(); // Get first instruction
+    if(!hands[hand].movement_finished()) _active_hands |= 1UL << hand; // Hands without instructions are finished right away
+  }
+
+  fill_step_queues();
+  step_scheduler.start(); // Steps are taken from the timer interrupt from now on
+
+  while(!hands_finished() || !step_scheduler.idle()) { // Check if movement is complete and all queued steps are taken
+
+    bool queued = fill_step_queues(); // Calculate steps ahead of the interrupt
+    tick(); // Buttons and telemetry in the time left until the next step
+    if(!queued) sleep(); // Queues are full, nothing to do until the interrupt takes a step
+    loops++;
+#ifdef STEP_STATISTICS
+    step_statistics.count_loop();
+#endif
     
-    if(millis()-_time_start_animation >= 120000) { // Animation is running for more than a minute, force finish
-      Serial.println(F("Animation is running longer than a minute, break out of loop"));
-      for(int hand=0; hand<nr_of_hands; hand++) {
-        hands[hand]->force_finished(); // Get first instruction
-      }
+    if(_pending_event != NO_EVENT) break; // Button was pushed, stop the hands where they are so the event is handled right away
+
+    if(millis()-_time_start_animation >= 120000) { // Movement is running for more than two minutes, something went wrong in its plan. Force finish.
+      telemetry.log(TELEMETRY_ANIMATION_TIMEOUT, _current_animation, 0);
+      break;
     }
 
   }
+
+  step_scheduler.stop();
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    hands[hand].stop_movement(step_scheduler.dropped_steps(hand)); // Hands that were stopped halfway keep the steps they took
+  }
+  _active_hands = 0;
+#ifdef STEP_STATISTICS
+  step_statistics.end_animation();
+#endif
+  log_animation_end(loops);
   
   // Movement complete, reset instructions
+  clear_all_instructions();
+}
+
+void Clockception::run_coordinated_animation() {
+  unsigned int max_speed = 0xFFFF; // Slowest motor that moves, any hand may be the one with the most steps
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    if(coordinator.steps(hand) > 0 && motor_max_speed[hand] < max_speed) max_speed = motor_max_speed[hand];
+  }
+  if(_predicting) { // Only the duration counts, the hands are put where the movement ends
+    add_prediction(coordinator.predicted_duration(), coordinator.max_speedup(max_speed));
+    for(int hand=0; hand<nr_of_hands; hand++) hands[hand].add_steps(coordinator.steps(hand));
+    coordinator.clear();
+    clear_all_instructions();
+    return;
+  }
+  _next_movement++;
+
+  if(_pending_event != NO_EVENT) { // Button was pushed, skip the rest of the animation so the event is handled right away
+    coordinator.clear();
+    clear_all_instructions();
+    return;
+  }
+
+  _time_start_animation = millis();  // Set start time to check for maximal execution time.
+  telemetry.log(TELEMETRY_ANIMATION_START, _current_animation, _time_start_animation);
+#ifdef STEP_STATISTICS
+  step_statistics.start_animation(_current_animation, _time_start_animation);
+#endif
+  unsigned long loops = 0;
+
+  float speedup = budget_speedup(coordinator.predicted_duration(), coordinator.max_speedup(max_speed));
+  if(speedup > 1) coordinator.scale_speed(speedup);
+
+  coordinator.start();
+  coordinator.fill_step_queues();
+  step_scheduler.start(); // Steps are taken from the timer interrupt from now on
+
+  while(!coordinator.finished() || !step_scheduler.idle()) { // Check if all ticks are queued and all queued steps are taken
+
+    bool queued = coordinator.fill_step_queues(); // Distribute the steps of the next ticks ahead of the interrupt
+    tick(); // Buttons and telemetry in the time left until the next step
+    if(!queued) sleep(); // Queues are full, nothing to do until the interrupt takes a step
+    loops++;
+#ifdef STEP_STATISTICS
+    step_statistics.count_loop();
+#endif
+
+    if(_pending_event != NO_EVENT) break; // Button was pushed, stop the hands where they are so the event is handled right away
+
+    if(millis()-_time_start_animation >= 120000) { // Movement is running for more than two minutes, something went wrong in its plan. Force finish.
+      telemetry.log(TELEMETRY_ANIMATION_TIMEOUT, _current_animation, 0);
+      break;
+    }
+
+  }
+
+  step_scheduler.stop();
+#ifdef STEP_STATISTICS
+  step_statistics.end_animation();
+#endif
+
+  // Movement complete or stopped, hands did not follow their own instructions so update their positions here. Steps only go forward, in the
+  // direction that was set before the move.
   for(int hand=0; hand<nr_of_hands; hand++) {
-    hands[hand]->clear_instructions(); // Clear instruction memory of all hands.
+    hands[hand].add_steps(coordinator.queued_steps(hand) - step_scheduler.dropped_steps(hand));
   }
+  log_animation_end(loops);
+  coordinator.clear();
+  clear_all_instructions();
+}
+
+void Clockception::start_budget() {
+  if(animation_budget == 0) return;
+  _budget_left = ((long)animation_budget - _second * 1000L) * 1000;
+  _on_budget = true;
+}
+
+float Clockception::budget_speedup(unsigned long predicted, float max_speedup) {
+  if(!_on_budget) return 1;
+  telemetry.log(TELEMETRY_MOVEMENT_PREDICTED, _current_animation, predicted / 1000);
+
+  // Movements and waits after this one, as predicted when the animation started
+  unsigned long rest = 0;
+  for(uint8_t i=_next_movement; i<_predicted_movements; i++) rest += _movement_durations[i];
+
+  float speedup = 1;
+  if(predicted > 0 && long(predicted + rest) > _budget_left) {
+    speedup = _budget_left > 0 ? float(predicted + rest) / _budget_left : max_speedup;
+    while(speedup < max_speedup) { // Movements after this one that can not go as fast take their own time, the others share what is left
+      float slow = 0;
+      unsigned long fast = predicted;
+      for(uint8_t i=_next_movement; i<_predicted_movements; i++) {
+        if(_movement_speedups[i] < speedup) slow += _movement_durations[i] / _movement_speedups[i];
+        else fast += _movement_durations[i];
+      }
+      float needed = slow < _budget_left ? fast / (_budget_left - slow) : max_speedup;
+      if(needed <= speedup) break;
+      speedup = needed;
+    }
+    if(speedup > max_speedup) speedup = max_speedup; // Does not fit, end as early as the motors allow
+    if(speedup > 1) telemetry.log(TELEMETRY_MOVEMENT_SCALED, _current_animation, (unsigned long)(100 * speedup + 0.5));
+    else speedup = 1;
+  }
+  _budget_left -= long(predicted / speedup);
+  return speedup;
+}
+
+void Clockception::predict_animation(const Animation_entry &entry) {
+  Hand_plan_state states[nr_of_hands];
+  for(int hand=0; hand<nr_of_hands; hand++) hands[hand].save_plan_state(states[hand]);
+  unsigned long seed = random(1, 0x7FFFFFFF); // Same random choices in the prediction and when the animation plays
+  randomSeed(seed);
+
+  _predicted_movements = 0;
+  _predicting = true;
+  if(entry.script) interpret_script(entry.script, false);
+  else {
+    (this->*entry.plan)();
+    (this->*entry.function)();
+  }
+  _predicting = false;
+  _next_movement = 0;
+
+  coordinator.clear();
+  clear_all_instructions(); // Planned before a wait for a new minute, it is planned again when it plays
+  for(int hand=0; hand<nr_of_hands; hand++) hands[hand].restore_plan_state(states[hand]);
+  randomSeed(seed);
+}
+
+void Clockception::add_prediction(unsigned long duration, float max_speedup) {
+  if(_predicted_movements < MAX_PREDICTED_MOVEMENTS) {
+    _movement_durations[_predicted_movements] = 0;
+    _movement_speedups[_predicted_movements++] = max_speedup;
+  }
+  uint8_t last = _predicted_movements - 1;
+  _movement_durations[last] += duration;
+  if(max_speedup < _movement_speedups[last]) _movement_speedups[last] = max_speedup;
+}
+
+unsigned long Clockception::movement_prediction(float &max_speedup) {
+  // All hands are sped up by the same factor, so they still move together. The hand closest to its speed limit sets how far that can go.
+  unsigned long predicted = 0;
+  max_speedup = 0;
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    hands[hand].blend_junctions(); // All movements of the animation are planned, so joins between them are known
+    unsigned long duration = hands[hand].predicted_duration();
+    if(duration > predicted) predicted = duration;
+    float speedup = hands[hand].max_speedup(motor_max_speed[hand]);
+    if(max_speedup == 0 || speedup < max_speedup) max_speedup = speedup;
+  }
+  return predicted;
+}
+
+void Clockception::log_animation_end(unsigned long loops) {
+  telemetry.log(TELEMETRY_ANIMATION_STOP, _current_animation, millis() - _time_start_animation);
+  telemetry.log(TELEMETRY_ANIMATION_LOOPS, _current_animation, loops);
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    telemetry.log(TELEMETRY_HAND_POSITION, hand, hands[hand].current_position);
+  }
+}
+
+bool Clockception::instructions_complete() {
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    if(hands[hand].instructions_dropped()) return false;
+  }
+  return true;
+}
+
+void Clockception::clear_all_instructions() {
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    hands[hand].clear_instructions(); // Clear instruction memory of all hands.
+  }
+  instruction_pool.clear(); // No hand refers to the pool anymore
+}
+
+bool Clockception::fill_step_queues() {
+  unsigned long interval;
+  byte flags;
+  unsigned int count;
+  bool queued = false;
+
+  // Only the hands that still have steps, hands of a short movement do not cost a call per loop after they finished
+  uint32_t active = _active_hands;
+  for(uint8_t hand=0; active != 0; hand++, active >>= 1) {
+    if(!(active & 1)) continue;
+    while(step_scheduler.queue_free(hand) > 0 && hands[hand].next_steps(interval, flags, count)) {
+      step_scheduler.queue_steps(hand, interval, flags, count);
+      queued = true;
+    }
+    if(hands[hand].movement_finished()) _active_hands &= ~(1UL << hand);
+  }
+  return queued;
+}
+
+unsigned long Clockception::planned_duration() {
+  unsigned long duration = 0;
+  unsigned long steps;
+
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    unsigned long hand_duration = hands[hand].planned_duration(steps);
+    if(hand_duration > duration) duration = hand_duration;
+  }
+  return duration;
 }
 
 void Clockception::set_direction_of_all_hands(bool direction) {
-  for(int hand=0; hand<nr_of_hands; hand++) hands[hand]->set_direction(direction);
+  for(int hand=0; hand<nr_of_hands; hand++) hands[hand].set_direction(direction);
 }
 
 void Clockception::set_shortest_direction_to_target() {
   for(int hand=0; hand<nr_of_hands; hand++) {
     // Calculate CW steps to target
-    int steps_cw = hands[hand]->target_position - hands[hand]->virtual_position;
+    int steps_cw = hands[hand].target_position - hands[hand].virtual_position;
     while(steps_cw < 0) steps_cw += steps_per_revolution;
 
     // If smaller than half a revolution, set CW direction
-    if(steps_cw <= int(.5*steps_per_revolution)) hands[hand]->set_direction(CW);
-    else hands[hand]->set_direction(CCW);
+    if(steps_cw <= int(.5*steps_per_revolution)) hands[hand].set_direction(CW);
+    else hands[hand].set_direction(CCW);
+  }
+}
+
+void Clockception::pattern_targets(uint32_t mask, uint8_t pattern, int first, int step) {
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    if(!(mask & (1UL << hand))) continue;
+    int target = first + step * pattern_place(pattern, hand);
+    while(target < 0) target += steps_per_revolution;
+    while(target > int(steps_per_revolution)) target -= steps_per_revolution; // A full revolution stays one, like the targets of the scripts
+    hands[hand].target_position = target;
+  }
+}
+
+void Clockception::pattern_delays(uint32_t mask, uint8_t pattern, int first, int step, int interval) {
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    if(!(mask & (1UL << hand))) continue;
+    int steps = first + step * pattern_place(pattern, hand);
+    if(steps > 0) hands[hand].set_instruction(DELAY, steps, interval);
+  }
+}
+
+void Clockception::pattern_directions(uint32_t mask, uint8_t pattern, bool direction) {
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    if(!(mask & (1UL << hand))) continue;
+    hands[hand].set_direction(pattern_place(pattern, hand) % 2 == 0 ? direction : !direction);
+  }
+}
+
+void Clockception::pattern_mirror(uint32_t mask) {
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    if(!(mask & (1UL << hand))) continue;
+    int mirror = mirror_hand(hand);
+    hands[hand].target_position = normalize(steps_per_revolution - hands[mirror].target_position, steps_per_revolution, 0);
+    hands[hand].set_direction(!hands[mirror].direction);
   }
 }
 
@@ -150,58 +475,61 @@ void Clockception::calculate_steps_to_positions(char extra_rotations) {
   for(int hand=0; hand<nr_of_hands; hand++) {
 
     // Determine for each hand how many steps should be taken to reach end position
-    if(hands[hand]->virtual_direction == CW) {
+    if(hands[hand].virtual_direction == CW) {
       // CW movement
-      if(hands[hand]->target_position >= hands[hand]->virtual_position) {
+      if(hands[hand].target_position >= hands[hand].virtual_position) {
         // Target lies ahead of current virtual position (in line with direction)
-        hands[hand]->steps_to_take = hands[hand]->target_position - hands[hand]->virtual_position;
+        hands[hand].steps_to_take = hands[hand].target_position - hands[hand].virtual_position;
       }
       else {
         // Target lies back of current virtual position
-        hands[hand]->steps_to_take = hands[hand]->target_position - hands[hand]->virtual_position + steps_per_revolution;
+        hands[hand].steps_to_take = hands[hand].target_position - hands[hand].virtual_position + steps_per_revolution;
       }
     }
     else {
       // CCW movement
-      if(hands[hand]->target_position <= hands[hand]->virtual_position) {
+      if(hands[hand].target_position <= hands[hand].virtual_position) {
         // Target lies back of current virtual position (in line with direction)
-        hands[hand]->steps_to_take = hands[hand]->virtual_position - hands[hand]->target_position;
+        hands[hand].steps_to_take = hands[hand].virtual_position - hands[hand].target_position;
       }
       else {
         // Target lies ahead of current virtual position
-        hands[hand]->steps_to_take = hands[hand]->virtual_position - hands[hand]->target_position + steps_per_revolution;
+        hands[hand].steps_to_take = hands[hand].virtual_position - hands[hand].target_position + steps_per_revolution;
       }
 
     }
 
-    hands[hand]->steps_to_take += extra_rotations*steps_per_revolution; // Account for extra rotations
+    hands[hand].steps_to_take += extra_rotations*steps_per_revolution; // Account for extra rotations
 
     // Set minimum and maximum steps to take (for calculation of relative speeds)
-    if(hands[hand]->steps_to_take > _max_steps_to_take) _max_steps_to_take = hands[hand]->steps_to_take;
-    if(hands[hand]->steps_to_take < _min_steps_to_take) _min_steps_to_take = hands[hand]->steps_to_take;
+    if(hands[hand].steps_to_take > _max_steps_to_take) _max_steps_to_take = hands[hand].steps_to_take;
+    if(hands[hand].steps_to_take < _min_steps_to_take) _min_steps_to_take = hands[hand].steps_to_take;
 
   }
 }
 
 void Clockception::calculate_animation_with_delays(char extra_rotations, unsigned int max_speed, float accel_fraction, float decel_fraction, bool delay_at_start) {
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_PLAN);
+#endif
   calculate_steps_to_positions(extra_rotations);
   int speed = int(1000000/max_speed); // Set speed from steps per time unit to step_interval;
 
   for(int hand=0; hand<nr_of_hands; hand++) {
     
     
-    if(hands[hand]->steps_to_take != 0) {
+    if(hands[hand].steps_to_take != 0) {
 
-      int steps_to_delay = _max_steps_to_take - hands[hand]->steps_to_take; // Since hands will have exactly same speed, each hand should wait for de hand with the longest way to go.
+      int steps_to_delay = _max_steps_to_take - hands[hand].steps_to_take; // Since hands will have exactly same speed, each hand should wait for de hand with the longest way to go.
       //unsigned int start_delay = int(steps_to_delay/float(1000)*speed); // Time in ms hand can wait to start to reach end at same time and same speed
-      // if(hand == 0) Serial.println((String)"Steps to take: "+hands[hand]->steps_to_take);
-      unsigned int steps_remaining = hands[hand]->steps_to_take;
+      // if(hand == 0) Serial.println((String)"Steps to take: "+hands[hand].steps_to_take);
+      unsigned int steps_remaining = hands[hand].steps_to_take;
       unsigned int steps_accelerating = 0;
       unsigned int steps_cruising = 0;
       
       if(steps_to_delay > 0 && delay_at_start) {
         // if(hand == 0) Serial.println("Delay");
-        hands[hand]->set_instruction(DELAY, steps_to_delay, speed); // Program delay, if delay needed at start
+        hands[hand].set_instruction(DELAY, steps_to_delay, speed); // Program delay, if delay needed at start
       }
       
       if(accel_fraction > 0) {
@@ -209,165 +537,191 @@ void Clockception::calculate_animation_with_delays(char extra_rotations, unsigne
         // if(hand == 0) Serial.println((String)"cruising_fraction: "+cruising_fraction);
 
         if(delay_at_start) steps_accelerating = int(_min_steps_to_take*accel_fraction);
-        else steps_accelerating = int(hands[hand]->steps_to_take*accel_fraction);
+        else steps_accelerating = int(hands[hand].steps_to_take*accel_fraction);
        
         if(steps_accelerating > 0) {
           // if(hand == 0) Serial.println("Accel");
-          hands[hand]->set_instruction(ACCELERATE, steps_accelerating, speed); // Accelerate, leave steps for decel
+          hands[hand].set_instruction(ACCELERATE, steps_accelerating, speed); // Accelerate, leave steps for decel
         }
         
-        steps_remaining -= steps_accelerating;
-        hands[hand]->_acceleration_speed_factor = speed/float(_default_acceleration_curve_end_speed); // All hands will accelerate at same speed
-        hands[hand]->_accel_speed = speed;
+        steps_remaining = subtract_steps(steps_remaining, steps_accelerating, hand);
+        hands[hand]._acceleration_speed_factor = speed/float(acceleration_curve_end_interval); // All hands will accelerate at same speed
+        hands[hand]._accel_speed = speed;
       }
       
       if(decel_fraction > 0) {
-        if(delay_at_start) steps_cruising = int(_min_steps_to_take*(1-accel_fraction-decel_fraction) + hands[hand]->steps_to_take-_min_steps_to_take);
-        else steps_cruising = int(hands[hand]->steps_to_take*(1-accel_fraction-decel_fraction));
+        if(delay_at_start) steps_cruising = int(_min_steps_to_take*(1-accel_fraction-decel_fraction) + hands[hand].steps_to_take-_min_steps_to_take);
+        else steps_cruising = int(hands[hand].steps_to_take*(1-accel_fraction-decel_fraction));
       }
       else steps_cruising = steps_remaining;
       // if(hand == 0) Serial.println((String)"Steps cruising: "+steps_cruising);
       if(steps_cruising > 0) {
         // if(hand == 0) Serial.println("Cruise");
-        hands[hand]->set_instruction(CRUISE, steps_cruising, speed); // Cruise
+        hands[hand].set_instruction(CRUISE, steps_cruising, speed); // Cruise
       }
 
 
       if(decel_fraction > 0) {
         
-        steps_remaining -= steps_cruising;
-        hands[hand]->_accel_vs_decel_speed_factor = 1;
+        steps_remaining = subtract_steps(steps_remaining, steps_cruising, hand);
+        hands[hand]._accel_vs_decel_speed_factor = 1;
         // if(hand == 0) Serial.println((String)"Steps decel: "+steps_remaining);
         // if(hand == 0) Serial.println("Decel");
-        hands[hand]->set_instruction(DECELERATE, steps_remaining, speed); // Decelerate with steps left from accel and cruise
+        hands[hand].set_instruction(DECELERATE, steps_remaining, speed); // Decelerate with steps left from accel and cruise
       }
 
       if(steps_to_delay > 0 && !delay_at_start) {
         
         // if(hand == 0) Serial.println("Delay end");
-        hands[hand]->set_instruction(DELAY, steps_to_delay, speed);
+        hands[hand].set_instruction(DELAY, steps_to_delay, speed);
       }
 
     }
 
     
   }
-    
-  calculate_corrected_curves(); // Precalculate the acceleration curve that leads to desired end speed (still same length as original curve)
+}
+
+unsigned int Clockception::subtract_steps(unsigned int steps, unsigned int part, int hand) {
+  if(part > steps) telemetry.log(TELEMETRY_STEPS_UNDERFLOW, hand, _current_animation); // Rounding gave a part more steps than the hand takes, the result wraps around
+  return steps - part;
 }
 
 void Clockception::calculate_animation_equal_duration(char extra_rotations, unsigned int max_speed, float accel_fraction, float decel_fraction) {
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_PLAN);
+#endif
   calculate_steps_to_positions(extra_rotations);
 
   for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hands[hand]->steps_to_take != 0) { // Calculate only if hands needs to take 1 or more steps.
+    if(hands[hand].steps_to_take != 0) { // Calculate only if hands needs to take 1 or more steps.
 
-      int speed = hands[hand]->steps_to_take/float(_max_steps_to_take)*max_speed; // Set speed based on relative steps to take from max steps to take (to end at same time)
+      int speed = hands[hand].steps_to_take/float(_max_steps_to_take)*max_speed; // Set speed based on relative steps to take from max steps to take (to end at same time)
+      if(speed < 31) speed = 31; // A hand with a few steps rounds to 0, and the interval of a slower speed does not fit in an int
       speed = int(1000000/speed); // Set speed from steps per time unit to step_interval;
 
-      unsigned int steps_remaining = hands[hand]->steps_to_take; // Steps that need to be incorporated in an instruction
+      unsigned int steps_remaining = hands[hand].steps_to_take; // Steps that need to be incorporated in an instruction
       unsigned int steps_accelerating = 0;
       unsigned int steps_cruising = 0;
       
       if(accel_fraction > 0) {
-        steps_accelerating = int(hands[hand]->steps_to_take*accel_fraction); // Steps accelerating = steps not cruising
+        steps_accelerating = int(hands[hand].steps_to_take*accel_fraction); // Steps accelerating = steps not cruising
 
-        hands[hand]->set_instruction(ACCELERATE, steps_accelerating, speed); // Program acceleration part.
-        steps_remaining -= steps_accelerating;
+        hands[hand].set_instruction(ACCELERATE, steps_accelerating, speed); // Program acceleration part.
+        steps_remaining = subtract_steps(steps_remaining, steps_accelerating, hand);
 
         /* Speed depends on steps to take relative to maximum steps to take. Since all hands should arrive at the finish at the same time, the acceleration curve 
         should also be corrected for this speed. */
-        float _acceleration_speed_factor = speed/float(_default_acceleration_curve_end_speed);
-        hands[hand]->_acceleration_speed_factor = _acceleration_speed_factor;
-        hands[hand]->_accel_speed = speed; // Save this speed, so later an deceleration speed factor can be calculated
+        float _acceleration_speed_factor = speed/float(acceleration_curve_end_interval);
+        hands[hand]._acceleration_speed_factor = _acceleration_speed_factor;
+        hands[hand]._accel_speed = speed; // Save this speed, so later an deceleration speed factor can be calculated
       }
       
-      if(decel_fraction > 0) steps_cruising = int(hands[hand]->steps_to_take*(1-accel_fraction-decel_fraction));
+      if(decel_fraction > 0) steps_cruising = int(hands[hand].steps_to_take*(1-accel_fraction-decel_fraction));
       else steps_cruising = steps_remaining; // Should be equal to line above, but accounts for rounding differences 
       
-      if(steps_cruising > 0) hands[hand]->set_instruction(CRUISE, steps_cruising, speed); // Cruise
-      steps_remaining -= steps_cruising; 
+      if(steps_cruising > 0) hands[hand].set_instruction(CRUISE, steps_cruising, speed); // Cruise
+      steps_remaining = subtract_steps(steps_remaining, steps_cruising, hand);
       
       if(decel_fraction > 0) {
-        hands[hand]->set_instruction(DECELERATE, steps_remaining, speed); // Decelerate with steps left from accel and cruise
-        hands[hand]->_accel_vs_decel_speed_factor = speed/float(hands[hand]->_accel_speed); // Calculate speed factor of deceleration in relation to acceleration, 
+        hands[hand].set_instruction(DECELERATE, steps_remaining, speed); // Decelerate with steps left from accel and cruise
+        hands[hand]._accel_vs_decel_speed_factor = speed/float(hands[hand]._accel_speed); // Calculate speed factor of deceleration in relation to acceleration, 
         // Since only an corrected acceleration curve is computed, not for deceleration.
       }
       
     }
     
   }
-  
-  calculate_corrected_curves(); // Precalculate the acceleration curve that leads to desired end speed (still same length as original curve)
 }
 
-void Clockception::calculate_run_with_same_speed(unsigned int steps, unsigned int speed) {
+void Clockception::calculate_animation_coordinated(char extra_rotations, unsigned int max_speed, float accel_fraction, float decel_fraction) {
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_PLAN);
+#endif
+  calculate_steps_to_positions(extra_rotations);
+
+  coordinator.clear();
   for(int hand=0; hand<nr_of_hands; hand++) {
-    hands[hand]->set_instruction(CRUISE, steps, int(1000000/speed)); // Cruise
+    coordinator.set_hand(hand, hands[hand].steps_to_take);
+    hands[hand].virtual_position = normalize(hands[hand].target_position, steps_per_revolution, 0); // Hand will be at its target after the move
   }
+  coordinator.set_profile(int(1000000/max_speed), accel_fraction, decel_fraction); // Set speed from steps per time unit to step_interval
 }
 
-void Clockception::calculate_run_with_speed(int *types, unsigned int *steps, unsigned int *speeds) {
+void Clockception::calculate_animation_s_curve(char extra_rotations, unsigned int max_speed, unsigned int acceleration, unsigned long jerk) {
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_PLAN);
+#endif
+  calculate_steps_to_positions(extra_rotations);
+
   for(int hand=0; hand<nr_of_hands; hand++) {
-    if(types[hand] == CRUISE) hands[hand]->set_instruction(CRUISE, steps[hand], int(1000000/speeds[hand])); // Cruise
-    else if (types[hand] == DELAY) hands[hand]->set_instruction(DELAY, steps[hand], int(1000000/speeds[hand])); // Cruise
+    if(hands[hand].steps_to_take == 0) continue;
+
+    unsigned int top_speed = Clockhand::s_curve_speed(hands[hand].steps_to_take, max_speed, acceleration, jerk); // Short moves do not reach max_speed
+    int speed = int((1000000UL + top_speed - 1) / top_speed); // Interval rounded up, so the hand does not pass its speed
+    hands[hand]._s_curve_acceleration_limit = acceleration;
+    hands[hand]._s_curve_jerk = jerk;
+    hands[hand].set_instruction(S_CURVE, hands[hand].steps_to_take, speed);
+
+    // A later deceleration without acceleration, like the one of show time, follows the curve from this speed
+    hands[hand]._acceleration_speed_factor = speed/float(acceleration_curve_end_interval);
+    hands[hand]._accel_speed = speed;
+    hands[hand]._accel_vs_decel_speed_factor = 1;
   }
 }
 
-///////////////////////////////////////////////////////////////////////////////// LONG ANIMATIONS /////////////////////////////////////////////////////////////////////////
+void Clockception::calculate_animation_time_optimal(char extra_rotations, uint8_t sync) {
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_PLAN);
+#endif
+  calculate_steps_to_positions(extra_rotations);
 
-void Clockception::animation_long_1() { // Strech_and_turn
-  set_direction_of_all_hands(CW);
-  
+  // Time of the last step. After a delay the first step waits its interval, so with SYNC_ARRIVE every hand starts with one.
+  unsigned long durations[nr_of_hands];
+  unsigned long longest = 0;
   for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 1) hands[hand]->target_position = int(steps_per_revolution*.5);
-    else hands[hand]->target_position = steps_per_revolution;
+    durations[hand] = 0;
+    if(hands[hand].steps_to_take == 0) continue;
+    unsigned long first_interval;
+    durations[hand] = Clockhand::trapezoid_duration(hands[hand].steps_to_take, motor_max_speed[hand], motor_max_acceleration[hand], first_interval);
+    if(sync == SYNC_ARRIVE) durations[hand] += first_interval;
+    if(durations[hand] > longest) longest = durations[hand];
   }
-  
-  unsigned int max_speed = 600;
-  // Calculate and set instructions for to stretch movement
-  calculate_animation_with_delays(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.9, /*decel*/ 0.0, /*delay at start*/ true);
 
-  // Rotations
-  calculate_run_with_same_speed(steps_per_revolution*2, max_speed);
-  
-  // Show time
-  show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.0, /*decel*/ 0.2);
-  
-  run_animation();
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    unsigned long duration = durations[hand];
+    if(sync == SYNC_ARRIVE) hands[hand].set_delay(longest - duration);
+    if(hands[hand].steps_to_take != 0) hands[hand].set_trapezoid(hands[hand].steps_to_take, motor_max_speed[hand], motor_max_acceleration[hand]);
+    if(sync == SYNC_START) hands[hand].set_delay(longest - duration); // Next movement starts together
+  }
 }
 
-void Clockception::animation_long_2() { // Opposite rotation
-  for(int hand = 0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 0) hands[hand]->set_direction(CW);
-    else hands[hand]->set_direction(CCW);
-    hands[hand]->target_position = 0;
+void Clockception::calculate_run_with_same_speed(unsigned int steps, unsigned int speed) {
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    hands[hand].set_instruction(CRUISE, steps, int(1000000/speed)); // Cruise
+  }
+}
+
+void Clockception::calculate_run_with_speed(int *types, unsigned int *steps, unsigned int *speeds) {
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    if(types[hand] == CRUISE) hands[hand].set_instruction(CRUISE, steps[hand], int(1000000/speeds[hand])); // Cruise
+    else if (types[hand] == DELAY) hands[hand].set_instruction(DELAY, steps[hand], int(1000000/speeds[hand])); // Cruise
   }
-  
-  unsigned int max_speed = 800;
-  
-  calculate_animation_with_delays(/*extra rotations*/ 1, /*max_speed*/ max_speed, /*accel*/ 1.0, /*decel*/ 0.0, /*delay at start*/ true);
-  // Rotate
-  
-  calculate_run_with_same_speed(steps_per_revolution*2, max_speed);
-  
-  // Show time
-  show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.0, /*decel*/ 0.2);
-  
-  run_animation();
 }
 
+///////////////////////////////////////////////////////////////////////////////// LONG ANIMATIONS /////////////////////////////////////////////////////////////////////////
+
 void Clockception::animation_long_3_to_birds() {
   for(int hand = 0; hand<nr_of_hands; hand++) {
     long offset = 0;
     if(hand%2 == 0) {
       long offset = random(-int(0.08*steps_per_revolution), int(0.08*steps_per_revolution));
-      hands[hand]->set_direction(CW);
-      hands[hand]->target_position = int(.85*steps_per_revolution) + offset;
+      hands[hand].set_direction(CW);
+      hands[hand].target_position = int(.85*steps_per_revolution) + offset;
     }
     else {
-      hands[hand]->set_direction(CCW);
-      hands[hand]->target_position = int(.15*steps_per_revolution) + offset;
+      hands[hand].set_direction(CCW);
+      hands[hand].target_position = int(.15*steps_per_revolution) + offset;
     }
   }
 }
@@ -377,23 +731,26 @@ void Clockception::animation_long_3_to_bottom() {
   for(int hand = 0; hand<nr_of_hands; hand++) {
     if(hand%2 == 0) {
       offset = random(-int(0.08*steps_per_revolution), int(0.08*steps_per_revolution));
-      hands[hand]->set_direction(CCW);
-      hands[hand]->target_position = int(.65*steps_per_revolution) + offset;
+      hands[hand].set_direction(CCW);
+      hands[hand].target_position = int(.65*steps_per_revolution) + offset;
     }
     else {
-      hands[hand]->set_direction(CW);
-      hands[hand]->target_position = int(.35*steps_per_revolution) + offset;
+      hands[hand].set_direction(CW);
+      hands[hand].target_position = int(.35*steps_per_revolution) + offset;
     }
   } 
 }
 
-void Clockception::animation_long_3() { // Bird shapes
-
+void Clockception::plan_long_3() { // Bird shapes
   animation_long_3_to_birds();
   
   unsigned int max_speed = 1000;
   // To bird shape
   calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.5, /*decel*/ 0.5);
+}
+
+void Clockception::animation_long_3() { // Bird shapes, planned by plan_long_3()
+  unsigned int max_speed = 1000;
   run_animation();
   
   // Loop 3 times
@@ -422,135 +779,7 @@ void Clockception::animation_long_3() { // Bird shapes
   run_animation();
 }
 
-void Clockception::animation_long_4() { // Opposite rotation with different speeds
-  for(int hand = 0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 0) hands[hand]->set_direction(CW);
-    else hands[hand]->set_direction(CCW);
-    hands[hand]->target_position = 0;
-  }
-  
-  unsigned int max_speed = 800;
-  
-  // Should use calculate_animation_with_delays and different speeds
-  calculate_animation_with_delays(/*extra rotations*/ 1, /*max_speed*/ max_speed, /*accel*/ 1.0, /*decel*/ 0.0, /*delay at start*/ true);
-  // Rotate
-
-  unsigned int steps[nr_of_hands];
-  unsigned int speeds[nr_of_hands];
-  int types[nr_of_hands];
-
-  for(int hand = 0; hand<nr_of_hands; hand++) {
-    types[hand] = CRUISE;
-    if(hand%2 == 0) {
-      steps[hand] = steps_per_revolution*1.5;
-      speeds[hand] = int(1.15/2.0*max_speed);
-    }
-    else {
-      steps[hand] = steps_per_revolution*2;
-      speeds[hand] = max_speed;
-    }
-  }
-
-  calculate_run_with_speed(types, steps, speeds);
-  
-  // Show time
-  show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.0, /*decel*/ 0.4);
-  
-  run_animation();
-}
-
-void Clockception::animation_long_5() { // Opposite rotation oriented to center simultaniously
-
-  for(int hand = 0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 0 || hand >= 16) hands[hand]->set_direction(CW);
-    else hands[hand]->set_direction(CCW);
-
-    if(hand<=1) hands[hand]->target_position = steps_per_revolution*.5;
-    else if(hand<=3) hands[hand]->target_position = int(steps_per_revolution*.625);
-    else if(hand<=5) hands[hand]->target_position = int(steps_per_revolution*.75);
-    else if(hand<=7) hands[hand]->target_position = int(steps_per_revolution*.875);
-    else if(hand<=9) hands[hand]->target_position = int(steps_per_revolution);
-    else if(hand<=11) hands[hand]->target_position = int(steps_per_revolution*.125);
-    else if(hand<=13) hands[hand]->target_position = int(steps_per_revolution*.25);
-    else if(hand<=15) hands[hand]->target_position = int(steps_per_revolution*.375);
-    else if(hand==16) hands[hand]->target_position = int(steps_per_revolution);
-    else if(hand==17) hands[hand]->target_position = int(steps_per_revolution*.5);
-  }
-  
-  unsigned int max_speed = 800;
-  
-  calculate_animation_with_delays(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 1.0, /*decel*/ 0.0, /*delay at start*/ true);
-  // Rotate
-
-  calculate_run_with_same_speed(steps_per_revolution*2, max_speed);
-  
-  // Show time
-  show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.0, /*decel*/ 0.4);
-  
-  run_animation();
-
-}
-
-void Clockception::animation_long_6() { // Frame turns in one minute  
-  unsigned int steps[nr_of_hands];
-  unsigned int speed[nr_of_hands];
-  int types[nr_of_hands];
-
-  for(int hand = 0; hand<nr_of_hands; hand++) {
-    steps[hand] = steps_per_revolution; 
-    speed[hand] = 80;
-    types[hand] = CRUISE;
-    if(hand%4 == 0 || hand%4 == 1) hands[hand]->set_direction(CW);
-    else hands[hand]->set_direction(CCW);
-  }
-
-  types[nr_of_hands-2] = DELAY;
-  types[nr_of_hands-1] = DELAY;
-
-  
-  calculate_run_with_speed(types, steps, speed);
-
-  show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 0.5, /*decel*/ 0.5);
-}
-
-void Clockception::animation_long_7() { 
-  set_direction_of_all_hands(CW);
-  for(int hand = 0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 0) hands[hand]->target_position = 0;
-    else hands[hand]->target_position = int(.5*steps_per_revolution);
-  }
-  
-  unsigned int max_speed = 800;
-  
-  // This should be calculate_animation_with_delays and different end speeds
-
-  unsigned int steps[nr_of_hands];
-  unsigned int speeds[nr_of_hands];
-  int types[nr_of_hands];
-  float factor = 10.0;
-
-  for(int hand = 0; hand<nr_of_hands; hand++) {
-    if(hand == 12 || hand == 13) steps[hand] = steps_per_revolution;
-    else if(hand == 10 || hand == 11 || hand == 14 || hand == 15) steps[hand] = int(steps_per_revolution*1.5);
-    else if(hand == 0 || hand == 1 || hand == 16 || hand == 17 || hand == 8 || hand == 9) steps[hand] = int(steps_per_revolution*2);
-    else if(hand == 2 || hand == 3 || hand == 6 || hand == 7) steps[hand] = int(steps_per_revolution*2.5);
-    else steps[hand] = int(steps_per_revolution*3);
-    speeds[hand] = int(steps[hand]/factor);
-    types[hand] = CRUISE;
-  }
-
-  calculate_animation_with_delays(/*extra rotations*/ 1, /*max_speed*/ max_speed, /*accel*/ 1.0, /*decel*/ 0.0, /*delay at start*/ true);
-  
-  calculate_run_with_speed(types, steps, speeds);
-
-  // Show time
-  show_time_with_delays(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.0, /*decel*/ 0.2);
-  
-  run_animation();
-
-}
-
-void Clockception::animation_long_8() {
+void Clockception::plan_long_8() { // Small clocks that turn 12 hours, the whole animation is one movement
   int hour = _hour + 1;
   int minute = 0;
     
@@ -558,9 +787,9 @@ void Clockception::animation_long_8() {
   int minute_in_steps = int(minute / float(60) * steps_per_revolution);
 
   for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 0) hands[hand]->target_position = hour_in_steps; // Set all hour hands to hour
-    else hands[hand]->target_position = minute_in_steps; // Set all minute hands to minute
-    hands[hand]->set_direction(CW);
+    if(hand%2 == 0) hands[hand].target_position = hour_in_steps; // Set all hour hands to hour
+    else hands[hand].target_position = minute_in_steps; // Set all minute hands to minute
+    hands[hand].set_direction(CW);
   }
 
   unsigned int max_speed = 800;
@@ -589,136 +818,56 @@ void Clockception::animation_long_8() {
   calculate_run_with_speed(types, steps, speed);
 
   show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.0, /*decel*/ 0.7); // Set extra rotations to 1 when having drift
-  
-  run_animation();
 }
 
-void Clockception::animation_long_9() { // Opposite rotation oriented to center after each other -> causes drift of the minute hand
-  set_direction_of_all_hands(CW);
-  for(int hand = 0; hand<nr_of_hands; hand++) {
-    if(hand<=15) hands[hand]->target_position = int(steps_per_revolution*.5);
-    else if(hand==16) hands[hand]->target_position = int(steps_per_revolution);
-    else if(hand==17) hands[hand]->target_position = int(steps_per_revolution);
-  }
-  
-  unsigned int max_speed = 800;
-  
-  calculate_animation_with_delays(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 1.0, /*decel*/ 0.0, /*delay at start*/ true);
-  // Rotate
-  
-  calculate_run_with_same_speed(steps_per_revolution*2, max_speed);
-  
-  // Show time
-  show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.0, /*decel*/ 0.2);
-  
-  run_animation();
-}
-
-void Clockception::animation_long_10() { // Strech_and_turn variation
-  set_direction_of_all_hands(CW);
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 1) hands[hand]->target_position = int(steps_per_revolution*.75);
-    else hands[hand]->target_position = int(steps_per_revolution*.25);
-
-    if(hand == 10 || hand == 11 || hand == 14 || hand == 15) hands[hand]->target_position -= 120;
-    else if(hand == 0 || hand == 1 || hand == 8 || hand == 9 || hand == 16 || hand == 17) hands[hand]->target_position -= 240;
-    else if(hand == 2 || hand == 3 || hand == 6 || hand == 7) hands[hand]->target_position -= 360;
-    else if(hand == 4 || hand == 5) hands[hand]->target_position -= 480;
-  }
-  
-  unsigned int max_speed = 600;
-  // Calculate and set instructions for to stretch movement
-  calculate_animation_with_delays(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.9, /*decel*/ 0.0, /*delay at start*/ true);
-
-  // Rotations
-  calculate_run_with_same_speed(steps_per_revolution*2, max_speed);
-  
-  // Show time
-  show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 1, /*max_speed*/ max_speed, /*accel*/ 0.0, /*decel*/ 0.2);
-  
-  run_animation();
-}
-
-void Clockception::animation_long_11() { // Stretch and each column opposite rotation
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 1) hands[hand]->target_position = 0;
-    else hands[hand]->target_position = int(steps_per_revolution*.5);
-
-    if(hand == 12 || hand == 13) hands[hand]->set_direction(CCW);
-    else if(hand == 10 || hand == 11 || hand == 14 || hand == 15) hands[hand]->set_direction(CW);
-    else if(hand == 0 || hand == 1 || hand == 8 || hand == 9 || hand == 16 || hand == 17) hands[hand]->set_direction(CCW);
-    else if(hand == 2 || hand == 3 || hand == 6 || hand == 7) hands[hand]->set_direction(CW);
-    else if(hand == 4 || hand == 5) hands[hand]->set_direction(CCW);
-  }
-  
-  unsigned int max_speed = 400;
-  // Calculate and set instructions for to stretch movement
-  calculate_animation_with_delays(/*extra rotations*/ 1, /*max_speed*/ max_speed, /*accel*/ 0.6, /*decel*/ 0.0, /*delay at start*/ true);
-
-  // Rotations
-  calculate_run_with_same_speed(steps_per_revolution*2, max_speed);
-  
-  // Show time
-  show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 1, /*max_speed*/ max_speed, /*accel*/ 0.0, /*decel*/ 0.2);
-  
-  run_animation();
-}
-
-void Clockception::animation_long_12() { // Subsequent rotation downwards
+void Clockception::plan_long_12() { // Subsequent rotation downwards
   // Rotate all hands upwards
-  for(int hand=0; hand<nr_of_hands; hand++) hands[hand]->target_position = 0;
+  for(int hand=0; hand<nr_of_hands; hand++) hands[hand].target_position = 0;
   set_shortest_direction_to_target();
   unsigned int max_speed = 400;
   calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.5, /*decel*/ 0.5);
+}
+
+void Clockception::animation_long_12() { // Subsequent rotation downwards, planned by plan_long_12()
   run_animation();
   
-  max_speed = 200;
+  unsigned int max_speed = 200;
   int speed = int(1000000/max_speed);
   // Program delays for each row of hands and then rotation downwards
+  pattern_directions(ALL_HANDS, PATTERN_ROLE, CCW);
+  pattern_delays(ALL_HANDS, PATTERN_ROW, 0, int(0.25*steps_per_revolution), speed); // Top row no delay, bottom row a full revolution
   for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 0) hands[hand]->set_direction(CCW);
-    else hands[hand]->set_direction(CW);
-
-    // Hands 0 and 1 no delay
-    if(hand == 14 || hand == 15 || hand == 2 || hand == 3) hands[hand]->set_instruction(DELAY, int(0.25*steps_per_revolution), speed);
-    else if(hand == 12 || hand == 13 || hand == 16 || hand == 17 || hand == 4 || hand == 5) hands[hand]->set_instruction(DELAY, int(0.5*steps_per_revolution), speed);
-    else if(hand == 10 || hand == 11 || hand == 6 || hand == 7) hands[hand]->set_instruction(DELAY, int(0.75*steps_per_revolution), speed);
-    
-    if(hand == 8 || hand == 9) {
+    if(hand_row(hand) == 4) {
       // Set instructions for a full rotation
-      hands[hand]->set_instruction(DELAY, int(steps_per_revolution), speed);
-      hands[hand]->target_position = steps_per_revolution; // These hands continue rotation upwards
-      hands[hand]->set_instruction(ACCELERATE, int(0.1*steps_per_revolution), speed);
-      hands[hand]->set_instruction(CRUISE, int(0.8*steps_per_revolution), speed);
-      hands[hand]->set_instruction(DECELERATE, int(0.1*steps_per_revolution), speed);
+      hands[hand].target_position = steps_per_revolution; // These hands continue rotation upwards
+      hands[hand].set_instruction(ACCELERATE, int(0.1*steps_per_revolution), speed);
+      hands[hand].set_instruction(CRUISE, int(0.8*steps_per_revolution), speed);
+      hands[hand].set_instruction(DECELERATE, int(0.1*steps_per_revolution), speed);
     }
     else {
       // For other hands half rotation
-      hands[hand]->set_instruction(ACCELERATE, int(0.1*steps_per_revolution), speed);
-      hands[hand]->set_instruction(CRUISE, int(0.3*steps_per_revolution), speed);
-      hands[hand]->set_instruction(DECELERATE, int(0.1*steps_per_revolution), speed);
+      hands[hand].set_instruction(ACCELERATE, int(0.1*steps_per_revolution), speed);
+      hands[hand].set_instruction(CRUISE, int(0.3*steps_per_revolution), speed);
+      hands[hand].set_instruction(DECELERATE, int(0.1*steps_per_revolution), speed);
     }
 
-    hands[hand]->_acceleration_speed_factor = speed/float(_default_acceleration_curve_end_speed); // All hands will accelerate at same speed
-    hands[hand]->_accel_speed = speed;
-    hands[hand]->_accel_vs_decel_speed_factor = 1;
+    hands[hand]._acceleration_speed_factor = speed/float(acceleration_curve_end_interval); // All hands will accelerate at same speed
+    hands[hand]._accel_speed = speed;
+    hands[hand]._accel_vs_decel_speed_factor = 1;
   }
     
+  for(int hand=0; hand<nr_of_hands; hand++) hands[hand].virtual_position = 0;
+
+  // Rows turn back upwards from the row above the bottom one. The bottom row does a full rotation, so does not need extra instructions.
+  uint32_t upper_rows = ALL_HANDS & ~hand_mask(8, 9);
+  pattern_delays(upper_rows, PATTERN_ROW, int(1.85*steps_per_revolution), -int(0.5*steps_per_revolution), speed);
   for(int hand=0; hand<nr_of_hands; hand++) {
-    hands[hand]->virtual_position = 0;
-    
-    if(hand == 8 || hand == 9) continue; // These hands do a full rotation, so do not need extra instructions
-    if(hand == 10 || hand == 11 || hand == 6 || hand == 7) hands[hand]->set_instruction(DELAY, int(0.35*steps_per_revolution), speed);
-    else if(hand == 12 || hand == 13 || hand == 16 || hand == 17 || hand == 4 || hand == 5) hands[hand]->set_instruction(DELAY, int(0.85*steps_per_revolution), speed);
-    else if(hand == 14 || hand == 15 || hand == 2 || hand == 3) hands[hand]->set_instruction(DELAY, int(1.35*steps_per_revolution), speed);
-    else if(hand == 0 || hand == 1) hands[hand]->set_instruction(DELAY, int(1.85*steps_per_revolution), speed);
-  
-    hands[hand]->set_instruction(ACCELERATE, int(0.1*steps_per_revolution), speed);
-    hands[hand]->set_instruction(CRUISE, int(0.3*steps_per_revolution), speed);
-    hands[hand]->set_instruction(DECELERATE, int(0.1*steps_per_revolution), speed);    
+    if(!(upper_rows & (1UL << hand))) continue;
+    hands[hand].set_instruction(ACCELERATE, int(0.1*steps_per_revolution), speed);
+    hands[hand].set_instruction(CRUISE, int(0.3*steps_per_revolution), speed);
+    hands[hand].set_instruction(DECELERATE, int(0.1*steps_per_revolution), speed);    
   }
 
-  calculate_corrected_curves();
   run_animation();
   
   // Show time
@@ -733,26 +882,23 @@ void Clockception::animation_long_12() { // Subsequent rotation downwards
 
 void Clockception::animation_long_13() { // Splash animation
   // All hands to zero
-  for(int hand=0; hand<nr_of_hands; hand++) hands[hand]->target_position = 0;
+  for(int hand=0; hand<nr_of_hands; hand++) hands[hand].target_position = 0;
   set_shortest_direction_to_target();
   unsigned int max_speed = 400;
   calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.5, /*decel*/ 0.5);
   run_animation();
 
-  delay(1000);
+  wait(1000);
 
   // Set directions and splash down
   for(int hand=0; hand<nr_of_hands; hand++) {
-    hands[hand]->target_position = int(steps_per_revolution*0.5);
-    if(hand%2 == 0 && hands[hand]->direction == CW) hands[hand]->set_direction(CCW);
-    else if(hand%2 == 1 && hands[hand]->direction == CCW) hands[hand]->set_direction(CW);
+    hands[hand].target_position = int(steps_per_revolution*0.5);
+    if(hand%2 == 0 && hands[hand].direction == CW) hands[hand].set_direction(CCW);
+    else if(hand%2 == 1 && hands[hand].direction == CCW) hands[hand].set_direction(CW);
 
-    int wait_time = 500;
-    if(hand==2 || hand==3 || hand==14 || hand==15) hands[hand]->set_instruction(DELAY, wait_time, max_speed);
-    if(hand==12 || hand==13 || hand==16 || hand==17 || hand==4 || hand==5) hands[hand]->set_instruction(DELAY, wait_time*2, max_speed);
-    if(hand==6 || hand==7 || hand==10 || hand==11) hands[hand]->set_instruction(DELAY, wait_time*3, max_speed);
-    if(hand==8 || hand==9) hands[hand]->set_instruction(DELAY, wait_time*4, max_speed);
   }
+  int wait_time = 500;
+  pattern_delays(ALL_HANDS, PATTERN_ROW, 0, wait_time, max_speed); // Each row waits longer than the one above
 
   calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.2, /*decel*/ 0.0);
 
@@ -762,302 +908,106 @@ void Clockception::animation_long_13() { // Splash animation
 
 ///////////////////////////////////////////////////////////////////////////////// SHORT ANIMATIONS /////////////////////////////////////////////////////////////////////////
 
-void Clockception::animation_short_1() { // Turn all hands equally
-  set_direction_of_all_hands(CW);
-  
-  int max_speed= 400;
-  show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 1, /*max_speed*/ max_speed, /*accel*/ 0.1, /*decel*/ 0.2);
-  run_animation();
-}
-
-void Clockception::animation_short_2() { // One revolution different start and end times
-  _current_animation = SHORT_2;
-  int max_speed= 800;
-  set_direction_of_all_hands(CW);
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    hands[hand]->target_position = int(steps_per_revolution*.25);
-  }
-
-  calculate_animation_with_delays(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 1.0, /*decel*/ 0.0, /*delay at start*/ true); 
-  show_time_with_delays(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.0, /*decel*/ 0.7);
-  run_animation();
-}
-
-void Clockception::animation_short_3() { // Turn hands outside and back
-
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 0) hands[hand]->set_direction(CCW);
-    else hands[hand]->set_direction(CW);
-    hands[16]->set_direction(CW);
-    hands[17]->set_direction(CW);
-
-    if(hand<=1) hands[hand]->target_position = steps_per_revolution;
-    else if(hand<=3) hands[hand]->target_position = int(steps_per_revolution*.125);
-    else if(hand<=5) hands[hand]->target_position = int(steps_per_revolution*.25);
-    else if(hand<=7) hands[hand]->target_position = int(steps_per_revolution*.375);
-    else if(hand<=9) hands[hand]->target_position = int(steps_per_revolution*.5);
-    else if(hand<=11) hands[hand]->target_position = int(steps_per_revolution*.625);
-    else if(hand<=13) hands[hand]->target_position = int(steps_per_revolution*.75);
-    else if(hand<=15) hands[hand]->target_position = int(steps_per_revolution*.875);
-    set_time_positions();
-  }
-  
-  int max_speed= 500;
-  calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.4, /*decel*/ 0.4);
-  run_animation();
-
-  Serial.println(F("Wait for new minute"));
-  _last_minute = _minute; // Set this now so wait_for_new_minute() works properly
-  wait_for_new_minute();
-
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 0) hands[hand]->set_direction(CW);
-    else hands[hand]->set_direction(CCW);
-  }
-  hands[nr_of_hands-2]->set_direction(CW);
-  hands[nr_of_hands-1]->set_direction(CW);
-  
-  set_clock_frame_positions();
-  calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.4, /*decel*/ 0.4);
-
-  show_time_equal_duration(/*get current time*/ 98, 98, /*extra rotations*/ 0, /*max_speed*/ 50, /*accel*/ 0.5, /*decel*/ 0.5);
-  run_animation();
-}
-
-void Clockception::animation_short_4() { // Create a wave through the frame, uses custom instructions
-  byte frame_order[nr_of_hands-2] = {0,3,2,5,4,7,6,9,8,11,10,13,12,15,14,1};
-
+void Clockception::plan_short_4() { // Create a wave through the frame, uses custom instructions. The whole animation is one movement.
   int step_interval = 8000;
   int angle = int(.012 * steps_per_revolution);
   int delay = int(angle/2);
+  pattern_directions(FRAME_HANDS, PATTERN_RING, CW); // Corners CW, sides CCW
   for(int hand = 0; hand<nr_of_hands-2; hand++) {
-    
-    if(hand == nr_of_hands-2) hands[frame_order[hand]]->set_instruction(DELAY, delay*(nr_of_hands-2), step_interval); // Hand 0 is the last one, so delay the longest
-    else hands[frame_order[hand]]->set_instruction(DELAY, delay*hand, step_interval);
-    
-    if(hand%4 == 1 || hand%4 == 2) hands[frame_order[hand]]->set_direction(CCW);
-    else hands[frame_order[hand]]->set_direction(CW);
+    hands[hand].set_instruction(DELAY, delay*hand_phase(hand), step_interval); // The wave walks around the frame, hand 1 is the last one
 
-    hands[frame_order[hand]]->_acceleration_speed_factor = 5;
-    hands[frame_order[hand]]->_accel_vs_decel_speed_factor = 1;
+    hands[hand]._acceleration_speed_factor = 5;
+    hands[hand]._accel_vs_decel_speed_factor = 1;
 
     // Move away
-    hands[frame_order[hand]]->set_instruction(ACCELERATE, angle, step_interval);
-    hands[frame_order[hand]]->set_instruction(DECELERATE, angle, step_interval);
+    hands[hand].set_instruction(ACCELERATE, angle, step_interval);
+    hands[hand].set_instruction(DECELERATE, angle, step_interval);
 
     // Move to other side
-    hands[frame_order[hand]]->set_instruction(SWITCH_DIRECTION, 0, 0);
-    hands[frame_order[hand]]->set_instruction(ACCELERATE, int(4*angle), step_interval);
-    hands[frame_order[hand]]->set_instruction(DECELERATE, int(4*angle), step_interval);
+    hands[hand].set_instruction(SWITCH_DIRECTION, 0, 0);
+    hands[hand].set_instruction(ACCELERATE, int(4*angle), step_interval);
+    hands[hand].set_instruction(DECELERATE, int(4*angle), step_interval);
     
     // Move back
-    hands[frame_order[hand]]->set_instruction(SWITCH_DIRECTION, 0, 0);
-    hands[frame_order[hand]]->set_instruction(ACCELERATE, int(2*angle), step_interval);
-    hands[frame_order[hand]]->set_instruction(DECELERATE, int(2*angle), step_interval);
+    hands[hand].set_instruction(SWITCH_DIRECTION, 0, 0);
+    hands[hand].set_instruction(ACCELERATE, int(2*angle), step_interval);
+    hands[hand].set_instruction(DECELERATE, int(2*angle), step_interval);
   }
 
   // Set hands in right position
   set_time_and_frame_positions();
   for(int hand = nr_of_hands-2; hand < nr_of_hands; hand++) {
-    int steps_to_take = normalize(hands[hand]->target_position - hands[hand]->virtual_position, steps_per_revolution, 0);
-    if(steps_to_take < int(0.5*steps_per_revolution)) hands[hand]->set_direction(CW);
+    int steps_to_take = normalize(hands[hand].target_position - hands[hand].virtual_position, steps_per_revolution, 0);
+    if(steps_to_take < int(0.5*steps_per_revolution)) hands[hand].set_direction(CW);
     else {
       steps_to_take = steps_per_revolution - steps_to_take;
-      hands[hand]->set_direction(CCW);
+      hands[hand].set_direction(CCW);
     }
-    hands[hand]->set_instruction(CRUISE, steps_to_take, 8000);
+    hands[hand].set_instruction(CRUISE, steps_to_take, 8000);
   }
-
-  calculate_corrected_curves();
-  run_animation();
 }
 
-void Clockception::animation_short_5() { // Rotation with random delay and speed
+void Clockception::plan_short_5() { // Rotation with random delay and speed, the whole animation is one movement
   for(int hand = 0; hand<nr_of_hands; hand++) {
-    //hands[hand]->set_instruction(DELAY, random(1, 3000), 800);
-    if(random(0,2) == 0) hands[hand]->set_direction(CW);
-    else hands[hand]->set_direction(CCW);
-    hands[hand]->target_position = random(1000, 3000);
+    //hands[hand].set_instruction(DELAY, random(1, 3000), 800);
+    if(random(0,2) == 0) hands[hand].set_direction(CW);
+    else hands[hand].set_direction(CCW);
+    hands[hand].target_position = random(1000, 3000);
   }
   
   calculate_animation_with_delays(/*extra rotations*/ 0, /*max_speed*/ 600, /*accel*/ 1.0, /*decel*/ 0.0, /*delay at start*/ true); 
   show_time_with_delays(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ 600, /*accel*/ 0.0, /*decel*/ 1.0);
-  run_animation();
-}
-
-void Clockception::animation_short_6() { // Turn hands inwards and back
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 0) hands[hand]->set_direction(CW);
-    else hands[hand]->set_direction(CCW);
-    hands[16]->set_direction(CW);
-    hands[17]->set_direction(CW);
-
-    if(hand<=1) hands[hand]->target_position = int(steps_per_revolution*.5);
-    else if(hand<=3) hands[hand]->target_position = int(steps_per_revolution*.625);
-    else if(hand<=5) hands[hand]->target_position = int(steps_per_revolution*.75);
-    else if(hand<=7) hands[hand]->target_position = int(steps_per_revolution*.875);
-    else if(hand<=9) hands[hand]->target_position = steps_per_revolution; 
-    else if(hand<=11) hands[hand]->target_position = int(steps_per_revolution*.125);
-    else if(hand<=13) hands[hand]->target_position = int(steps_per_revolution*.25);
-    else if(hand<=15) hands[hand]->target_position = int(steps_per_revolution*.375);
-    set_time_positions();
-  }
-  
-  int max_speed= 500;
-  calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.4, /*decel*/ 0.4);
-  run_animation();
-
-  Serial.println(F("Wait for new minute"));
-  _last_minute = _minute; // Set this now so wait_for_new_minute() works properly
-  wait_for_new_minute();
-
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%2 == 0) hands[hand]->set_direction(CCW);
-    else hands[hand]->set_direction(CW);
-  }
-  hands[nr_of_hands-2]->set_direction(CW);
-  hands[nr_of_hands-1]->set_direction(CW);
-  
-  set_clock_frame_positions();
-  calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.4, /*decel*/ 0.4);
-
-  show_time_equal_duration(/*get current time*/ 98, 98, /*extra rotations*/ 0, /*max_speed*/ 50, /*accel*/ 0.5, /*decel*/ 0.5);
-  run_animation();
-}
-
-void Clockception::animation_short_7() { // Turn corners first 
-  int speed = 600; 
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%4 >= 2) {
-      hands[hand]->set_instruction(DELAY, int(steps_per_revolution/2), int(1000000/speed));
-    }
-  }
-  
-  show_time_equal_duration(/*get current time*/ 98, 98, /*extra rotations*/ 1, /*max_speed*/ speed, /*accel*/ 0.15, /*decel*/ 0.15);
-  run_animation();
-}
-
-void Clockception::animation_short_8() { // Corners out, straigts in
-  for(int hand=0; hand<nr_of_hands; hand++) {
-
-    if(hand%4 == 1 || hand%4 == 2) hands[hand]->set_direction(CW);
-    else hands[hand]->set_direction(CCW);
-
-    if(hand<=1) hands[hand]->target_position = steps_per_revolution;
-    else if(hand<=3) hands[hand]->target_position = int(steps_per_revolution*.625);
-    else if(hand<=5) hands[hand]->target_position = int(steps_per_revolution*.25);
-    else if(hand<=7) hands[hand]->target_position = int(steps_per_revolution*.875);
-    else if(hand<=9) hands[hand]->target_position = int(steps_per_revolution*0.5); 
-    else if(hand<=11) hands[hand]->target_position = int(steps_per_revolution*.125);
-    else if(hand<=13) hands[hand]->target_position = int(steps_per_revolution*.75);
-    else if(hand<=15) hands[hand]->target_position = int(steps_per_revolution*.375);
-    else hands[hand]->target_position = hands[hand]->current_position;
-  }
-  
-  int max_speed= 500;
-  calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.4, /*decel*/ 0.4);
-  run_animation();
-
-  delay(1500); // Wait 2 seconds
-
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%4 == 1 || hand%4 == 2) hands[hand]->set_direction(CCW);
-    else hands[hand]->set_direction(CW);
-  }
-  hands[nr_of_hands-2]->set_direction(CW);
-  hands[nr_of_hands-1]->set_direction(CW);
-  
-  set_clock_frame_positions();
-  calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.4, /*decel*/ 0.4);
-
-  show_time_equal_duration(/*get current time*/ 98, 98, /*extra rotations*/ 0, /*max_speed*/ 50, /*accel*/ 0.5, /*decel*/ 0.5);
-  run_animation();
 }
 
-void Clockception::animation_short_9() { // Corners in, straigts out
-  for(int hand=0; hand<nr_of_hands; hand++) {
-
-    if(hand%4 == 1 || hand%4 == 2) hands[hand]->set_direction(CCW);
-    else hands[hand]->set_direction(CW);
-
-    if(hand<=1) hands[hand]->target_position = int(steps_per_revolution*0.5);
-    else if(hand<=3) hands[hand]->target_position = int(steps_per_revolution*.125);
-    else if(hand<=5) hands[hand]->target_position = int(steps_per_revolution*.75);
-    else if(hand<=7) hands[hand]->target_position = int(steps_per_revolution*.375);
-    else if(hand<=9) hands[hand]->target_position = int(steps_per_revolution); 
-    else if(hand<=11) hands[hand]->target_position = int(steps_per_revolution*.625);
-    else if(hand<=13) hands[hand]->target_position = int(steps_per_revolution*.25);
-    else if(hand<=15) hands[hand]->target_position = int(steps_per_revolution*.875);
-    else hands[hand]->target_position = hands[hand]->current_position;
-  }
-  
-  int max_speed= 500;
-  calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.4, /*decel*/ 0.4);
-  run_animation();
-
-  Serial.println(F("Wait for new minute"));
-  _last_minute = _minute; // Set this now so wait_for_new_minute() works properly
-  wait_for_new_minute();
-
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand%4 == 1 || hand%4 == 2) hands[hand]->set_direction(CW);
-    else hands[hand]->set_direction(CCW);
-  }
-  hands[nr_of_hands-2]->set_direction(CW);
-  hands[nr_of_hands-1]->set_direction(CW);
-  
-  set_clock_frame_positions();
-  calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.4, /*decel*/ 0.4);
-
-  show_time_equal_duration(/*get current time*/ 98, 98, /*extra rotations*/ 0, /*max_speed*/ 50, /*accel*/ 0.5, /*decel*/ 0.5);
-  run_animation();
-}
-
-void Clockception::animation_short_10() { // All hands flat
+void Clockception::plan_short_10() { // All hands flat
   int left = int(steps_per_revolution*.75);
   int right = int(steps_per_revolution*.25);
 
-  hands[0]->target_position = right;
-  hands[1]->target_position = left;
-  hands[2]->target_position = right;
-  hands[3]->target_position = left;
-  hands[4]->target_position = left;
-  hands[5]->target_position = left;
-  hands[6]->target_position = left;
-  hands[7]->target_position = right;
-  hands[8]->target_position = left;
-  hands[9]->target_position = right;
-  hands[10]->target_position = left;
-  hands[11]->target_position = right;
-  hands[12]->target_position = right;
-  hands[13]->target_position = right;
-  hands[14]->target_position = right;
-  hands[15]->target_position = left;
+  hands[0].target_position = right;
+  hands[1].target_position = left;
+  hands[2].target_position = right;
+  hands[3].target_position = left;
+  hands[4].target_position = left;
+  hands[5].target_position = left;
+  hands[6].target_position = left;
+  hands[7].target_position = right;
+  hands[8].target_position = left;
+  hands[9].target_position = right;
+  hands[10].target_position = left;
+  hands[11].target_position = right;
+  hands[12].target_position = right;
+  hands[13].target_position = right;
+  hands[14].target_position = right;
+  hands[15].target_position = left;
 
   // Determine distance to right side
-  int hour_to_right = abs(right - hands[16]->current_position);
+  int hour_to_right = abs(right - hands[16].current_position);
   if(hour_to_right > 0.5*steps_per_revolution) hour_to_right = steps_per_revolution - hour_to_right;
 
-  int minute_to_right = abs(right - hands[17]->current_position);
+  int minute_to_right = abs(right - hands[17].current_position);
   if(minute_to_right > 0.5*steps_per_revolution) minute_to_right = steps_per_revolution - minute_to_right;
 
   // Determine which hand is closest to right side
   if(hour_to_right <= minute_to_right) {
-    hands[16]->target_position = right;
-    hands[17]->target_position = left;
+    hands[16].target_position = right;
+    hands[17].target_position = left;
   }
   else {
-    hands[16]->target_position = left;
-    hands[17]->target_position = right;
+    hands[16].target_position = left;
+    hands[17].target_position = right;
   }
 
   set_shortest_direction_to_target();
   
   int max_speed= 500;
   calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.5, /*decel*/ 0.5);
+}
+
+void Clockception::animation_short_10() { // All hands flat, planned by plan_short_10(). Also plays short 11, both show the time the same way.
+  int max_speed= 500;
   run_animation();
 
-  delay(1500); // Wait 1500ms
+  wait(1500); // Wait 1500ms
 
   get_time();
   set_time_and_frame_positions();
@@ -1067,97 +1017,212 @@ void Clockception::animation_short_10() { // All hands flat
   run_animation();
 }
 
-void Clockception::animation_short_11() { // All hands straight
+void Clockception::plan_short_11() { // All hands straight
   int top = 0;
   int down = int(steps_per_revolution*.5);
 
-  hands[0]->target_position = down;
-  hands[1]->target_position = down;
-  hands[2]->target_position = down;
-  hands[3]->target_position = top;
-  hands[4]->target_position = down;
-  hands[5]->target_position = top;
-  hands[6]->target_position = down;
-  hands[7]->target_position = top;
-  hands[8]->target_position = top;
-  hands[9]->target_position = top;
-  hands[10]->target_position = top;
-  hands[11]->target_position = down;
-  hands[12]->target_position = top;
-  hands[13]->target_position = down;
-  hands[14]->target_position = top;
-  hands[15]->target_position = down;
+  hands[0].target_position = down;
+  hands[1].target_position = down;
+  hands[2].target_position = down;
+  hands[3].target_position = top;
+  hands[4].target_position = down;
+  hands[5].target_position = top;
+  hands[6].target_position = down;
+  hands[7].target_position = top;
+  hands[8].target_position = top;
+  hands[9].target_position = top;
+  hands[10].target_position = top;
+  hands[11].target_position = down;
+  hands[12].target_position = top;
+  hands[13].target_position = down;
+  hands[14].target_position = top;
+  hands[15].target_position = down;
 
   // Determine distance to top side
-  int hour_to_top = hands[16]->current_position;
+  int hour_to_top = hands[16].current_position;
   if(hour_to_top > 0.5*steps_per_revolution) hour_to_top = steps_per_revolution - hour_to_top;
 
-  int minute_to_top = hands[17]->current_position;
+  int minute_to_top = hands[17].current_position;
   if(minute_to_top > 0.5*steps_per_revolution) minute_to_top = steps_per_revolution - minute_to_top;
 
   // Determine which hand is closest to top side
   if(hour_to_top <= minute_to_top) {
-    hands[16]->target_position = top;
-    hands[17]->target_position = down;
+    hands[16].target_position = top;
+    hands[17].target_position = down;
   }
   else {
-    hands[16]->target_position = down;
-    hands[17]->target_position = top;
+    hands[16].target_position = down;
+    hands[17].target_position = top;
   }
 
   set_shortest_direction_to_target();
   
   int max_speed= 500;
   calculate_animation_equal_duration(/*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.5, /*decel*/ 0.5);
-  run_animation();
-
-  delay(1500); // Wait 1500ms
+}
 
-  get_time();
-  set_time_and_frame_positions();
-  set_shortest_direction_to_target();
 
-  show_time_equal_duration(/*time already fetched*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ max_speed, /*accel*/ 0.5, /*decel*/ 0.5);
 
-  run_animation();
+///////////////////////////////////////////////////////////////////////////////// SCRIPTS /////////////////////////////////////////////////////////////////////////
 
+static uint8_t script_byte(const uint8_t *&script) {
+  return pgm_read_byte(script++);
 }
 
-void Clockception::animation_short_12() { // One rotation after each other
-  int speed = 900;
-  set_direction_of_all_hands(CW);
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    hands[hand]->set_instruction(DELAY, int(steps_per_revolution/4*hand), int(1000000/speed));
-  }
+static int script_word(const uint8_t *&script) {
+  uint16_t low = script_byte(script);
+  return int16_t(low | uint16_t(script_byte(script)) << 8);
+}
 
-  show_time_equal_duration(/*get current time*/ 98, 98, /*extra rotations*/ 1, /*max_speed*/ speed, /*accel*/ 0.5, /*decel*/ 0.5);
-  run_animation();
+static uint32_t script_hands(const uint8_t *&script) {
+  uint32_t low = script_word(script) & 0xFFFF;
+  return low | uint32_t(script_byte(script)) << 16;
 }
 
-void Clockception::animation_short_13() { // One rotation, each row after another
-  int speed = 900;
-  set_direction_of_all_hands(CW);
-  for(int hand=0; hand<nr_of_hands; hand++) {
-    if(hand == 2 || hand == 3 || hand == 14 || hand == 15) hands[hand]->set_instruction(DELAY, int(steps_per_revolution/3), int(1000000/speed));
-    else if(hand == 4 || hand == 5 || hand == 12 || hand == 13 || hand == 16 || hand == 17) hands[hand]->set_instruction(DELAY, int(steps_per_revolution/3*2), int(1000000/speed));
-    else if(hand == 6 || hand == 7 || hand == 10 || hand == 11) hands[hand]->set_instruction(DELAY, int(steps_per_revolution/3*3), int(1000000/speed));
-    else if(hand == 8 || hand == 9) hands[hand]->set_instruction(DELAY, int(steps_per_revolution/3*4), int(1000000/speed));
-    hands[hand]->target_position = int(steps_per_revolution*0.5);
-  }
+static float script_fraction(const uint8_t *&script) {
+  return script_byte(script) / 100.0f; // Percent
+}
 
-  //show_time_equal_duration(/*get current time*/ 98, 98, /*extra rotations*/ 1, /*max_speed*/ speed, /*accel*/ 0.5, /*decel*/ 0.5);
-  
-  calculate_animation_with_delays(/*extra rotations*/ 0, /*max_speed*/ speed, /*accel*/ 1.0, /*decel*/ 0.0, /*delay at start*/ true); 
-  show_time_with_delays(/*get current time*/ 98, 98, /*extra rotations*/ 0, /*max_speed*/ speed, /*accel*/ 0.0, /*decel*/ 1.0);
-  run_animation();
+static bool script_code_moves(uint8_t code) {
+  // Codes that move the hands or wait, planning ahead stops before them
+  return code == SCRIPT_END || code == SCRIPT_RUN || code == SCRIPT_RUN_COORDINATED || code == SCRIPT_WAIT || code == SCRIPT_WAIT_FOR_NEW_MINUTE;
 }
 
+void Clockception::play_script(const uint8_t *script) {
+  interpret_script(script, false);
+}
 
+const uint8_t *Clockception::interpret_script(const uint8_t *script, bool plan_only) {
+  while(true) {
+    if(plan_only && script_code_moves(pgm_read_byte(script))) return script;
+    uint8_t code = script_byte(script);
+    if(code == SCRIPT_END) return script;
+
+    switch(code) {
+      case SCRIPT_DIRECTION:
+      case SCRIPT_TARGET:
+      case SCRIPT_TARGET_ADD:
+      case SCRIPT_TARGET_CURRENT:
+      case SCRIPT_CRUISE:
+      case SCRIPT_DELAY: {
+        // Codes that work on a group of hands
+        uint32_t mask = script_hands(script);
+        int value = 0;
+        int interval = 0;
+        if(code == SCRIPT_DIRECTION) value = script_byte(script);
+        else if(code != SCRIPT_TARGET_CURRENT) value = script_word(script);
+        if(code == SCRIPT_CRUISE || code == SCRIPT_DELAY) interval = script_word(script);
+
+        for(int hand=0; hand<nr_of_hands; hand++) {
+          if(!(mask & (1UL << hand))) continue;
+          if(code == SCRIPT_DIRECTION) hands[hand].set_direction(value);
+          else if(code == SCRIPT_TARGET) hands[hand].target_position = value;
+          else if(code == SCRIPT_TARGET_ADD) hands[hand].target_position += value;
+          else if(code == SCRIPT_TARGET_CURRENT) hands[hand].target_position = hands[hand].current_position;
+          else if(code == SCRIPT_CRUISE) hands[hand].set_instruction(CRUISE, value, interval);
+          else hands[hand].set_instruction(DELAY, value, interval);
+        }
+        break;
+      }
+      case SCRIPT_PATTERN_TARGET:
+      case SCRIPT_PATTERN_DELAY:
+      case SCRIPT_PATTERN_DIRECTION: {
+        uint32_t mask = script_hands(script);
+        uint8_t pattern = script_byte(script);
+        if(code == SCRIPT_PATTERN_DIRECTION) {
+          pattern_directions(mask, pattern, script_byte(script));
+          break;
+        }
+        int first = script_word(script);
+        int step = script_word(script);
+        if(code == SCRIPT_PATTERN_TARGET) pattern_targets(mask, pattern, first, step);
+        else pattern_delays(mask, pattern, first, step, script_word(script));
+        break;
+      }
+      case SCRIPT_MIRROR:
+        pattern_mirror(script_hands(script));
+        break;
+      case SCRIPT_FRAME_POSITIONS:
+        set_clock_frame_positions();
+        break;
+      case SCRIPT_TIME_POSITIONS:
+        set_time_positions();
+        break;
+      case SCRIPT_GET_TIME:
+        get_time();
+        break;
+      case SCRIPT_SAME_SPEED: {
+        unsigned int steps = script_word(script);
+        unsigned int speed = script_word(script);
+        calculate_run_with_same_speed(steps, speed);
+        break;
+      }
+      case SCRIPT_EQUAL_DURATION:
+      case SCRIPT_WITH_DELAYS:
+      case SCRIPT_COORDINATED: {
+        char extra_rotations = script_byte(script);
+        unsigned int max_speed = script_word(script);
+        float accel_fraction = script_fraction(script);
+        float decel_fraction = script_fraction(script);
+        if(code == SCRIPT_EQUAL_DURATION) calculate_animation_equal_duration(extra_rotations, max_speed, accel_fraction, decel_fraction);
+        else if(code == SCRIPT_COORDINATED) calculate_animation_coordinated(extra_rotations, max_speed, accel_fraction, decel_fraction);
+        else calculate_animation_with_delays(extra_rotations, max_speed, accel_fraction, decel_fraction, script_byte(script));
+        break;
+      }
+      case SCRIPT_S_CURVE: {
+        char extra_rotations = script_byte(script);
+        unsigned int max_speed = script_word(script);
+        unsigned int acceleration = script_word(script);
+        unsigned long jerk = (unsigned long)(script_word(script) & 0xFFFF) * 100;
+        calculate_animation_s_curve(extra_rotations, max_speed, acceleration, jerk);
+        break;
+      }
+      case SCRIPT_TIME_OPTIMAL: {
+        char extra_rotations = script_byte(script);
+        calculate_animation_time_optimal(extra_rotations, script_byte(script));
+        break;
+      }
+      case SCRIPT_SHOW_TIME_EQUAL_DURATION:
+      case SCRIPT_SHOW_TIME_WITH_DELAYS: {
+        uint8_t time = script_byte(script);
+        int extra_rotations = script_byte(script);
+        unsigned int max_speed = script_word(script);
+        float accel_fraction = script_fraction(script);
+        float decel_fraction = script_fraction(script);
+        if(code == SCRIPT_SHOW_TIME_EQUAL_DURATION) show_time_equal_duration(time, time, extra_rotations, max_speed, accel_fraction, decel_fraction);
+        else show_time_with_delays(time, time, extra_rotations, max_speed, accel_fraction, decel_fraction);
+        break;
+      }
+      case SCRIPT_RUN:
+        run_animation();
+        break;
+      case SCRIPT_RUN_COORDINATED:
+        run_coordinated_animation();
+        break;
+      case SCRIPT_WAIT:
+        wait(script_word(script));
+        break;
+      case SCRIPT_WAIT_FOR_NEW_MINUTE: {
+        if(_predicting) return script; // Rest of the animation is for the new minute, it is predicted when that starts
+        Serial.println(F("Wait for new minute"));
+        _last_minute = _minute; // Set this now so wait_for_new_minute() works properly
+        wait_for_new_minute();
+        start_budget(); // Rest of the animation is for the new minute
+        Animation_entry rest = {uint8_t(_current_animation), script, 0, 0};
+        predict_animation(rest);
+        break;
+      }
+      default:
+        Serial.println(F("Unknown code in animation script"));
+        return script;
+    }
+  }
+}
 
 ///////////////////////////////////////////////////////////////////////////////// PARTIAL ANIMATIONS /////////////////////////////////////////////////////////////////////////
 
 void Clockception::animation_to_zero() {
-  for(int hand = 0; hand<nr_of_hands; hand++) hands[hand]->target_position = 0;
+  for(int hand = 0; hand<nr_of_hands; hand++) hands[hand].target_position = 0;
   unsigned int max_speed = 1000;
   
   set_shortest_direction_to_target();
@@ -1169,8 +1234,8 @@ void Clockception::animation_to_zero() {
 
 void Clockception::animation_to_bottom() {
   for(int hand = 0; hand<nr_of_hands; hand++) {
-    hands[hand]->target_position = int(0.5*steps_per_revolution);
-    hands[hand]->set_direction(CW);
+    hands[hand].target_position = int(0.5*steps_per_revolution);
+    hands[hand].set_direction(CW);
   }
   unsigned int max_speed = 1000;
 
@@ -1183,10 +1248,8 @@ void Clockception::animation_to_bottom() {
 ///////////////////////////////////////////////////////////////////////////////// SHOW TIME /////////////////////////////////////////////////////////////////////////
 
 void Clockception::get_time() {
-  DateTime now = rtc->now();
-  _hour = now.hour();
-  _minute = now.minute();
-  _second = now.second();
+  if(_planning_ahead) return; // Animation is planned for the time that is set, not for now
+  time_base.now(_hour, _minute, _second); // Counted from the square wave of the RTC, no I2C
 }
 
 void Clockception::set_time_and_frame_positions() {
@@ -1196,7 +1259,7 @@ void Clockception::set_time_and_frame_positions() {
 
 void Clockception::set_clock_frame_positions() {
   for(int hand=0; hand<nr_of_hands-2; hand++) {
-    hands[hand]->target_position = clock_frame_positions[hand]; // Set frame as defined in settings
+    hands[hand].target_position = clock_frame_positions[hand]; // Set frame as defined in settings
   }
 }
 
@@ -1205,8 +1268,8 @@ void Clockception::set_time_positions() {
   int hour_in_steps = int(float(_hour % 12) / 12 * float(steps_per_revolution) + floor(float(_minute) / 60 / 12 * float(steps_per_revolution)));
   int minute_in_steps = int(_minute / float(60) * steps_per_revolution);
 
-  hands[nr_of_hands-2]->target_position = hour_in_steps; // Set current hour position
-  hands[nr_of_hands-1]->target_position = minute_in_steps; // Set current minute position
+  hands[nr_of_hands-2].target_position = hour_in_steps; // Set current hour position
+  hands[nr_of_hands-1].target_position = minute_in_steps; // Set current minute position
 }
 
 
@@ -1229,35 +1292,35 @@ void Clockception::show_time_equal_duration(uint8_t predefined_hour, uint8_t pre
   // Corrections to improve the visuals of different animations
   if(_current_animation == LONG_1) { // Corrections for stretch & turn
     for(int hand=0; hand<nr_of_hands; hand++) {
-      while(hands[hand]->target_position - hands[hand]->virtual_position < int(1*steps_per_revolution)) hands[hand]->target_position += steps_per_revolution;
-      while(hands[hand]->target_position - hands[hand]->virtual_position >= int(2*steps_per_revolution)) hands[hand]->target_position -= steps_per_revolution;
+      while(hands[hand].target_position - hands[hand].virtual_position < int(1*steps_per_revolution)) hands[hand].target_position += steps_per_revolution;
+      while(hands[hand].target_position - hands[hand].virtual_position >= int(2*steps_per_revolution)) hands[hand].target_position -= steps_per_revolution;
     }
   }
 
   if(_current_animation == LONG_2 || _current_animation == LONG_3) { // Corrections for opposite rotation or after birds
     for(int hand=0; hand<nr_of_hands; hand++) {
-      if(hands[hand]->direction == CW) {
-        while(hands[hand]->target_position - hands[hand]->virtual_position < int(1*steps_per_revolution)) hands[hand]->target_position += steps_per_revolution;
-        while(hands[hand]->target_position - hands[hand]->virtual_position >= int(2*steps_per_revolution)) hands[hand]->target_position -= steps_per_revolution;
+      if(hands[hand].direction == CW) {
+        while(hands[hand].target_position - hands[hand].virtual_position < int(1*steps_per_revolution)) hands[hand].target_position += steps_per_revolution;
+        while(hands[hand].target_position - hands[hand].virtual_position >= int(2*steps_per_revolution)) hands[hand].target_position -= steps_per_revolution;
       }
       else {
-        while(hands[hand]->virtual_position - hands[hand]->target_position < int(1*steps_per_revolution)) hands[hand]->target_position -= steps_per_revolution;
-        while(hands[hand]->virtual_position - hands[hand]->target_position >= int(2*steps_per_revolution)) hands[hand]->target_position += steps_per_revolution;
+        while(hands[hand].virtual_position - hands[hand].target_position < int(1*steps_per_revolution)) hands[hand].target_position -= steps_per_revolution;
+        while(hands[hand].virtual_position - hands[hand].target_position >= int(2*steps_per_revolution)) hands[hand].target_position += steps_per_revolution;
       }
     }
   }
 
   if(_current_animation == LONG_4) {
     for(int hand=0; hand<nr_of_hands; hand++) {
-      if(hands[hand]->direction == CW) while(hands[hand]->target_position - hands[hand]->virtual_position < int(1*steps_per_revolution)) hands[hand]->target_position += steps_per_revolution;
-      else while(hands[hand]->virtual_position - hands[hand]->target_position < int(1*steps_per_revolution)) hands[hand]->target_position -= steps_per_revolution;
+      if(hands[hand].direction == CW) while(hands[hand].target_position - hands[hand].virtual_position < int(1*steps_per_revolution)) hands[hand].target_position += steps_per_revolution;
+      else while(hands[hand].virtual_position - hands[hand].target_position < int(1*steps_per_revolution)) hands[hand].target_position -= steps_per_revolution;
     }
 
   }
 
   if(_current_animation == LONG_5) {
-    if(hands[nr_of_hands-2]->target_position - hands[nr_of_hands-2]->virtual_position < int(.33*steps_per_revolution)) hands[nr_of_hands-2]->target_position += steps_per_revolution;
-    if(hands[nr_of_hands-1]->target_position - hands[nr_of_hands-1]->virtual_position < int(.33*steps_per_revolution)) hands[nr_of_hands-1]->target_position += steps_per_revolution;
+    if(hands[nr_of_hands-2].target_position - hands[nr_of_hands-2].virtual_position < int(.33*steps_per_revolution)) hands[nr_of_hands-2].target_position += steps_per_revolution;
+    if(hands[nr_of_hands-1].target_position - hands[nr_of_hands-1].virtual_position < int(.33*steps_per_revolution)) hands[nr_of_hands-1].target_position += steps_per_revolution;
   }
 
   calculate_animation_equal_duration(/*extra rotations*/ extra_rotations, /*max_speed*/ max_speed, /*accel*/ accel_fraction, /*decel*/  decel_fraction);
@@ -1281,7 +1344,7 @@ void Clockception::show_time_with_delays(uint8_t predefined_hour, uint8_t predef
   
   if(_current_animation == LONG_7) {
     for(int hand=0; hand<nr_of_hands; hand++) {
-      if(hands[hand]->target_position - hands[hand]->virtual_position < int(.33*steps_per_revolution)) hands[hand]->target_position += steps_per_revolution;
+      if(hands[hand].target_position - hands[hand].virtual_position < int(.33*steps_per_revolution)) hands[hand].target_position += steps_per_revolution;
     }
   }
 
@@ -1309,29 +1372,27 @@ void Clockception::set_settings() {
 }
 
 void Clockception::set_time_hour_back() {
-  Serial.println(F("Set time hour back"));
-
   if(_hour <= 0) _hour = 23;
   else _hour--;
 
-  rtc->adjust(DateTime(2000, 1, 1, _hour, _minute, _second)); // Write time to RTC
+  time_base.adjust(_hour, _minute, _second); // Write time to RTC
+  telemetry.log(TELEMETRY_TIME_SET, 0, (unsigned long)_hour << 8 | _minute);
 
   set_time_positions();
-  hands[nr_of_hands-2]->set_direction(CCW);
+  hands[nr_of_hands-2].set_direction(CCW);
   show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 0.2, /*decel*/ 0.2);
   run_animation();
 }
 
 void Clockception::set_time_hour_forward() {
-  Serial.println(F("Set time hour forward"));
-
   if(_hour >= 23) _hour = 0;
   else _hour++;
 
-  rtc->adjust(DateTime(2000, 1, 1, _hour, _minute, _second)); // Write time to RTC
+  time_base.adjust(_hour, _minute, _second); // Write time to RTC
+  telemetry.log(TELEMETRY_TIME_SET, 0, (unsigned long)_hour << 8 | _minute);
 
   set_time_positions();
-  hands[nr_of_hands-2]->set_direction(CW);
+  hands[nr_of_hands-2].set_direction(CW);
   show_time_equal_duration(/*get current time*/ 99, 99, /*extra rotations*/ 0, /*max_speed*/ 800, /*accel*/ 0.2, /*decel*/ 0.2);
   run_animation();
 }
@@ -1371,24 +1432,22 @@ void Clockception::set_time() {
     else {
       // No button pushed, but let hands take steps to desired position
       // Rotate hour hand
-      if(hands[hour_hand]->current_position != hands[hour_hand]->target_position) hands[hour_hand]->run_manually(QUICKEST_DIRECTION);
+      if(hands[hour_hand].current_position != hands[hour_hand].target_position) hands[hour_hand].run_manually(QUICKEST_DIRECTION);
       // Rotate minute hand
-      if(hands[minute_hand]->current_position != hands[minute_hand]->target_position) hands[minute_hand]->run_manually(QUICKEST_DIRECTION);
+      if(hands[minute_hand].current_position != hands[minute_hand].target_position) hands[minute_hand].run_manually(QUICKEST_DIRECTION);
     }
 
     if(change == true) {
       // Calculate new positions
       set_time_positions();
-      Serial.print("New time: ");
-      Serial.print(_hour);
-      Serial.print(" ");
-      Serial.println(_minute);
+      telemetry.log(TELEMETRY_TIME_SET, 0, (unsigned long)_hour << 8 | _minute);
     }
+    telemetry.service();
   }
 
   // Set new time to RTC
   _last_minute = _minute;
-  rtc->adjust(DateTime(2000, 1, 1, _hour, _minute, 0)); // Write time to RTC
+  time_base.adjust(_hour, _minute, 0); // Write time to RTC
 }
 
 ///////////////////////////////////////////////////////////////////////////////// TEST HAND ORDER /////////////////////////////////////////////////////////////
@@ -1397,133 +1456,245 @@ void Clockception::test_hand_order() {
   for(int hand=8; hand<nr_of_hands; hand++) {
     Serial.print(hand);
     Serial.print(" with pins: ");
-    Serial.print(hands[hand]->step_pin());
+    Serial.print(hands[hand].step_pin());
     Serial.print(", ");
-    Serial.println(hands[hand]->dir_pin());
-    hands[hand]->target_position = steps_per_revolution-1;
-    while(hands[hand]->current_position != hands[hand]->target_position) hands[hand]->run_manually(CW);
+    Serial.println(hands[hand].dir_pin());
+    hands[hand].target_position = steps_per_revolution-1;
+    while(hands[hand].current_position != hands[hand].target_position) hands[hand].run_manually(CW);
     while(!button_set->pushed()) delay(1);
   }
 }
 
+#ifdef CYCLE_PROFILE
+void Clockception::benchmark() {
+  // Script and C++ animations, with each of the planners they use
+  static const uint8_t animations[] = {LONG_1, LONG_3, LONG_6, LONG_8, SHORT_1, SHORT_4, SHORT_13};
+
+  cycle_profile.begin();
+  cycle_profile.print_header();
+  for(uint8_t i=0; i<sizeof(animations); i++) {
+    get_time();
+    randomSeed(animations[i]); // Same random choices on every run
+    cycle_profile.clear();
+    play_animation(animations[i]);
+    cycle_profile.print(animations[i]);
+  }
+}
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////// RUN /////////////////////////////////////////////////////////////////////////
 
 void Clockception::wait_for_new_minute() {
+  _events_enabled = true; // Settings are done, the clock runs on its own from now on
+  get_time(); // The second of the last read can be from long ago, e.g. the start of the animation
   while(_minute == _last_minute) {
-    unsigned long waiting_start = millis();
-    unsigned long wait_time = (60-_second);
-    while(millis() - waiting_start <= (wait_time*1000)) { // Loop until wait time is past
-      if(button_set->pushed()) set_settings(); // Check for button push
-      else if(button_forward->pushed()) set_time_hour_forward();
-      else if(button_back->pushed()) set_time_hour_back();
+    tick();
+    if(_pending_event != NO_EVENT) handle_event();
+#ifdef STEP_STATISTICS
+    else if(Serial.available()) { // Send s to print the step statistics, c to clear them
+      int command = Serial.read();
+      if(command == 's') step_statistics.print();
+      else if(command == 'c') step_statistics.clear();
     }
+#endif
+    time_base.check(); // Hands are idle, reading the RTC over I2C does not delay steps
+    sleep(); // Nothing due until the next millisecond
+    get_time(); // Counted from the square wave, reading it is a copy of a few bytes
+  }
+}
+
+void Clockception::tick() {
+  // Buttons are read once per millisecond, a press is kept until it is handled
+  unsigned long now = millis();
+  if(_events_enabled && now != _last_button_check) {
+    _last_button_check = now;
+    if(_pending_event == NO_EVENT) {
+      if(button_set->pushed()) _pending_event = SET_EVENT;
+      else if(button_forward->pushed()) _pending_event = FORWARD_EVENT;
+      else if(button_back->pushed()) _pending_event = BACK_EVENT;
+    }
+  }
+
+  sync_bus.service();
+  telemetry.service();
+}
 
-    get_time(); // Check time.
+void Clockception::wait(unsigned long ms) {
+  if(_predicting) {
+    add_prediction(ms * 1000, 1);
+    return;
   }
+  _next_movement++;
+  if(_on_budget) _budget_left -= ms * 1000; // Part of the animation as a whole, see budget_speedup()
+  unsigned long wait_start = millis();
+  while(millis() - wait_start < ms && _pending_event == NO_EVENT) {
+    tick();
+    sleep();
+  }
+}
+
+void Clockception::sleep() {
+  if(!telemetry.empty()) return; // Records are waiting for room in the serial buffer, keep trying
+  set_sleep_mode(SLEEP_MODE_IDLE); // Timers and serial keep running
+  sleep_mode();
+}
+
+void Clockception::handle_event() {
+  uint8_t event = _pending_event;
+  _pending_event = NO_EVENT; // Clear first, the handlers run animations themselves
+  discard_plan(); // Handlers move the hands and may change the time
+  _on_budget = false; // Setting the time takes as long as it takes
+  _events_enabled = false; // Buttons belong to the handler until it is done
+
+  if(event == SET_EVENT) set_settings();
+  else if(event == FORWARD_EVENT) set_time_hour_forward();
+  else if(event == BACK_EVENT) set_time_hour_back();
+
+  _events_enabled = true;
 }
 
-void Clockception::run() {
+void Clockception::run(unsigned int minutes) {
   randomSeed(analogRead(unused_pin)); // Set a random seed by reading an unused (floating) input pin
   get_time(); // Get time when running starts.
   
-  while(true) { // Run forever
-    wait_for_new_minute();
+  for(unsigned int minute=0; minutes == 0 || minute < minutes; minute++) { // Run forever without a number of minutes
+    run_minute();
+  }
+}
+
+void Clockception::run_minute() {
+  if(sync_bus.follower() && follow_master()) return;
+
+  // Select the animation of the next minute and plan it while waiting, so the hands start moving right on the minute
+  uint8_t hour, minute, second;
+  time_base.now(hour, minute, second);
+  uint8_t next_minute = (minute + 1) % 60;
+  uint8_t next_hour = next_minute == 0 ? (hour + 1) % 24 : hour;
+  select_animation(next_minute);
+  if(sync_bus.master()) announce_animation(next_hour, next_minute);
+  plan_animation(_current_animation, next_hour, next_minute);
+
+  wait_for_new_minute();
+
+  telemetry.log(TELEMETRY_TIME, 0, (unsigned long)_hour << 8 | _minute);
+  if(_minute != next_minute) { // Time was changed while waiting, play_animation() drops the plan
+    select_animation(_minute);
+    if(sync_bus.master()) announce_animation(_hour, _minute);
+  }
 
-    // Print time and select animation
-    Serial.print(_hour);
-    Serial.print(F(":"));
-    Serial.println(_minute);
+  sync_bus.start(_second); // Followers start at the same moment as the master
+  play_animation(_current_animation);
+  if(_pending_event != NO_EVENT) handle_event(); // Button was pushed during the animation
+}
 
-    while(_current_animation == _previous_animation) { // Selet new animation, that doesn't match previous animation
-      if (_minute % 5 == 0) _current_animation = random(1, 14); // Long animation
-      else _current_animation = random(1, 14) + 20; // Short animations start in 20 range
+void Clockception::announce_animation(uint8_t hour, uint8_t minute) {
+  // Followers use the same random numbers, so animations with random movements look the same on all units
+  sync_bus.measure_latencies();
+  unsigned long seed = random(1, 0x7FFFFFFF);
+  randomSeed(seed);
+  sync_bus.announce(hour, minute, _current_animation, seed);
+}
+
+bool Clockception::follow_master() {
+  if(sync_bus.master_silent()) {
+    telemetry.log(TELEMETRY_BUS_SILENT, 0, 0);
+    return false;
+  }
+
+  _events_enabled = true;
+  Sync_announcement announcement;
+  while(!sync_bus.started(announcement)) {
+    tick();
+    if(_pending_event != NO_EVENT) handle_event();
+    if(sync_bus.announced(announcement)) { // Plan while waiting for the start, like the master does
+      randomSeed(announcement.seed);
+      plan_animation(announcement.animation, announcement.hour, announcement.minute);
     }
+    if(sync_bus.master_silent()) return false; // Run on the own RTC until the master is back
+    sleep(); // Also wakes on a byte from the bus
+  }
+  // Show the time of the master, and keep it when running on the own RTC later. Writing the RTC takes a milli second, done before the start.
+  _hour = announcement.hour;
+  _minute = announcement.minute;
+  _second = announcement.second;
+  time_base.adjust(_hour, _minute, _second); // Write time to RTC
+  sync_bus.wait_for_start();
+  telemetry.log(TELEMETRY_TIME, 0, (unsigned long)_hour << 8 | _minute);
+
+  if(_planned_animation != announcement.animation) randomSeed(announcement.seed); // Plan was dropped, planning at the start gets the same random numbers
+  play_animation(announcement.animation);
+  sync_bus.listen(); // The master sends nothing while it plays, however long the animation takes
+  if(_pending_event != NO_EVENT) handle_event(); // Button was pushed during the animation
+  return true;
+}
 
-    switch(_current_animation) {
-      case LONG_1:
-        animation_long_1();
-        break;
-      case LONG_2:
-        animation_long_2();
-        break;
-      case LONG_3:
-        animation_long_3();
-        break;
-      case LONG_4:
-        animation_long_4();
-        break;
-      case LONG_5:
-        animation_long_5();
-        break;
-      case LONG_6:
-        animation_long_6();
-        break;
-      case LONG_7:
-        animation_long_7();
-        break;
-      case LONG_8:
-        animation_long_8();
-        break;
-      case LONG_9:
-        animation_long_9();
-        break;
-      case LONG_10:
-        animation_long_10();
-        break;
-      case LONG_11:
-        animation_long_11();
-        break;
-      case LONG_12:
-        animation_long_12();
-        break;
-      case LONG_13:
-        animation_long_12();
-        break;
-      
-      case SHORT_1:
-        animation_short_1();
-        break;
-      case SHORT_2:
-        animation_short_2();
-        break;
-      case SHORT_3:
-        animation_short_3();
-        break;
-      case SHORT_4:
-        animation_short_4();
-        break;
-      case SHORT_5:
-        animation_short_5();
-        break;
-      case SHORT_6:
-        animation_short_6();
-        break;
-      case SHORT_7:
-        animation_short_7();
-        break;
-      case SHORT_8:
-        animation_short_8();
-        break;
-      case SHORT_9:
-        animation_short_9();
-        break;
-      case SHORT_10:
-        animation_short_10();
-        break;
-      case SHORT_11:
-        animation_short_11();
-        break;
-      case SHORT_12:
-        animation_short_12();
-        break;
-      case SHORT_13:
-        animation_short_13();
-        break;
+void Clockception::select_animation(uint8_t minute) {
+  do { // Select new animation, that doesn't match previous animation
+    if (minute % 5 == 0) _current_animation = random(1, 14); // Long animation
+    else _current_animation = random(1, 14) + 20; // Short animations start in 20 range
+  } while(_current_animation == _previous_animation);
+}
+
+void Clockception::play_animation(int animation) {
+  if(_planned_animation != animation || _planned_hour != _hour || _planned_minute != _minute) discard_plan(); // Planned for another animation or time
+  _current_animation = animation;
+  start_budget();
+
+  Animation_entry entry;
+  if(find_animation(_current_animation, entry)) {
+    if(!_planned_animation) predict_animation(entry); // Planned ahead, it was predicted then
+    if(entry.script) interpret_script(_planned_animation ? _planned_script : entry.script, false); // Planned script goes on with its first movement
+    else {
+      if(!_planned_animation) (this->*entry.plan)();
+      (this->*entry.function)();
     }
-    
-    _previous_animation = _current_animation;
-    _last_minute = _minute;
   }
+
+  _planned_animation = 0;
+  _on_budget = false;
+  _previous_animation = _current_animation;
+  _last_minute = _minute;
+}
+
+void Clockception::plan_animation(int animation, uint8_t hour, uint8_t minute) {
+  discard_plan();
+
+  Animation_entry entry;
+  if(!find_animation(animation, entry)) return;
+
+  // Plan with the time the animation is for, then restore the time wait_for_new_minute() compares with
+  uint8_t current_hour = _hour;
+  uint8_t current_minute = _minute;
+  _hour = hour;
+  _minute = minute;
+  _current_animation = animation; // Corrections in show_time_*() depend on the animation
+  _planning_ahead = true;
+
+  predict_animation(entry);
+  if(entry.script) _planned_script = interpret_script(entry.script, true);
+  else (this->*entry.plan)();
+
+  _planning_ahead = false;
+  _hour = current_hour;
+  _minute = current_minute;
+  _planned_animation = animation;
+  _planned_hour = hour;
+  _planned_minute = minute;
+}
+
+void Clockception::discard_plan() {
+  if(_planned_animation == 0) return;
+  coordinator.clear();
+  clear_all_instructions(); // Also moves the virtual positions back to the idle hands
+  _planned_animation = 0;
+}
+
+bool Clockception::find_animation(int animation, Animation_entry &entry) {
+  for(uint8_t i=0; i<sizeof(_animation_table)/sizeof(_animation_table[0]); i++) {
+    memcpy_P(&entry, &_animation_table[i], sizeof(entry));
+    if(entry.number == animation) return true;
+  }
+  return false;
 }
 
 
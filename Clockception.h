@@ -6,6 +6,11 @@
 #include "Clockhand.h"
 #include <RTClib.h>
 #include "Button.h"
+#include "Stepscheduler.h"
+#include "Coordinator.h"
+#include "Cycleprofile.h"
+
+#define MAX_PREDICTED_MOVEMENTS 12 // Movements and waits of an animation that budget_speedup() knows apart, the ones after them count as one
 
 class Clockception
 {
@@ -22,6 +27,11 @@ private:
         DECELERATE = 2,
         DELAY = 3,
         SWITCH_DIRECTION = 4,
+        S_CURVE = 5,
+        // Sync policies of calculate_animation_time_optimal()
+        SYNC_START = 0, // Hands start together, hands that arrive earlier wait at the end
+        SYNC_ARRIVE = 1, // Hands with fewer steps wait at the start, so all arrive together
+        SYNC_INDEPENDENT = 2, // Hands do not wait for each other
         // Animations
         LONG_1 = 1,
         LONG_2 = 2,
@@ -49,9 +59,15 @@ private:
         SHORT_11 = 31,
         SHORT_12 = 32,
         SHORT_13 = 33,
+        // Button events, handled between animations
+        NO_EVENT = 0,
+        SET_EVENT = 1,
+        FORWARD_EVENT = 2,
+        BACK_EVENT = 3,
     };
 
-    Clockhand *hands[18];
+    Clockhand hands[18]; // Allocated statically, so their memory shows in the size of the program
+    uint32_t _active_hands; // Bit per hand that has steps left in the running animation, cleared when its last step is queued
     RTC_DS3231 *rtc;
     Button *button_back;
     Button *button_set;
@@ -59,13 +75,6 @@ private:
 
 
     float _max_speed; // Step interval in micro seconds at max speed
-    unsigned int _default_acceleration_curve[100]; // Step intervals in micro seconds for creating a nice acceleration
-    unsigned int _acceleration_curves[18][100]; // Step intervals in micro seconds for creating a nice acceleration
-    float _c0;
-    float _cn;
-    int _default_acceleration_curve_length;
-    unsigned int _default_acceleration_curve_end_speed;
-    unsigned long _total_acceleration_duration;
     bool _directions[18];
     unsigned int _min_steps_to_take;
     unsigned int _max_steps_to_take;
@@ -76,6 +85,84 @@ private:
     uint8_t _second;
     uint8_t _last_minute;
     unsigned long _time_start_animation;
+    long _budget_left; // Micro seconds left of animation_budget, counted down with the predicted durations of the movements and waits
+    bool _on_budget; // Movements are fitted in animation_budget, only while an animation plays and not while the time is set
+    unsigned long _movement_durations[MAX_PREDICTED_MOVEMENTS]; // Predicted micro seconds of each movement and wait of the animation before any speed up, see predict_animation()
+    float _movement_speedups[MAX_PREDICTED_MOVEMENTS]; // How much faster each of them can go, 1 for a wait
+    uint8_t _predicted_movements; // Entries in _movement_durations
+    uint8_t _next_movement; // Movements and waits of the animation that started, the index in _movement_durations of the one after them
+    bool _predicting; // Movements are planned and predicted without moving the hands, see predict_animation()
+    uint8_t _pending_event; // Button that was pushed, the animation that runs skips its remaining movements
+    unsigned long _last_button_check; // millis() at which the buttons were read
+    bool _events_enabled; // Buttons are only read into events while the clock runs on its own, not while settings are made
+    uint8_t _planned_animation; // Animation that was planned ahead with plan_animation(), 0 if none
+    uint8_t _planned_hour; // Time the planned animation is for
+    uint8_t _planned_minute;
+    const uint8_t *_planned_script; // Code of the planned script to go on with when it starts
+    bool _planning_ahead; // get_time() keeps the planned time while planning ahead
+
+    // Animations by number, played from a script or by a function
+    struct Animation_entry
+    {
+        uint8_t number;
+        const uint8_t *script; // Script in flash, see Animationscript.h, or 0 to call function
+        void (Clockception::*function)(); // Plays the animation from its first movement on, after plan
+        void (Clockception::*plan)(); // Plans the first movement, like a script up to its first run. Can be planned ahead.
+    };
+    static const Animation_entry _animation_table[26]; // In flash
+
+    bool find_animation(int animation, Animation_entry &entry);
+    /* Copies the table entry of an animation from flash. Returns false if there is no such animation. */
+
+    const uint8_t *interpret_script(const uint8_t *script, bool plan_only);
+    /* Runs the codes of a script. With plan_only it stops before the first code that moves the hands or waits, and returns where it stopped. */
+
+    void run_minute();
+    /* Selects, plans and plays the animation of the next minute. Followers on a bus play what the master announces, at its start. */
+
+    bool follow_master();
+    /* Follower: plans the animation the master announces and plays it when the master starts it. Returns false if the master is silent. */
+
+    void announce_animation(uint8_t hour, uint8_t minute);
+    /* Master: measures the latencies of the followers, then seeds the random numbers and sends the animation with the seed to the followers */
+
+    void select_animation(uint8_t minute);
+    /* Picks a random animation for a minute, long ones on every fifth minute, that differs from the previous animation */
+
+    void discard_plan();
+    /* Drops the instructions of an animation that was planned ahead, e.g. when the time was changed while waiting for it */
+
+    void log_animation_end(unsigned long loops);
+    /* Logs duration, loop count and hand positions of the animation that just ran to telemetry */
+
+    void start_budget();
+    /* Starts the budget of the animation at the second of the RTC that was read last, its movements have to end animation_budget after the start
+    of that minute. The budget is counted down with predictions instead of millis(), so units on the sync bus speed up alike. */
+
+    float budget_speedup(unsigned long predicted, float max_speedup);
+    /* Logs the predicted duration of the movement that is set, in micro seconds, and returns how much faster it has to run to end within
+    animation_budget: 1 if it fits, at most max_speedup. The movements and waits after it are taken from predict_animation(), so all are sped up
+    alike instead of the last ones having no time left. Those that can not go that fast leave less time to this one. */
+
+    void predict_animation(const Animation_entry &entry);
+    /* Plays the animation without moving the hands, or a script from entry.script on: each movement is planned and its duration and how much
+    faster it can go are kept for budget_speedup(). Stops at a wait for a new minute. Hands and random numbers are set back after, so the
+    animation plays as predicted. */
+
+    void add_prediction(unsigned long duration, float max_speedup);
+    /* Adds a movement or wait to the prediction, to the last entry if all are taken */
+
+    unsigned long movement_prediction(float &max_speedup);
+    /* Blends the joins of the movement that is set and returns its predicted duration in micro seconds, and how much faster it can go */
+
+    unsigned int subtract_steps(unsigned int steps, unsigned int part, int hand);
+    /* Returns steps minus the part of them that is planned for a movement, logs to telemetry if the part is larger */
+
+    void sleep();
+    /* Idle the CPU until the next interrupt, the step and millis() interrupts wake it at least every millisecond */
+
+    void handle_event();
+    /* Runs the settings or time change of the pending button event */
 
 public:
     Clockception();
@@ -83,26 +170,67 @@ public:
      void init();
     /* Creates hands, RTC and rotary encoder */
 
-    void calculate_default_acceleration_curve();
-    /* Calculates the default acceleration curve, which is adapted for each hand prior to executing an animation */
-    
-    void calculate_corrected_curves();
-    /* Calculates an adapted acceleration curve to end at the desired speed for this hand */
-    
     void set_direction_of_all_hands(bool direction);
     /* Sets direction of each hand */
 
     void set_shortest_direction_to_target();
     /* Sets direction for each hand that gives the shortest distance to the target */
 
+    // Pattern kernels, the place of a hand in a pattern is in Clockgeometry.h
+    void pattern_targets(uint32_t mask, uint8_t pattern, int first, int step);
+    /* Sets the target of the hands in the mask to first + step * their place in the pattern, within one revolution */
+
+    void pattern_delays(uint32_t mask, uint8_t pattern, int first, int step, int interval);
+    /* Adds a delay of first + step * place steps to the hands in the mask, or nothing for hands that get no steps */
+
+    void pattern_directions(uint32_t mask, uint8_t pattern, bool direction);
+    /* Sets the direction of the hands in the mask on an even place in the pattern, the hands on an odd place turn the other way */
+
+    void pattern_mirror(uint32_t mask);
+    /* Sets the hands in the mask to the mirror image of the target and direction of their mirror_hand() */
+
     void run_animation();
     /* Sets a loop to run all animations for all hands, untill all hands are finished */
 
-    void run();
-    /* The general loop to run de program infinite */
+    void run_coordinated_animation();
+    /* Runs the animation set with calculate_animation_coordinated(), untill all hands are finished */
+
+    bool instructions_complete();
+    /* Returns false if an instruction of any hand did not fit in the instruction pool */
+
+    void clear_all_instructions();
+    /* Clears the instructions of all hands and empties the instruction pool */
+
+    bool fill_step_queues();
+    /* Compiles the next steps of each hand and queues them for the step scheduler. Returns true if any steps were queued. */
+
+    unsigned long planned_duration();
+    /* Returns the duration in micro seconds of the animation that is set, before running it */
+
+    void run(unsigned int minutes = 0);
+    /* The general loop to run de program infinite, or a number of minutes (e.g. in the host simulation in sim/) */
+
+    void play_animation(int animation);
+    /* Runs one animation by its number (LONG_1 to LONG_13 or SHORT_1 to SHORT_13) */
+
+    void play_script(const uint8_t *script);
+    /* Runs an animation script from flash, see Animationscript.h */
+
+    void plan_animation(int animation, uint8_t hour, uint8_t minute);
+    /* Plans the first movement of an animation for a time ahead, while the hands are idle: a script up to its first run, an animation in C++ with
+    its plan function. play_animation() at that time starts it without planning. Later movements are planned when the one before has ended. */
+
+    Clockhand *get_hand(int hand);
+    /* Returns a hand, to follow its position from outside the clock (e.g. the host simulation in sim/) */
 
     void wait_for_new_minute();
-    /* Wait for next minute, while checking for button presses */
+    /* Wait for next minute, while handling button presses */
+
+    void tick();
+    /* Does the work between steps: reads the buttons into a pending event and sends telemetry. Called from every loop that waits. */
+
+    void wait(unsigned long ms);
+    /* Pause between movements of an animation without blocking tick(). Returns early when a button event is pending. */
 
     void disable_drivers();
     /* Set RESET pin low */
@@ -117,36 +245,21 @@ public:
     bool hands_finished();
     /* Returns true if all hands are finished */
 
-    // Higer level animation functions
-    void animation_long_1(); // Stretch_and_turn
-    void animation_long_2(); // Opposite rotation
-    void animation_long_3(); // Bird shapes
+    // Higer level animation functions, animations that are not in Animationscript.cpp. The plan_*() functions plan their first movement.
+    void plan_long_3(); // Bird shapes
+    void animation_long_3();
     void animation_long_3_to_birds(); // Partial animation
     void animation_long_3_to_bottom(); // Partial animation
-    void animation_long_4(); // Opposite rotation with differend hand speeds
-    void animation_long_5(); // Opposite rotation oriented to center
-    void animation_long_6(); // Frame rotates in a minute
-    void animation_long_7(); // Stretched rotation with each clock different speeds
-    void animation_long_8(); // Small clocks that turn 12 hours
-    void animation_long_9(); // Opposite rotation oriented to center, time that hands come together to hour and minute hands -> causes drift of hour hand
-    void animation_long_10(); // Stretch_and_turn variation
-    void animation_long_11(); // Stretch and each column opposite rotation
-    void animation_long_12(); // Subsequent rotation downwards and back
+    void plan_long_8(); // Small clocks that turn 12 hours
+    void plan_long_12(); // Subsequent rotation downwards and back
+    void animation_long_12();
     void animation_long_13(); // Splash animation
 
-    void animation_short_1(); // One revolution all hands same time
-    void animation_short_2(); // One revolution different start and end times
-    void animation_short_3(); // All hands out, then back
-    void animation_short_4(); // Create a wave through the frame
-    void animation_short_5(); // Rotation with random delay and speed
-    void animation_short_6(); // All hands inwards, then back
-    void animation_short_7(); // Turn corners first
-    void animation_short_8(); // Corners out, straights in
-    void animation_short_9(); // Corners in, straights out
-    void animation_short_10(); // All hands horizontal
-    void animation_short_11(); // All hands vertical
-    void animation_short_12(); // One rotation after each other
-    void animation_short_13(); // One rotation, each row after another
+    void plan_short_4(); // Create a wave through the frame
+    void plan_short_5(); // Rotation with random delay and speed
+    void plan_short_10(); // All hands horizontal
+    void plan_short_11(); // All hands vertical
+    void animation_short_10(); // Shows the time after short 10 and 11
     void animation_to_zero(); // All hands to zero
     void animation_to_bottom(); // All hands to bottom
 
@@ -178,6 +291,24 @@ public:
     This type should be used when all hands need to start and end equally but a end speed (or start speed when decelerating) difference isn't a problem.
     */
 
+    void calculate_animation_coordinated(char extra_rotations, unsigned int max_speed, float accel_fraction, float decel_fraction);
+    /* Calculates an animation in which all hands follow one master timeline, like the axes of a CNC machine. The hand with the most steps moves at max_speed,
+    the steps of the other hands are spread over the same ticks. All hands start and arrive on the same tick, by construction.
+    This type can not be combined with other instructions, run it with run_coordinated_animation().
+    */
+
+    void calculate_animation_s_curve(char extra_rotations, unsigned int max_speed, unsigned int acceleration, unsigned long jerk);
+    /* Calculates an animation in which each hand moves to its target with one jerk limited S-curve: acceleration ramps up and down instead of jumping,
+    so hands can run faster without missing steps. Limits are in steps per second, per second^2 and per second^3. Hands start at the same time, 
+    hands with fewer steps arrive earlier. Only one set of limits per hand per animation, like the acceleration factors.
+    */
+
+    void calculate_animation_time_optimal(char extra_rotations, uint8_t sync);
+    /* Calculates an animation in which each hand moves to its target in the shortest time its motor allows: accelerate at motor_max_acceleration to
+    motor_max_speed of settings.h, cruise and decelerate, or turn around halfway when the speed is not reached. Hands that are done before the slowest one
+    wait at the start or at the end, as the sync policy says (SYNC_START, SYNC_ARRIVE or SYNC_INDEPENDENT). Replaces guessing a max_speed and fractions.
+    */
+
     void calculate_run_with_same_speed(unsigned int steps, unsigned int speed);
     /* Runs hands with fixed speed, all hands same steps and speed */
 
@@ -206,6 +337,12 @@ public:
     void test_hand_order();
     /* Run all hands one by one */
 
+#ifdef CYCLE_PROFILE
+    void benchmark();
+    /* Plays a fixed set of animations and prints the cycles of the step code and the planners of each as CSV. Call before set_settings(), buttons are
+    not read. */
+#endif
+
 };
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef Clockgeometry_h
+#define Clockgeometry_h
+
+#include <Arduino.h>
+#include "settings.h"
+
+// Places of the clocks as drawn in settings.h, so animations can pick hands by where they are instead of by number. Clock c has the hour hand 2*c
+// and the minute hand 2*c+1.
+
+struct Clock_place
+{
+    int8_t x; // Centre of the clock, neighbours on a side of the diamond are one unit apart in x and in y. x grows to the right, y downwards.
+    int8_t y;
+    uint8_t ring; // Place on the frame clockwise from the top, the clock in the middle is 8
+};
+
+constexpr Clock_place clock_places[nr_of_hands/2] = {
+  {0, -2, 0}, {1, -1, 1}, {2, 0, 2}, {1, 1, 3}, {0, 2, 4}, {-1, 1, 5}, {-2, 0, 6}, {-1, -1, 7}, {0, 0, 8}
+};
+
+// Place of a hand in each pattern, see pattern_place()
+enum
+{
+    PATTERN_ROW, // 0 at the top to 4 at the bottom
+    PATTERN_COLUMN, // 0 on the left to 4 on the right
+    PATTERN_RADIUS, // 0 in the middle, 1 on the sides, 2 in the corners
+    PATTERN_RING, // Place of the clock on the frame, 8 in the middle
+    PATTERN_PHASE, // Place on a walk around the frame: hand 0, then both hands of each clock clockwise, minute hand first, and hand 1 last. 16 and 17 in the middle.
+    PATTERN_ROLE // 0 for hour hands, 1 for minute hands
+};
+
+constexpr uint8_t hand_row(int hand) {
+  return clock_places[hand/2].y + 2;
+}
+
+constexpr uint8_t hand_column(int hand) {
+  return clock_places[hand/2].x + 2;
+}
+
+constexpr uint8_t hand_radius(int hand) {
+  return (clock_places[hand/2].x * clock_places[hand/2].x + clock_places[hand/2].y * clock_places[hand/2].y) / 2;
+}
+
+constexpr uint8_t hand_ring(int hand) {
+  return clock_places[hand/2].ring;
+}
+
+constexpr uint8_t hand_phase(int hand) {
+  return hand >= nr_of_hands-2 ? hand : (2*hand_ring(hand) + nr_of_hands-2 - hand%2) % (nr_of_hands-2);
+}
+
+constexpr bool is_minute_hand(int hand) {
+  return hand%2 == 1;
+}
+
+constexpr uint8_t pattern_place(uint8_t pattern, int hand) {
+  return pattern == PATTERN_ROW ? hand_row(hand) :
+         pattern == PATTERN_COLUMN ? hand_column(hand) :
+         pattern == PATTERN_RADIUS ? hand_radius(hand) :
+         pattern == PATTERN_RING ? hand_ring(hand) :
+         pattern == PATTERN_PHASE ? hand_phase(hand) : is_minute_hand(hand);
+}
+
+constexpr int mirror_hand(int hand) {
+  return hand >= nr_of_hands-2 ? hand : 2*((8 - hand_ring(hand)) % 8) + hand%2;
+}
+/* Hand in the same role on the other side of the vertical axis */
+
+#endif
@@ -1,66 +1,115 @@
 #include "Clockhand.h"
+#include "Stepscheduler.h"
+#include "Stepoutput.h"
+#include "Accelerationcurve.h"
+#include "Instructionpool.h"
+#include "Telemetry.h"
+#include "Cycleprofile.h"
 
-Clockhand::Clockhand(int nr_of_hand, byte step, byte dir, bool inverted, int steps_per_revolution, unsigned int* acceleration_curve) {
+const Clockhand::Interval_function Clockhand::_interval_functions[7] = {
+  &Clockhand::accelerate_interval, // ACCELERATE
+  &Clockhand::cruise_interval, // CRUISE
+  &Clockhand::decelerate_interval, // DECELERATE
+  &Clockhand::delay_interval, // DELAY
+  &Clockhand::switch_direction_interval, // SWITCH_DIRECTION
+  &Clockhand::s_curve_interval, // S_CURVE
+  &Clockhand::ramp_interval // RAMP
+};
 
+static const float s_curve_acceleration_unit = 16777216.0 / 1000000.0; // Acceleration of one step/s^2, so velocity change per micro second is in 8.24 fixed point
+static const float s_curve_jerk_unit = s_curve_acceleration_unit / 1000000.0 * 65536.0; // Jerk of one step/s^3 in acceleration per micro second, 16.16 fixed point
+static const unsigned long s_curve_relative_factor = 1099512; // 2^24/10^6 in 16.16 fixed point, turns velocity change times interval into a 24 bit fraction
+
+// Intervals of the start steps 2 to S_CURVE_START_STEPS relative to the first step: from rest the position is jerk*t^3/6, so step k is at cbrt(k) times the first one.
+// In 0.16 fixed point.
+static const uint16_t s_curve_start_steps[S_CURVE_START_STEPS-1] PROGMEM = {17034, 11949, 9513, 8033, 7022, 6279, 5706};
+
+static unsigned long power_of_two_above(unsigned long value) {
+  // Sets all bits below the highest one, without a loop over the bits, so the float rounding below costs the same at every step
+  value |= value >> 1;
+  value |= value >> 2;
+  value |= value >> 4;
+  value |= value >> 8;
+  value |= value >> 16;
+  return value + 1;
+}
+
+Clockhand::Clockhand() {
+  _nr = 0;
+  hand_finished = true;
+}
+
+void Clockhand::begin(int nr_of_hand, byte step, byte dir, bool inverted, int steps_per_revolution) {
+
+    _nr = nr_of_hand;
     _step_pin = step;
     _dir_pin = dir;
     _inverted = inverted;
     current_position = 0;
-    _acceleration_curve = acceleration_curve;
-    _instruction_counter = 0;
+    _current_instruction = NO_INSTRUCTION;
+    _last_instruction = NO_INSTRUCTION;
+    _instructions_dropped = false;
     _steps_per_revolution = steps_per_revolution;
     virtual_position = 0;
     _last_step_time = 0;
     _step_interval = 0;
     _default_step_interval = 500; // Speed used for setting time
     _minimum_step_interval = 250;
+    _direction_changed = false;
+    _start_of_movement = false;
+    _acceleration_speed_factor = 1;
+    _accel_speed = acceleration_curve_end_interval; // Speed of the curve at factor 1, a deceleration before the first acceleration follows it
+    _accel_vs_decel_speed_factor = 1;
+    set_curve_factor(1);
+    _decel_speed_factor = 65536;
+    _s_curve_acceleration_limit = 4000;
+    _s_curve_jerk = 40000;
     
     // Set the pins for step and direction
     pinMode(_step_pin, OUTPUT);
     pinMode(_dir_pin, OUTPUT);
     digitalWrite(_step_pin, LOW);
     digitalWrite(_dir_pin, LOW);
+    resolve_output(_step_pin, _step_port, _step_mask);
+    resolve_output(_dir_pin, _dir_port, _dir_mask);
 }
 
 void Clockhand::set_direction(bool new_direction) {
   direction = new_direction;
   virtual_direction = direction;
    // Write direction to stepper driver.
-  if (_inverted == direction) digitalWrite(_dir_pin, LOW);
-  else digitalWrite(_dir_pin, HIGH);
+  write_output(_dir_port, _dir_mask, _inverted != direction);
 }
 
 void Clockhand::clear_instructions() {
-    // Clears all instructions set previously
-    memset(_instruction_set_types, 0, sizeof(_instruction_set_types));
-    memset(_instruction_set_steps, 0, sizeof(_instruction_set_steps));
-    memset(_instruction_set_speeds, 0, sizeof(_instruction_set_speeds));
-    memset(_instruction_set_step_factors, 0, sizeof(_instruction_set_step_factors));
+    // Clears all instructions set previously. They stay in the instruction pool until it is cleared.
     virtual_position = current_position; // To be shure that current position is set as virtual position (when program interrupts an animation)
     hand_finished = true;
-    _instruction_counter = 0;
-    _current_instruction = 0;
+    _current_instruction = NO_INSTRUCTION;
+    _last_instruction = NO_INSTRUCTION;
+    _instructions_dropped = false;
     _substeps_to_go = 0;
     _step_interval = 0;
     _last_step_time = 0;
     _substeps_taken = 0;
 }
 
-void Clockhand::set_instruction(int type, int steps, int speed) {
-  /* Adds an instruction to the instructions array */
-  if(_instruction_counter == 9) Serial.println("Maximum instructions reached!");
-  if(_instruction_counter >9) Serial.println("Maximum instructions exceeded!");
-
+bool Clockhand::set_instruction(int type, int steps, int speed) {
+  /* Adds an instruction to the list of this hand in the instruction pool */
   if(steps <= 0) steps = 1; // Prevent division by zero
   if(speed <= 0) speed = 1; // Prevent division by zero
 
-  _instruction_set_types[_instruction_counter] = type; // Constant, accel or decel
-  _instruction_set_steps[_instruction_counter] = steps; // Steps to take
-  _instruction_set_speeds[_instruction_counter] = speed; // instruction_speed is steptime, inversion of input speed
-  _instruction_set_step_factors[_instruction_counter] = 100/float(steps); // Calculate the amount of steps relative to the acceleration curve.
+  uint8_t instruction = instruction_pool.append(_last_instruction, type, steps, speed); // instruction speed is steptime, inversion of input speed
+  if(instruction == NO_INSTRUCTION) {
+    telemetry.log(TELEMETRY_POOL_FULL, _nr, 0); // Instruction pool is full
+    _instructions_dropped = true; // Animation can not be run as planned
+    return false;
+  }
+  if(_current_instruction == NO_INSTRUCTION) _current_instruction = instruction; // First instruction of this hand
+  _last_instruction = instruction;
 
   // Update virtual position of hand since instruction is set
-  if(type != DELAY && type != SWITCH_DIRECTION) {
+  if(type != DELAY) { // Switch of direction takes its step in the old direction
     if(virtual_direction == CW) virtual_position += steps;
     else virtual_position -= steps;
     // Normalize virtual position
@@ -73,90 +122,632 @@ void Clockhand::set_instruction(int type, int steps, int speed) {
   }
 
   hand_finished = false;
-  _instruction_counter++;
+  return true;
+}
+
+bool Clockhand::instructions_dropped() {
+  return _instructions_dropped;
+}
+
+uint8_t Clockhand::first_instruction() {
+  return _current_instruction;
 }
 
 void Clockhand::get_next_instruction() {
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_NEXT_INSTRUCTION);
+#endif
+  unsigned long previous_interval = _step_interval; // Where a ramp starts
+
+  if(_movement_type != DELAY) update_positions(); // Update position, but not if instruction was delay (since no actual steps have been taken);
+
   // Get next instruction row
   if(_movement_type == SWITCH_DIRECTION) {
-    
-    if(direction) set_direction(false);
-    else set_direction(true);
-    _current_instruction++; // Directly get next instruction
+    // Steps before this one may still be queued, so the driver pin is written together with the next step
+    direction = !direction;
+    virtual_direction = direction;
+    _direction_changed = true;
+    _current_instruction = instruction_pool.next(_current_instruction); // Directly get next instruction
   }
-
-  if(_movement_type != DELAY && _movement_type != SWITCH_DIRECTION) update_positions(); // Update position, but not if instruction was delay (since no actual steps have been taken);
-  
   _substeps_taken = 0; // Reset
   
-  if(_current_instruction == _instruction_counter) { // Last instrucion was already executed, so this hand is finished.
+  if(_current_instruction == NO_INSTRUCTION) { // Last instrucion was already executed, so this hand is finished.
     hand_finished = true;
     clear_instructions();
     return;
   }
   
-  _substeps_to_go = _instruction_set_steps[_current_instruction];
-  _movement_type = _instruction_set_types[_current_instruction];
-  _movement_speed = _instruction_set_speeds[_current_instruction];
-  _acceleration_step_factor = _instruction_set_step_factors[_current_instruction]; // Factor to multiply the step counter with to get the correct acceleration length. Only needed when accelerating and decelerating.
+  const Instruction &instruction = instruction_pool.get(_current_instruction);
+  _substeps_to_go = instruction.steps;
+  _movement_type = instruction.type;
+  _movement_speed = instruction.speed;
+
+  if(_movement_type == ACCELERATE || _movement_type == DECELERATE) {
+    // Calculate the amount of steps relative to the acceleration curve (of 100 positions). Fraction is taken from the float, so positions are the same as with float calculations.
+    float curve_steps = 100/float(_substeps_to_go);
+    _curve_steps = uint8_t(curve_steps);
+    _curve_step_fraction = uint32_t((curve_steps - uint8_t(curve_steps)) * 4294967296.0);
+  }
+
+  if(_movement_type == DECELERATE) {
+    // Curve is followed backwards, start at _substeps_to_go curve steps
+    uint64_t fraction = uint64_t(_substeps_to_go) * _curve_step_fraction;
+    _curve_position = _substeps_to_go * _curve_steps + uint8_t(fraction >> 32);
+    _curve_fraction = uint32_t(fraction);
+  }
+  else {
+    _curve_position = 0;
+    _curve_fraction = 0;
+  }
+
+  if(_movement_type == S_CURVE) start_s_curve();
+  if(_movement_type == RAMP) start_ramp(previous_interval);
 
   calculate_step_interval(); // Calculate first step interval
-  _current_instruction++;
+  _current_instruction = instruction.next;
 }
 
 void Clockhand::calculate_step_interval() {
-    
-  if(_substeps_to_go == 0) { // Get next instruction because all substeps of this instructions have been taken.
-    get_next_instruction();
-    if(hand_finished) return; // This hand is finished, do not return a step interval.
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_STEP_INTERVAL);
+#endif
+  (this->*_interval_functions[int(_movement_type)])();
+
+  if(_step_interval < _minimum_step_interval) _step_interval = _minimum_step_interval; // To be safe
+}
+
+uint8_t Clockhand::curve_index() {
+  uint8_t position = _curve_position;
+
+  // Float multiplication rounded its result to 24 bits, so a fraction less than half a float step below the next whole position was rounded up to it.
+  // Half a float step is the power of two above the position times 2^-24, which is 2^7 in the 32 bit fraction.
+  if(_curve_fraction != 0 && uint32_t(0 - _curve_fraction) <= power_of_two_above(position) << 7) position++;
+
+  if(position > 99) position = 99;
+  return position;
+}
+
+unsigned int Clockhand::curve_position_interval() {
+  if(_curve_steps != 0) return acceleration_curve_interval(curve_index());
+
+  // Less than one curve position per step, take the part of the way to the next interval by the upper 16 bits of the fraction
+  if(_curve_position >= ACCELERATION_CURVE_LENGTH - 1) return acceleration_curve_interval(ACCELERATION_CURVE_LENGTH - 1);
+  unsigned int interval = acceleration_curve_interval(_curve_position);
+  unsigned int difference = interval - acceleration_curve_interval(_curve_position + 1);
+  return interval - (unsigned int)(((unsigned long)difference * (_curve_fraction >> 16)) >> 16);
+}
+
+unsigned long Clockhand::scale_interval(unsigned long interval, unsigned long factor) {
+  // Multiply word by word, so every partial product fits in 32 bits
+  unsigned long high = interval >> 16;
+  unsigned long low = interval & 0xFFFF;
+  return interval * (factor >> 16) + high * (factor & 0xFFFF) + ((low * (factor & 0xFFFF)) >> 16);
+}
+
+unsigned long Clockhand::scaled_curve_interval() {
+  // Default curve is scaled with the speed factor of this hand, so it ends at the speed of the instruction. Hands had a copy of the curve with the
+  // float products in whole micro seconds, the same product is worked out on the mantissa of the factor. It is 48 bits: a high word and 16 low bits.
+  unsigned long interval = curve_position_interval();
+  unsigned long low = interval * (_curve_mantissa & 0xFFFF);
+  unsigned long high = interval * (_curve_mantissa >> 16) + (low >> 16);
+  low &= 0xFFFF;
+  uint8_t shift = _curve_shift - 16;
+  unsigned long scaled = high >> shift;
+  unsigned long remainder = (high & ((1UL << shift) - 1)) << 16 | low;
+  if(remainder == 0) return scaled;
+
+  // Float rounded the product to 24 bits, so a product less than half a float step below the next whole micro second became it. Half a float step
+  // is the power of two above scaled times 2^-25, which is 2^(_curve_shift-25) times it in units of the remainder.
+  unsigned long below = (1UL << _curve_shift) - remainder;
+  unsigned long power = power_of_two_above(scaled);
+  if(_curve_shift <= 25 ? below << (25 - _curve_shift) <= power : below <= power << (_curve_shift - 25)) scaled++;
+  return scaled;
+}
+
+void Clockhand::set_curve_factor(float factor) {
+  // factor is mantissa * 2^(exponent-24), factors from 1/256 up to 256 keep the shift between 16 and 31
+  int exponent;
+  float mantissa = frexp(factor, &exponent);
+  if(!(factor > 0) || exponent < -7) { // Curve of intervals below a micro second, the minimum step interval applies
+    _curve_mantissa = 0;
+    _curve_shift = 16;
+  }
+  else if(exponent > 8) {
+    _curve_mantissa = 0xFFFFFF;
+    _curve_shift = 16;
+  }
+  else {
+    _curve_mantissa = (unsigned long)ldexp(mantissa, 24);
+    _curve_shift = 24 - exponent;
+  }
+}
+
+void Clockhand::accelerate_interval() {
+  // Curve has length of 100 steps, but hand will mostly accelerate in different amount of steps, so the position is scaled by the steps of this instruction.
+  _step_interval = scaled_curve_interval();
+}
+
+void Clockhand::cruise_interval() {
+  _step_interval = _movement_speed+4; // Time moving at given speed + correction for not having to perform calculations
+}
+
+void Clockhand::decelerate_interval() {
+  // Curve has length of 100 steps, but hand will mostly decelerate in different amount of steps, so the position is scaled by the steps of this instruction.
+  // Since acceleration curve was calculated for a different end speed, multiply the step interval with a factor of relative speeds.
+  _step_interval = scale_interval(scaled_curve_interval(), _decel_speed_factor);
+}
+
+void Clockhand::delay_interval() {
+  _step_interval = _movement_speed; // Delay the time one step takes
+}
+
+void Clockhand::switch_direction_interval() {
+  _step_interval = 0; // Direction is switched with the next instruction
+}
+
+void Clockhand::s_curve_interval() {
+  // The first and the last steps follow the position from rest, in between the recurrence of advance_s_curve() gives the interval
+  uint8_t start_step;
+  if(_s_curve_phase < S_CURVE_CRUISE && _substeps_taken < S_CURVE_START_STEPS) start_step = _substeps_taken;
+  else if(_s_curve_phase > S_CURVE_CRUISE && _substeps_to_go < S_CURVE_START_STEPS) start_step = _substeps_to_go; // Mirrored, the hand stops at the last step like it starts at the first
+  else {
+    _step_interval = _s_curve_interval >> 8;
+    return;
+  }
+
+  if(start_step == 0) _step_interval = _s_curve_start_interval >> 8;
+  else _step_interval = scale_interval(_s_curve_start_interval, pgm_read_word(&s_curve_start_steps[start_step-1])) >> 8;
+}
+
+void Clockhand::ramp_interval() {
+  _step_interval = scale_interval(curve_position_interval(), _ramp_speed_factor);
+}
+
+void Clockhand::start_ramp(unsigned long from_interval) {
+  // Speed squared grows about linearly along the curve, so a speed that is a part of the end speed is at that part squared of the curve
+  unsigned long to_interval = _movement_speed;
+  _ramp_down = to_interval > from_interval;
+  float fast = _ramp_down ? from_interval : to_interval;
+  float slow = _ramp_down ? to_interval : from_interval;
+  float slow_position = ACCELERATION_CURVE_LENGTH * (fast / slow) * (fast / slow);
+  _ramp_speed_factor = fixed_point_factor(fast / acceleration_curve_end_interval);
+
+  float curve_steps = (ACCELERATION_CURVE_LENGTH - slow_position) / _substeps_to_go;
+  _curve_steps = uint8_t(curve_steps);
+  _curve_step_fraction = uint32_t((curve_steps - uint8_t(curve_steps)) * 4294967296.0);
+
+  // Speeding up goes forward from the slow position, slowing down goes backward to it
+  float position = _ramp_down ? slow_position + curve_steps * _substeps_to_go : slow_position;
+  _curve_position = uint8_t(position);
+  _curve_fraction = uint32_t((position - uint8_t(position)) * 4294967296.0);
+}
+
+void Clockhand::start_s_curve() {
+  // Limits are converted once per instruction, like the curve steps of ACCELERATE and DECELERATE
+  float jerk = _s_curve_jerk;
+  float peak_velocity = 1000000.0 / _movement_speed;
+  float acceleration_limit = _s_curve_acceleration_limit - _s_curve_acceleration_limit / float(S_CURVE_ACCELERATION_HEADROOM);
+  float peak_acceleration = sqrt(peak_velocity * jerk); // Short moves reach their peak velocity before the acceleration limit
+  if(peak_acceleration > acceleration_limit) peak_acceleration = acceleration_limit;
+  float ramp_velocity = peak_acceleration * peak_acceleration / (2 * jerk); // Velocity gained while acceleration ramps between zero and its peak
+
+  // State after the start steps, the recurrence goes on from there. The start steps follow less jerk if the full jerk would pass the peak
+  // acceleration before they are done, acceleration after them is then at its peak.
+  float start_cube_root = cbrt(float(S_CURVE_START_STEPS));
+  float start_jerk = jerk;
+  if(jerk * cbrt(6 / jerk) * start_cube_root > peak_acceleration) start_jerk = pow(peak_acceleration / (cbrt(6.0) * start_cube_root), 1.5);
+  float start_time = cbrt(6 / start_jerk); // Time of the first step, position is jerk*t^3/6 from rest
+  float time = start_time * start_cube_root;
+  float velocity = start_jerk * time * time / 2;
+  float acceleration = start_jerk * time;
+  if(acceleration > peak_acceleration) acceleration = peak_acceleration;
+
+  _s_curve_accel_steps = 0;
+  _s_curve_ramp_steps = 0;
+  _s_curve_acceleration = (unsigned long)(acceleration * s_curve_acceleration_unit);
+  _s_curve_peak_acceleration = (unsigned long)(peak_acceleration * s_curve_acceleration_unit);
+  _s_curve_jerk_factor = (unsigned long)(jerk * s_curve_jerk_unit);
+  _s_curve_start_interval = (unsigned long)(start_time * 256000000.0);
+  _s_curve_peak_interval = (unsigned long)_movement_speed << 8; // Exactly the interval of the instruction, the float quotient can round below it
+  _s_curve_ramp_interval = (unsigned long)(256000000.0 / (peak_velocity - ramp_velocity));
+  _s_curve_max_interval = (unsigned long)(256000000.0 / velocity);
+  _s_curve_interval = _s_curve_max_interval;
+  _s_curve_phase = start_jerk < jerk ? S_CURVE_ACCELERATE : S_CURVE_JERK_UP; // Acceleration ramped up in the start steps
+
+  if(_substeps_to_go < 2*S_CURVE_START_STEPS || _s_curve_interval <= _s_curve_peak_interval) { // Too short for a curve, run at the peak velocity
+    _s_curve_interval = _s_curve_peak_interval;
+    _s_curve_phase = S_CURVE_CRUISE;
   }
+}
+
+void Clockhand::advance_s_curve() {
+  // Over one step v^2 changes by 2a, with v the velocity, c = 1/v the interval and a the mean acceleration during the step. With x = a*c^2
+  // the next interval is c/sqrt(1+2x) = c*(1-x+1.5x^2) when speeding up and c*(1+x+1.5x^2) when slowing down, so slowing down mirrors speeding up.
+  unsigned long interval = _s_curve_interval >> 8;
 
-  if(_movement_type == DELAY) {
-    _step_interval = _movement_speed; // Delay the time one step takes
+  if(_s_curve_phase < S_CURVE_DECEL_JERK_UP && _substeps_to_go <= _s_curve_accel_steps) {
+    // Slow down over as many steps as speeding up took. A short move gets here before it cruised, then the acceleration it had is turned around.
+    _s_curve_phase = S_CURVE_DECEL_JERK_UP;
   }
-  else if(_movement_type == SWITCH_DIRECTION) {
-    _step_interval = 0; // Delay the time one step takes
+  if(_s_curve_phase == S_CURVE_CRUISE) return;
+  if(_substeps_taken <= S_CURVE_START_STEPS) { // Start steps are timed by s_curve_interval(), the recurrence starts after them
+    _s_curve_accel_steps++;
+    if(_s_curve_phase == S_CURVE_JERK_UP) _s_curve_ramp_steps++; // Start steps that reach the peak acceleration ramp down in the last steps
+    return;
   }
-  else if(_movement_type == CRUISE) {
-    _step_interval = _movement_speed+4; // Time moving at given speed + correction for not having to perform calculations
+
+  // Acceleration ramps up to its peak, stays there and ramps down to zero, both when speeding up and when slowing down
+  unsigned long previous_acceleration = _s_curve_acceleration;
+  unsigned long acceleration_change = scale_interval(interval, _s_curve_jerk_factor);
+  if(_s_curve_phase == S_CURVE_JERK_DOWN || _s_curve_phase == S_CURVE_DECEL_JERK_DOWN) {
+    _s_curve_acceleration -= acceleration_change < _s_curve_acceleration ? acceleration_change : _s_curve_acceleration;
   }
-  else if (_movement_type == ACCELERATE) {
-    // Correct the acceleration duration by _acceleration_step_factor. Curve has length of 100 steps, but hand will mostly accelerate in different amount of steps.
-    int accel_curve_position = _substeps_taken*_acceleration_step_factor;
-    if(accel_curve_position > 99) accel_curve_position = 99;
-    _step_interval = _acceleration_curve[accel_curve_position];
+  else if(_s_curve_peak_acceleration - _s_curve_acceleration > acceleration_change) _s_curve_acceleration += acceleration_change;
+  else _s_curve_acceleration = _s_curve_peak_acceleration;
 
+  unsigned long velocity_change = scale_interval(_s_curve_interval, (previous_acceleration + _s_curve_acceleration) / 2); // Steps/s in 16.16 fixed point
+  unsigned long relative_factor = scale_interval(velocity_change, s_curve_relative_factor);
+  unsigned long relative_change = scale_interval(interval, relative_factor) + (scale_interval(_s_curve_interval & 0xFF, relative_factor) >> 8); // x in 0.24 fixed point, x is small so 0.16 would round away the jerk phases. The fraction of the interval is kept, else speeding up and slowing down would not mirror.
+  unsigned long first_order = scale_interval(_s_curve_interval, relative_change); // In 1/65536 us, rounded once when added so the second order is not lost
+  unsigned long second_order = scale_interval(first_order >> 8, relative_change);
+
+  if(_s_curve_phase < S_CURVE_CRUISE) {
+    _s_curve_accel_steps++;
+    if(_s_curve_phase == S_CURVE_JERK_UP) _s_curve_ramp_steps++;
+    _s_curve_interval -= (first_order - second_order - second_order / 2 + 128) >> 8;
+    if(_s_curve_phase == S_CURVE_JERK_UP && _s_curve_acceleration == _s_curve_peak_acceleration) _s_curve_phase = S_CURVE_ACCELERATE;
+    if(_s_curve_interval <= _s_curve_ramp_interval) _s_curve_phase = S_CURVE_JERK_DOWN;
+    if(_s_curve_phase == S_CURVE_JERK_DOWN && (_s_curve_acceleration == 0 || _s_curve_interval <= _s_curve_peak_interval)) {
+      _s_curve_interval = _s_curve_peak_interval;
+      _s_curve_phase = S_CURVE_CRUISE; // Acceleration that is left is where slowing down starts, so it mirrors the ramp that was cut short
+    }
   }
-  else if (_movement_type == DECELERATE) {
-    // Correct the acceleration duration by _acceleration_step_factor. Curve has length of 100 steps, but hand will mostly decelerate in different amount of steps.
-    int accel_curve_position = _substeps_to_go*_acceleration_step_factor;
-    if(accel_curve_position > 99) accel_curve_position = 99; 
-    _step_interval = _acceleration_curve[accel_curve_position];
-    _step_interval = _step_interval * _accel_vs_decel_speed_factor; // Since acceleration curve was calculated for a different end speed, multiply the step interval with a factor of relative speeds
+  else {
+    _s_curve_interval += (first_order + second_order + second_order / 2 + 128) >> 8;
+    if(_s_curve_interval > _s_curve_max_interval) _s_curve_interval = _s_curve_max_interval;
+    if(_s_curve_phase == S_CURVE_DECEL_JERK_UP && _s_curve_acceleration == _s_curve_peak_acceleration) _s_curve_phase = S_CURVE_DECELERATE;
+    if(_substeps_to_go <= _s_curve_ramp_steps) _s_curve_phase = S_CURVE_DECEL_JERK_DOWN; // By position, so rounding of the velocity does not stop the ramp early
   }
+}
 
-  if(_step_interval < _minimum_step_interval) _step_interval = _minimum_step_interval; // To be safe
+unsigned int Clockhand::trapezoid_speed(unsigned int steps, unsigned int max_speed, unsigned int acceleration) {
+  // Speeding up to v takes v^2/2a steps, a hand with too few steps for twice that turns around halfway
+  float speed = sqrt(float(steps) * acceleration);
+  if(speed > max_speed) speed = max_speed;
+  if(speed < 31) speed = 31; // Interval of a lower speed does not fit in an instruction
+  return (unsigned int)speed;
 }
 
-void Clockhand::run_hand() {
- 
-  if((!hand_finished) && (((micros() - _last_step_time) >= _step_interval))) {
-    
-    _last_step_time = micros();
-    
-    if(_movement_type != DELAY) {
-      // Take the acutal step
-      digitalWrite(_step_pin, HIGH);
-      delayMicroseconds(1);
-      digitalWrite(_step_pin, LOW);
+unsigned long Clockhand::curve_duration(unsigned int steps, float factor) {
+  // Step i is at curve position 100*i/steps, so count the steps per position. A short curve skips positions, which the mean of the curve
+  // (acceleration_curve_time_factor) does not know about. A stretched curve is interpolated, its steps at a position are on the way to the next
+  // interval by their fraction: 100*i/steps less the position, which adds up over the steps in one go.
+  unsigned long duration = 0;
+  unsigned long first_step = 0; // First step at this position
+  for(uint8_t position=0; position<ACCELERATION_CURVE_LENGTH; position++) {
+    unsigned long next_step = ((unsigned long)(position + 1) * steps + ACCELERATION_CURVE_LENGTH - 1) / ACCELERATION_CURVE_LENGTH;
+    unsigned long count = next_step - first_step;
+    if(count > 0 && steps > ACCELERATION_CURVE_LENGTH && position < ACCELERATION_CURVE_LENGTH - 1) {
+      float fractions = float(ACCELERATION_CURVE_LENGTH) * (first_step + next_step - 1) * count / (2.0 * steps) - float(position) * count;
+      float difference = acceleration_curve_interval(position) - acceleration_curve_interval(position + 1);
+      // Both the interpolated interval and its product are whole micro seconds, rounded up half of one and down half of the other on average
+      duration += (unsigned long)((count * float(acceleration_curve_interval(position)) - difference * fractions) * factor + count * (factor - 1) / 2);
     }
+    else if(count > 0) duration += count * (unsigned long)(acceleration_curve_interval(position) * factor); // Like scaled_curve_interval()
+    first_step = next_step;
+  }
+  return duration;
+}
 
-    _substeps_to_go--;
-    _substeps_taken++;
-    
-    calculate_step_interval(); // Calculate step interval to next step
-    
+unsigned long Clockhand::trapezoid_duration(unsigned int steps, unsigned int max_speed, unsigned int acceleration, unsigned long &first_interval) {
+  // Steps at the peak speed, plus the curves up to it and down from it. Slowing down takes the curve positions one step later than speeding up.
+  float speed = trapezoid_speed(steps, max_speed, acceleration);
+  int interval = int(1000000 / speed);
+  unsigned int accel_steps = (unsigned int)(speed * speed / (2.0 * acceleration));
+  if(2 * accel_steps > steps) accel_steps = steps / 2;
+  unsigned long duration = (unsigned long)(steps - 2 * accel_steps) * (interval + 4); // See cruise_interval()
+  first_interval = interval + 4;
+  if(accel_steps > 0) {
+    float factor = interval / float(acceleration_curve_end_interval);
+    first_interval = (unsigned long)(acceleration_curve_interval(0) * factor);
+    duration += 2 * curve_duration(accel_steps, factor) - first_interval + (unsigned long)(acceleration_curve_interval(ACCELERATION_CURVE_LENGTH - 1) * factor);
+  }
+  return duration - first_interval;
+}
+
+void Clockhand::set_trapezoid(unsigned int steps, unsigned int max_speed, unsigned int acceleration) {
+  float speed = trapezoid_speed(steps, max_speed, acceleration);
+  int interval = int(1000000 / speed);
+  unsigned int accel_steps = (unsigned int)(speed * speed / (2.0 * acceleration));
+  if(2 * accel_steps > steps) accel_steps = steps / 2;
+
+  // The curve of an instruction is stretched over its steps, so accel_steps from rest to speed is the acceleration of the limit
+  _acceleration_speed_factor = interval / float(acceleration_curve_end_interval);
+  _accel_vs_decel_speed_factor = 1;
+  _accel_speed = interval;
+  if(accel_steps > 0) set_instruction(ACCELERATE, accel_steps, interval);
+  if(steps > 2 * accel_steps) set_instruction(CRUISE, steps - 2 * accel_steps, interval);
+  if(accel_steps > 0) set_instruction(DECELERATE, accel_steps, interval);
+}
+
+void Clockhand::set_delay(unsigned long duration) {
+  // Short steps, a delay is waited in one go anyway. Steps of an instruction are an int.
+  unsigned long interval = duration / 32767 + 1;
+  if(interval < _minimum_step_interval) interval = _minimum_step_interval;
+  unsigned long steps = duration / interval;
+  if(_current_instruction == NO_INSTRUCTION) steps++; // First step of an animation is taken right away
+  if(steps > 0) set_instruction(DELAY, steps, interval);
+}
+
+unsigned int Clockhand::s_curve_speed(unsigned int steps, unsigned int max_speed, unsigned int acceleration, unsigned long jerk) {
+  // Speeding up from rest to a speed takes speed/acceleration + acceleration/jerk seconds, or 2*sqrt(speed/jerk) if the acceleration limit is not reached.
+  // The curve is symmetric in time, so the average speed is half the end speed. Bisect for the speed at which speeding up takes half of the steps.
+  float low = 31; // Interval of a lower speed does not fit in an instruction
+  float high = max_speed;
+  float acceleration_limit = acceleration - acceleration / float(S_CURVE_ACCELERATION_HEADROOM); // As start_s_curve() plans it
+  for(uint8_t i=0; i<16; i++) {
+    float speed = i == 0 ? high : (low + high) / 2;
+    float time;
+    if(speed * jerk >= acceleration_limit * acceleration_limit) time = speed / acceleration_limit + acceleration_limit / jerk;
+    else time = 2 * sqrt(speed / jerk);
+
+    bool fits = speed / 2 * time <= steps / 2.0;
+    if(fits && i == 0) return max_speed;
+    if(fits) low = speed;
+    else high = speed;
+  }
+  return (unsigned int)low;
+}
+
+unsigned long Clockhand::fixed_point_factor(float factor) {
+  if(factor >= 65535) return 0xFFFFFFFF;
+  if(factor <= 0) return 0;
+  return (unsigned long)(factor * 65536.0 + 0.5);
+}
+
+void Clockhand::start_movement() {
+  _direction_changed = false;
+  // Planners set the float factors, convert them once so stepping does not need float calculations
+  set_curve_factor(_acceleration_speed_factor);
+  _decel_speed_factor = fixed_point_factor(_accel_vs_decel_speed_factor);
+  get_next_instruction(); // Get first instruction
+  _start_of_movement = true; // Take the first step directly at the start of the animation
+}
+
+bool Clockhand::next_steps(unsigned long &interval, byte &flags, unsigned int &count) {
+  if(hand_finished) return false;
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_NEXT_STEPS);
+#endif
+
+  interval = _step_interval;
+  flags = 0;
+  count = 1;
+  bool single_step = false;
+  if(_movement_type != DELAY) flags |= Stepscheduler::STEP_PULSE; // Take an actual step
+
+  if(_start_of_movement) {
+    interval = 0; // First step is taken directly, steps after it have the interval of the instruction
+    single_step = true;
+    _start_of_movement = false;
+  }
+
+  if(_direction_changed) {
+    flags |= Stepscheduler::STEP_SET_DIRECTION;
+    if(_inverted != direction) flags |= Stepscheduler::STEP_DIRECTION_HIGH;
+    single_step = true;
+    _direction_changed = false;
+  }
+
+  if(!single_step && (_movement_type == CRUISE || _movement_type == DELAY)) {
+    count = _substeps_to_go; // Interval is the same for all steps of this instruction, so take them as one run
+  }
+
+  _substeps_to_go -= count;
+  _substeps_taken += count;
+
+  if(_substeps_to_go == 0) {
+    get_next_instruction(); // All substeps of this instruction have been taken, this also calculates the step interval.
+    return true;
+  }
+
+  // Follow the acceleration curve, forward when accelerating and backward when decelerating
+  if(_movement_type == DECELERATE || (_movement_type == RAMP && _ramp_down)) {
+    if(_curve_fraction < _curve_step_fraction) _curve_position--; // Borrow
+    _curve_fraction -= _curve_step_fraction;
+    _curve_position -= _curve_steps;
+  }
+  else if(_movement_type == ACCELERATE || _movement_type == RAMP) {
+    _curve_fraction += _curve_step_fraction;
+    if(_curve_fraction < _curve_step_fraction) _curve_position++; // Carry
+    _curve_position += _curve_steps;
+  }
+  else if(_movement_type == S_CURVE) advance_s_curve();
+
+  calculate_step_interval(); // Calculate step interval to next step
+  return true;
+}
+
+float Clockhand::junction_speed(uint8_t type, int speed) {
+  if(type == ACCELERATE) return 1000000.0 / (acceleration_curve_end_interval * _acceleration_speed_factor);
+  if(type == DECELERATE) return 1000000.0 / (acceleration_curve_end_interval * _acceleration_speed_factor * _accel_vs_decel_speed_factor);
+  return 1000000.0 / speed;
+}
+
+void Clockhand::blend_junctions() {
+  // Ramps accelerate no harder than the hand already does, so planners that do not follow the curve (e.g. only cruise) keep their jumps
+  float peak_acceleration = 0;
+  for(uint8_t index=_current_instruction; index!=NO_INSTRUCTION; index=instruction_pool.next(index)) {
+    const Instruction &instruction = instruction_pool.get(index);
+    if(instruction.type != ACCELERATE && instruction.type != DECELERATE) continue;
+    float speed = junction_speed(instruction.type, instruction.speed);
+    float acceleration = speed * speed / (2 * instruction.steps);
+    if(acceleration > peak_acceleration) peak_acceleration = acceleration;
   }
+  if(peak_acceleration == 0) return;
+
+  uint8_t previous = NO_INSTRUCTION;
+  uint8_t current = _current_instruction;
+  while(current != NO_INSTRUCTION && instruction_pool.next(current) != NO_INSTRUCTION) {
+    uint8_t next = instruction_pool.next(current);
+    Instruction before = instruction_pool.get(current);
+    Instruction after = instruction_pool.get(next);
+    float from = junction_speed(before.type, before.speed);
+    float to = junction_speed(after.type, after.speed);
+    uint8_t type_before = previous == NO_INSTRUCTION ? (uint8_t)DELAY : instruction_pool.get(previous).type;
+    bool moving_before = type_before == ACCELERATE || type_before == CRUISE || type_before == RAMP; // A ramp starts at the interval of the step before it
+
+    if(!(from > 0) || !(to > 0)) {
+      // Speed factor of a curve was not set (e.g. a deceleration without acceleration before it), leave the join as planned
+    }
+    else if(before.type == DECELERATE && after.type == ACCELERATE && moving_before) {
+      // Hand stops and speeds up again in the same direction. Go on at the slower of the two speeds and ramp to or from it at the curve of
+      // the instruction that is taken out, so the ramp is as steep as that curve.
+      if(from >= to) {
+        unsigned int ramp_steps = (unsigned int)(before.steps * (1 - (to / from) * (to / from)));
+        int interval = int(1000000.0 / to);
+        if(ramp_steps > 0 && ramp_steps < before.steps) {
+          if(instruction_pool.insert(current, CRUISE, before.steps - ramp_steps, interval) == NO_INSTRUCTION) break;
+          instruction_pool.set(current, RAMP, ramp_steps, interval);
+        }
+        else instruction_pool.set(current, CRUISE, before.steps, interval);
+        instruction_pool.set(next, CRUISE, after.steps, interval);
+      }
+      else {
+        unsigned int ramp_steps = (unsigned int)(after.steps * (1 - (from / to) * (from / to)));
+        int interval = int(1000000.0 / from);
+        if(ramp_steps > 0 && ramp_steps < after.steps) {
+          if(instruction_pool.insert(next, RAMP, ramp_steps, int(1000000.0 / to)) == NO_INSTRUCTION) break; // Before any rewrite, so a full pool leaves the join as planned
+          instruction_pool.set(current, CRUISE, before.steps, interval);
+          instruction_pool.set(next, CRUISE, after.steps - ramp_steps, interval);
+          if(next == _last_instruction) _last_instruction = instruction_pool.next(next);
+        }
+        else {
+          instruction_pool.set(current, CRUISE, before.steps, interval);
+          instruction_pool.set(next, CRUISE, after.steps, interval);
+        }
+      }
+    }
+    else if((before.type == ACCELERATE || before.type == CRUISE) && (after.type == CRUISE || after.type == DECELERATE) && (before.type == CRUISE || after.type == CRUISE)) {
+      // Speed jumps at the join. The ramp only takes steps from a cruise on the slower side, those steps speed up and the faster ones keep
+      // their speed, so the hand arrives earlier than with the jump. Ramping steps of the faster side would slow them down. A cruise with
+      // fewer steps than the ramp keeps its jump, a steeper ramp would pass the peak acceleration and a longer one the faster side.
+      float ramp_steps = fabs(from * from - to * to) / (2 * peak_acceleration);
+      unsigned int steps_before = before.type == CRUISE && from < to && ramp_steps < before.steps ? (unsigned int)ramp_steps : 0;
+      unsigned int steps_after = after.type == CRUISE && to < from && ramp_steps < after.steps ? (unsigned int)ramp_steps : 0;
+
+      if(steps_before + steps_after >= 2) {
+        if(instruction_pool.insert(current, RAMP, steps_before + steps_after, after.type == CRUISE ? after.speed : int(1000000.0 / to)) == NO_INSTRUCTION) break;
+        instruction_pool.set(current, before.type, before.steps - steps_before, before.speed);
+        instruction_pool.set(next, after.type, after.steps - steps_after, after.speed);
+      }
+    }
+
+    previous = current;
+    current = instruction_pool.next(current);
+  }
+}
+
+unsigned long Clockhand::planned_duration(unsigned long &steps) {
+  // Compile the instructions on a copy, so the result is exactly what the step scheduler will get
+  Clockhand hand = *this;
+  unsigned long duration = 0;
+  unsigned long interval;
+  byte flags;
+  unsigned int count;
+
+  steps = 0;
+  hand.start_movement();
+  while(hand.next_steps(interval, flags, count)) {
+    duration += interval*count;
+    if(flags & Stepscheduler::STEP_PULSE) steps += count;
+  }
+  return duration;
+}
+
+unsigned long Clockhand::predicted_duration() {
+  float duration = 0;
+  float exit_interval = 0; // Interval at the end of the instruction before, where a RAMP starts
+  for(uint8_t index=_current_instruction; index!=NO_INSTRUCTION; index=instruction_pool.next(index)) {
+    const Instruction &instruction = instruction_pool.get(index);
+    float interval = instruction.speed;
+    float curve_end = acceleration_curve_end_interval * _acceleration_speed_factor;
+    float time_factor = instruction.steps > ACCELERATION_CURVE_LENGTH ? acceleration_curve_stretched_time_factor : acceleration_curve_time_factor;
+
+    switch(instruction.type) {
+      case ACCELERATE: // Curve is stretched over the steps, so its mean interval is a fixed part of its end interval
+        duration += instruction.steps * curve_end * time_factor;
+        exit_interval = curve_end;
+        break;
+      case DECELERATE:
+        duration += instruction.steps * curve_end * _accel_vs_decel_speed_factor * time_factor;
+        exit_interval = 0;
+        break;
+      case CRUISE:
+        duration += instruction.steps * (interval + 4); // See cruise_interval()
+        exit_interval = interval;
+        break;
+      case DELAY:
+        duration += instruction.steps * interval;
+        break;
+      case SWITCH_DIRECTION: // One step at the shortest interval, get_next_instruction() then goes on after the instruction that follows it
+        duration += _minimum_step_interval;
+        index = instruction_pool.next(index);
+        if(index == NO_INSTRUCTION) return (unsigned long)duration;
+        break;
+      case RAMP: { // About constant acceleration, so the mean speed is halfway both ends
+        float from = exit_interval > 0 ? exit_interval : interval;
+        duration += 2 * instruction.steps * from * interval / (from + interval);
+        exit_interval = interval;
+        break;
+      }
+      case S_CURVE: {
+        // Speeding up and slowing down both take speed/acceleration + acceleration/jerk seconds at half the peak speed, see s_curve_speed()
+        float speed = 1000000.0 / interval;
+        float acceleration = sqrt(speed * _s_curve_jerk);
+        if(acceleration > _s_curve_acceleration_limit) acceleration = _s_curve_acceleration_limit;
+        float time = speed / acceleration + acceleration / _s_curve_jerk;
+        float curve_steps = speed * time; // Both curves
+        if(curve_steps <= instruction.steps) duration += 2000000.0 * time + (instruction.steps - curve_steps) * interval;
+        else duration += 2000000.0 * time * sqrt(instruction.steps / curve_steps); // Peak speed is not reached
+        exit_interval = 0;
+        break;
+      }
+    }
+  }
+  return (unsigned long)duration;
+}
+
+float Clockhand::max_speedup(unsigned int max_speed) {
+  float shortest = 0; // Shortest interval of the instructions, at the end of an ACCELERATE and the start of a DECELERATE
+  for(uint8_t index=_current_instruction; index!=NO_INSTRUCTION; index=instruction_pool.next(index)) {
+    const Instruction &instruction = instruction_pool.get(index);
+    float interval;
+    if(instruction.type == ACCELERATE || instruction.type == DECELERATE) interval = 1000000.0 / junction_speed(instruction.type, instruction.speed);
+    else if(instruction.type == CRUISE || instruction.type == RAMP || instruction.type == S_CURVE) interval = instruction.speed;
+    else continue;
+    if(shortest == 0 || interval < shortest) shortest = interval;
+  }
+  float speedup = shortest * max_speed / 1000000.0;
+  return speedup > 1 ? speedup : 1;
+}
+
+void Clockhand::scale_speed(float factor) {
+  // Intervals are divided by the factor, acceleration grows with its square and jerk with its cube, so every curve keeps its shape in less time
+  for(uint8_t index=_current_instruction; index!=NO_INSTRUCTION; index=instruction_pool.next(index)) {
+    Instruction instruction = instruction_pool.get(index);
+    int interval = int(instruction.speed / factor); // Rounded down, so the scaled movement does not take longer than predicted
+    if(instruction.type == DELAY && interval < int(_minimum_step_interval)) { // Fewer steps instead, a delay step is not shorter than a real one
+      instruction_pool.set(index, DELAY, (unsigned int)(instruction.steps / factor), instruction.speed);
+    }
+    else if(instruction.type != SWITCH_DIRECTION) instruction_pool.set(index, instruction.type, instruction.steps, interval);
+  }
+
+  _acceleration_speed_factor /= factor;
+  _accel_speed = int(_accel_speed / factor + 0.5);
+  float acceleration = _s_curve_acceleration_limit * factor * factor;
+  _s_curve_acceleration_limit = acceleration < 65535 ? (unsigned int)acceleration : 65535;
+  _s_curve_jerk = (unsigned long)(_s_curve_jerk * factor * factor * factor);
 }
 
 void Clockhand::run_manually(int direction_type) {
@@ -192,9 +783,13 @@ void Clockhand::take_manual_step() {
   virtual_position = current_position;
 
   // Take the actual step
-  digitalWrite(_step_pin, HIGH);
-  delayMicroseconds(1);
-  digitalWrite(_step_pin, LOW);
+  uint8_t port_masks[NR_OF_PORTS];
+  memset(port_masks, 0, sizeof(port_masks));
+  port_masks[_step_port] = _step_mask;
+  uint8_t sreg = SREG;
+  cli();
+  pulse_outputs(port_masks);
+  SREG = sreg;
 }
 
 bool Clockhand::movement_finished() {
@@ -207,6 +802,54 @@ void Clockhand::force_finished() {
   clear_instructions();
 }
 
+void Clockhand::stop_movement(int steps_not_taken) {
+  // Steps of earlier instructions are in the current position already, those of the current instruction are added when it ends
+  long steps = _movement_type == DELAY ? 0 : _substeps_taken;
+  if(_direction_changed) steps += steps_not_taken; // Switch is not queued yet, so the steps that were went the other way
+  else steps -= steps_not_taken;
+
+  if(direction == CW) current_position += steps;
+  else current_position -= steps;
+  current_position = current_position % _steps_per_revolution;
+  while(current_position < 0) current_position += _steps_per_revolution;
+  clear_instructions();
+}
+
+void Clockhand::skip_movement() {
+  // Steps as get_next_instruction() takes them, an animation can set the virtual position while it plans
+  for(uint8_t index=_current_instruction; index!=NO_INSTRUCTION; index=instruction_pool.next(index)) {
+    const Instruction &instruction = instruction_pool.get(index);
+    if(instruction.type == DELAY) continue;
+    _substeps_taken = instruction.steps;
+    update_positions();
+    if(instruction.type == SWITCH_DIRECTION) direction = !direction; // The pin is written when the hand is put back
+  }
+  _substeps_taken = 0;
+}
+
+void Clockhand::save_plan_state(Hand_plan_state &state) {
+  state.position = current_position;
+  state.target_position = target_position;
+  state.direction = direction;
+  state.acceleration_speed_factor = _acceleration_speed_factor;
+  state.accel_vs_decel_speed_factor = _accel_vs_decel_speed_factor;
+  state.accel_speed = _accel_speed;
+  state.s_curve_acceleration_limit = _s_curve_acceleration_limit;
+  state.s_curve_jerk = _s_curve_jerk;
+}
+
+void Clockhand::restore_plan_state(const Hand_plan_state &state) {
+  current_position = state.position;
+  target_position = state.target_position;
+  set_direction(state.direction);
+  _acceleration_speed_factor = state.acceleration_speed_factor;
+  _accel_vs_decel_speed_factor = state.accel_vs_decel_speed_factor;
+  _accel_speed = state.accel_speed;
+  _s_curve_acceleration_limit = state.s_curve_acceleration_limit;
+  _s_curve_jerk = state.s_curve_jerk;
+  clear_instructions(); // Virtual position back to the current one
+}
+
 void Clockhand::update_positions() {
   // Update the current position and normalize between 0 and steps per revolution.
   if(direction == CW) current_position += _substeps_taken;
@@ -215,6 +858,12 @@ void Clockhand::update_positions() {
   while(current_position < 0) current_position += _steps_per_revolution;
 }
 
+void Clockhand::add_steps(unsigned int steps) {
+  _substeps_taken = steps;
+  update_positions();
+  _substeps_taken = 0;
+}
+
 byte Clockhand::step_pin() {
   return(_step_pin);
 }
@@ -3,6 +3,22 @@
 
 #include <Arduino.h>
 
+#define S_CURVE_START_STEPS 8 // First and last steps of an S-curve, timed from the position from rest instead of the recurrence
+#define S_CURVE_ACCELERATION_HEADROOM 64 // An S-curve plans 1/64 below its acceleration limit, whole micro second intervals change the speed by up to 1 %
+
+// What the planners read of a hand besides its instructions, to put it back after a movement was only predicted
+struct Hand_plan_state
+{
+    int position;
+    int target_position;
+    bool direction;
+    float acceleration_speed_factor;
+    float accel_vs_decel_speed_factor;
+    int accel_speed;
+    unsigned int s_curve_acceleration_limit;
+    unsigned long s_curve_jerk;
+};
+
 class Clockhand
 {
 private:
@@ -15,34 +31,74 @@ private:
         CRUISE = 1,
         DECELERATE = 2,
         DELAY = 3,
-        SWITCH_DIRECTION = 4
+        SWITCH_DIRECTION = 4,
+        S_CURVE = 5,
+        RAMP = 6, // From the speed of the instruction before to the speed of this one, only set by blend_junctions()
+        // Phases of an S-curve
+        S_CURVE_JERK_UP = 0, // Acceleration grows
+        S_CURVE_ACCELERATE = 1, // Acceleration at its peak
+        S_CURVE_JERK_DOWN = 2, // Acceleration shrinks to reach peak velocity with zero acceleration
+        S_CURVE_CRUISE = 3,
+        S_CURVE_DECEL_JERK_UP = 4,
+        S_CURVE_DECELERATE = 5,
+        S_CURVE_DECEL_JERK_DOWN = 6
     };
 
+    uint8_t _nr; // Number of the hand, for telemetry
     byte _step_pin;
     byte _dir_pin;
+    uint8_t _step_port; // Port and bit mask of the pins, to write them directly
+    uint8_t _step_mask;
+    uint8_t _dir_port;
+    uint8_t _dir_mask;
     bool _inverted;
     int _steps_per_revolution;
-    unsigned char _instruction_counter;
-    char _instruction_set_types[10]; // Type of movement (constand, accel, decel)
-    unsigned int _instruction_set_steps[10]; // Steps to take
-    int _instruction_set_speeds[10]; // Speed
-    float _instruction_set_step_factors[10];
+    uint8_t _last_instruction; // Instructions are a list in the instruction pool, new instructions are added after the last one
+    bool _instructions_dropped; // An instruction did not fit in the instruction pool
     char _movement_type;
     int _movement_speed;
-    float _acceleration_step_factor;
-    unsigned int *_acceleration_curve;
+    uint8_t _curve_steps; // Curve positions per step (100/steps) in 8.32 fixed point: whole part
+    uint32_t _curve_step_fraction; // and fraction
+    uint8_t _curve_position; // Position on the acceleration curve in 8.32 fixed point: whole part
+    uint32_t _curve_fraction; // and fraction
+    unsigned long _curve_mantissa; // _acceleration_speed_factor as its 24 bit float mantissa, shifted right by _curve_shift
+    uint8_t _curve_shift;
+    unsigned long _decel_speed_factor; // _accel_vs_decel_speed_factor in 16.16 fixed point
     unsigned long _step_interval;
     unsigned long _default_step_interval;
     unsigned long _minimum_step_interval; // Used for setting time
+
+    // State of an S-curve instruction. The step interval follows the acceleration with a recurrence of multiplications only, no division per step.
+    // Intervals are in micro seconds in 24.8 fixed point, acceleration in steps/s^2 scaled by 2^24/10^6 and jerk in acceleration per micro second in 16.16 fixed point.
+    uint8_t _s_curve_phase;
+    unsigned int _s_curve_accel_steps; // Steps taken while speeding up, slowing down starts when as many steps are left
+    unsigned int _s_curve_ramp_steps; // Steps taken while acceleration ramped up, deceleration ramps down when as many steps are left
+    unsigned long _s_curve_interval;
+    unsigned long _s_curve_acceleration;
+    unsigned long _s_curve_peak_acceleration;
+    unsigned long _s_curve_jerk_factor;
+    unsigned long _s_curve_peak_interval; // Interval at peak velocity
+    unsigned long _s_curve_ramp_interval; // Acceleration ramps down from this interval on, to reach peak velocity with zero acceleration
+    unsigned long _s_curve_max_interval; // Interval after the start steps, slowing down does not go slower
+    unsigned long _s_curve_start_interval; // Time of the first step from rest
+
+    // State of a RAMP instruction. It follows part of the acceleration curve, scaled so the end of the curve is at the faster of its two speeds.
+    unsigned long _ramp_speed_factor; // 16.16 fixed point
+    bool _ramp_down; // Slowing down, the curve is followed backwards
     
     uint8_t _steps_accelerating_to_max_speed;
-    uint8_t _current_instruction;
+    uint8_t _current_instruction; // Next instruction to get, index in the instruction pool
     unsigned long _last_step_time;
     unsigned int _substeps_to_go;
     unsigned int _substeps_taken;
+    bool _direction_changed; // Direction was switched by an instruction, write it to the driver with the next step
+    bool _start_of_movement; // Next step is the first step of the animation
 
 public:
-    Clockhand(int nr, byte step, byte dir, bool inverted, int steps_per_revolution, unsigned int *acceleration_curve);
+    Clockhand();
+
+    void begin(int nr, byte step, byte dir, bool inverted, int steps_per_revolution);
+    /* Sets the pins and the defaults of the hand. Hands are allocated statically in Clockception, so this runs from init() and not at construction. */
 
     void set_direction(bool direction);
     /* Sets direction of a hand, also to the stepper driver */
@@ -50,8 +106,14 @@ public:
     void clear_instructions();
     /* Clears memory of all variables assocciated with an animation to enable programming new animations. */
 
-    void set_instruction(int type, int steps, int speed);
-    /* Set the instructions for a (partial) animation */
+    bool set_instruction(int type, int steps, int speed);
+    /* Set the instructions for a (partial) animation. Returns false if the instruction pool is full. */
+
+    bool instructions_dropped();
+    /* Returns true if instructions were set that did not fit in the instruction pool, since the last clear */
+
+    uint8_t first_instruction();
+    /* Returns the index in the instruction pool of the first instruction that is set, NO_INSTRUCTION if there is none (e.g. for checks in sim/) */
 
     void get_next_instruction();
     /* Get the instructions for a (partial) animation */
@@ -59,8 +121,92 @@ public:
     void calculate_step_interval();
     /* Calculate the step interval, depending on the movement type */
 
-    void run_hand();
-    /* Take step if step interval is passed */
+    void start_s_curve();
+    /* Converts the limits of an S-curve instruction to fixed point and sets the state for the first step */
+
+    void advance_s_curve();
+    /* Integrates jerk, acceleration and velocity of an S-curve over the step that was just taken, and moves to the next phase when due */
+
+    void start_ramp(unsigned long from_interval);
+    /* Sets the part of the acceleration curve a RAMP instruction follows, from the step interval of the instruction before */
+
+    float junction_speed(uint8_t type, int speed);
+    /* Returns the speed in steps/s of a moving instruction where it joins another: an ACCELERATE at its end, a DECELERATE at its start */
+
+    void blend_junctions();
+    /* Looks ahead over the instructions that are set and rewrites the joins between movements in the same direction, so speed carries through them.
+    A stop between a DECELERATE and an ACCELERATE is taken out, a jump in speed becomes a RAMP at the peak acceleration of the hand where it can
+    take the steps of the slower side, so a hand never takes longer. */
+
+    uint8_t curve_index();
+    /* Returns the index in the acceleration curve of the current curve position */
+
+    unsigned int curve_position_interval();
+    /* Returns the interval of the default acceleration curve at the current curve position. A curve stretched over more steps than it has
+    intervals is interpolated between them, so its steps do not keep one interval and then jump to the next. */
+
+    unsigned long scaled_curve_interval();
+    /* Returns the interval of the acceleration curve at the current curve position, scaled for this hand */
+
+    void set_curve_factor(float factor);
+    /* Converts the speed factor of the acceleration curve for scaled_curve_interval() */
+
+    static unsigned long scale_interval(unsigned long interval, unsigned long factor);
+    /* Returns interval multiplied by a 16.16 fixed point factor */
+
+    static unsigned long fixed_point_factor(float factor);
+    /* Converts a speed factor to 16.16 fixed point */
+
+    static unsigned int trapezoid_speed(unsigned int steps, unsigned int max_speed, unsigned int acceleration);
+    /* Returns the peak speed in steps per second of the shortest movement of steps at the limits: max_speed, or lower if the hand has to slow down before it gets there */
+
+    static unsigned long curve_duration(unsigned int steps, float factor);
+    /* Returns the sum in micro seconds of the step intervals of an ACCELERATE of steps, for a curve speed factor */
+
+    static unsigned long trapezoid_duration(unsigned int steps, unsigned int max_speed, unsigned int acceleration, unsigned long &first_interval);
+    /* Returns the time in micro seconds from the first to the last step of the shortest movement of steps at the limits, and the interval before
+    its first step. The first step of an animation is taken right away, after a delay the hand waits first_interval for it. */
+
+    void set_trapezoid(unsigned int steps, unsigned int max_speed, unsigned int acceleration);
+    /* Sets the instructions of the shortest movement of steps at the limits: accelerate, cruise and decelerate, and the speed factors of their curves */
+
+    void set_delay(unsigned long duration);
+    /* Sets a delay of duration micro seconds, to the minimum step interval. A delay that starts the movement also takes the place of the first
+    step, which is taken right away, so the instruction after it waits its full interval. */
+
+    static unsigned int s_curve_speed(unsigned int steps, unsigned int max_speed, unsigned int acceleration, unsigned long jerk);
+    /* Returns the highest speed up to max_speed at which an S-curve of steps speeds up and slows down again, in steps per second */
+
+    // Step interval per movement type, called through _interval_functions
+    typedef void (Clockhand::*Interval_function)();
+    static const Interval_function _interval_functions[7];
+    void accelerate_interval();
+    void cruise_interval();
+    void decelerate_interval();
+    void delay_interval();
+    void switch_direction_interval();
+    void s_curve_interval();
+    void ramp_interval();
+
+    void start_movement();
+    /* Get the first instruction of an animation, the first step is taken directly */
+
+    bool next_steps(unsigned long &interval, byte &flags, unsigned int &count);
+    /* Compiles the next steps to be taken by the step scheduler: the interval since the previous step, the step flags and how many times this step is repeated.
+    Cruise and delay instructions are returned as one run of steps. Returns false if hand is finished. */
+
+    unsigned long planned_duration(unsigned long &steps);
+    /* Returns the duration in micro seconds of the instructions that are set, and the amount of steps taken. Does not change the hand. */
+
+    unsigned long predicted_duration();
+    /* Returns the duration in micro seconds of the instructions that are set, worked out per instruction instead of per step like planned_duration(),
+    so it is quick enough to check before every movement. Within a few percent of planned_duration(). */
+
+    float max_speedup(unsigned int max_speed);
+    /* Returns how much faster the instructions that are set can run before the hand moves faster than max_speed steps per second, at least 1 */
+
+    void scale_speed(float factor);
+    /* Makes the instructions that are set factor times as fast, curves and delays included, so the hand takes the same path in less time */
 
     bool movement_finished();
     /* Returns if this hand has finished all the steps */
@@ -68,9 +214,25 @@ public:
     void force_finished();
     /* Force hand to be finished */
 
+    void stop_movement(int steps_not_taken);
+    /* Finish the movement where the hand is, after the step scheduler stopped. Its position counts the steps it calculated less steps_not_taken, see
+    Stepscheduler::dropped_steps(). */
+
+    void skip_movement();
+    /* Puts the hand where its instructions end without taking the steps, for a movement that is only predicted. The instructions stay set. */
+
+    void save_plan_state(Hand_plan_state &state);
+    /* Copies position, target, direction and curves of the hand, what planning reads and changes */
+
+    void restore_plan_state(const Hand_plan_state &state);
+    /* Puts the hand back as it was saved with save_plan_state(), its direction pin included, and clears its instructions */
+
     void update_positions();
     /* Set current position to actual position and normalize between 0 and steps_per_revolution */
 
+    void add_steps(unsigned int steps);
+    /* Add steps that were taken outside the instructions of this hand (e.g. by the coordinator) to the current position */
+
     void run_manually(int direction_type);
     /* Step manually untill target is reached. Used when setting time and calibrating. Does not use the instruction functions. */
 
@@ -94,6 +256,8 @@ public:
     float _acceleration_speed_factor;
     float _accel_vs_decel_speed_factor;
     int _accel_speed;
+    unsigned int _s_curve_acceleration_limit; // Acceleration of S_CURVE instructions in steps/s^2, set by the planner
+    unsigned long _s_curve_jerk; // Jerk of S_CURVE instructions in steps/s^3, set by the planner
     unsigned int steps_to_take;
     bool hand_finished;
 
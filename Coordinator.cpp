@@ -0,0 +1,111 @@
+#include "Coordinator.h"
+#include "Clockhand.h"
+#include "Accelerationcurve.h"
+
+Coordinator coordinator;
+
+Coordinator::Coordinator() {
+  clear();
+}
+
+void Coordinator::clear() {
+  _master_steps = 0;
+  _accel_ticks = 0;
+  _decel_ticks = 0;
+  _cruise_interval = 0;
+  _curve_speed_factor = 65536;
+  _tick = 0;
+  for(uint8_t hand=0; hand<COORDINATOR_HANDS; hand++) {
+    _steps[hand] = 0;
+    _errors[hand] = 0;
+    _pending_intervals[hand] = 0;
+  }
+}
+
+void Coordinator::set_hand(uint8_t hand, unsigned int steps) {
+  _steps[hand] = steps;
+  if(steps > _master_steps) _master_steps = steps;
+}
+
+void Coordinator::set_profile(unsigned int cruise_interval, float accel_fraction, float decel_fraction) {
+  _cruise_interval = cruise_interval;
+  _accel_ticks = int(_master_steps*accel_fraction);
+  _decel_ticks = int(_master_steps*decel_fraction);
+  if(_accel_ticks + _decel_ticks > _master_steps) _decel_ticks = _master_steps - _accel_ticks;
+  _curve_speed_factor = Clockhand::fixed_point_factor(cruise_interval/float(acceleration_curve_end_interval)); // Same factor as the hands get when accelerating to this speed
+}
+
+unsigned int Coordinator::steps(uint8_t hand) {
+  return _steps[hand];
+}
+
+unsigned int Coordinator::queued_steps(uint8_t hand) {
+  if(_master_steps == 0) return 0;
+  return (unsigned long)_tick * _steps[hand] / _master_steps; // Bresenham accumulator steps the hand on every tick its share passes a whole step
+}
+
+unsigned long Coordinator::predicted_duration() {
+  float curve_end = acceleration_curve_end_interval * (_curve_speed_factor / 65536.0);
+  return (unsigned long)((_accel_ticks + _decel_ticks) * curve_end * acceleration_curve_time_factor + float(_master_steps - _accel_ticks - _decel_ticks) * _cruise_interval);
+}
+
+float Coordinator::max_speedup(unsigned int max_speed) {
+  float speedup = _cruise_interval * float(max_speed) / 1000000.0;
+  return speedup > 1 ? speedup : 1;
+}
+
+void Coordinator::scale_speed(float factor) {
+  _cruise_interval = (unsigned long)(_cruise_interval / factor + 0.5);
+  _curve_speed_factor = (unsigned long)(_curve_speed_factor / factor + 0.5);
+}
+
+void Coordinator::start() {
+  _tick = 0;
+  for(uint8_t hand=0; hand<COORDINATOR_HANDS; hand++) {
+    _errors[hand] = 0;
+    _pending_intervals[hand] = 0;
+  }
+}
+
+bool Coordinator::finished() {
+  return _tick >= _master_steps;
+}
+
+unsigned long Coordinator::tick_interval(unsigned int tick) {
+  if(tick == 0) return 0; // First tick is taken directly at the start of the animation
+
+  unsigned long index;
+  if(tick < _accel_ticks) index = (unsigned long)tick*ACCELERATION_CURVE_LENGTH/_accel_ticks; // Forward through the curve
+  else if(tick >= _master_steps - _decel_ticks) index = ((unsigned long)(_master_steps - tick)*ACCELERATION_CURVE_LENGTH - 1)/_decel_ticks; // Backward through the curve
+  else return _cruise_interval;
+
+  return Clockhand::scale_interval(acceleration_curve_interval(index), _curve_speed_factor);
+}
+
+bool Coordinator::steps_on_tick(uint8_t hand) {
+  return (unsigned long)_errors[hand] + _steps[hand] >= _master_steps;
+}
+
+bool Coordinator::fill_step_queues() {
+  unsigned int first_tick = _tick;
+  while(_tick < _master_steps) {
+    // A tick is queued for all hands at once, so wait until every hand stepping on it has room in its queue
+    for(uint8_t hand=0; hand<COORDINATOR_HANDS; hand++) {
+      if(steps_on_tick(hand) && step_scheduler.queue_free(hand) == 0) return _tick != first_tick;
+    }
+
+    unsigned long interval = tick_interval(_tick);
+    for(uint8_t hand=0; hand<COORDINATOR_HANDS; hand++) {
+      if(_steps[hand] == 0) continue;
+      _pending_intervals[hand] += interval;
+      if(steps_on_tick(hand)) {
+        _errors[hand] = _errors[hand] + _steps[hand] - _master_steps;
+        step_scheduler.queue_steps(hand, _pending_intervals[hand], Stepscheduler::STEP_PULSE, 1);
+        _pending_intervals[hand] = 0;
+      }
+      else _errors[hand] += _steps[hand];
+    }
+    _tick++;
+  }
+  return _tick != first_tick;
+}
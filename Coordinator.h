@@ -0,0 +1,70 @@
+#ifndef Coordinator_h
+#define Coordinator_h
+
+#include <Arduino.h>
+#include "Stepscheduler.h"
+
+#define COORDINATOR_HANDS 18
+
+class Coordinator
+{
+private:
+    // One master timeline of ticks with an acceleration, cruise and deceleration part. The hand with the most steps steps on every tick.
+    unsigned int _master_steps;
+    unsigned int _accel_ticks;
+    unsigned int _decel_ticks;
+    unsigned long _cruise_interval; // Micro seconds between ticks at cruise speed
+    unsigned long _curve_speed_factor; // Scales the acceleration curve to end at cruise speed, in 16.16 fixed point
+    unsigned int _tick; // Next tick to queue
+
+    // Bresenham accumulator of each hand, a hand steps on the ticks where its accumulator passes the master steps
+    unsigned int _steps[COORDINATOR_HANDS];
+    unsigned int _errors[COORDINATOR_HANDS];
+    unsigned long _pending_intervals[COORDINATOR_HANDS]; // Time since the last queued step of this hand
+
+    unsigned long tick_interval(unsigned int tick);
+    /* Returns the time in micro seconds between the previous tick and this tick */
+
+    bool steps_on_tick(uint8_t hand);
+    /* Returns true if the hand steps on the next tick */
+
+public:
+    Coordinator();
+
+    void clear();
+    /* Remove all hands and the profile */
+
+    void set_hand(uint8_t hand, unsigned int steps);
+    /* Set the steps a hand takes during the move. The direction of the hand must be set before. */
+
+    void set_profile(unsigned int cruise_interval, float accel_fraction, float decel_fraction);
+    /* Set speed and the fraction of ticks spent accelerating and decelerating. Call after all hands are set. */
+
+    unsigned int steps(uint8_t hand);
+    /* Returns the steps of a hand in the move */
+
+    unsigned int queued_steps(uint8_t hand);
+    /* Returns the steps of a hand on the ticks that are queued so far */
+
+    unsigned long predicted_duration();
+    /* Returns the duration of the move in micro seconds, worked out from the profile like Clockhand::predicted_duration() */
+
+    float max_speedup(unsigned int max_speed);
+    /* Returns how much faster the move can run before the hand with the most steps moves faster than max_speed steps per second, at least 1 */
+
+    void scale_speed(float factor);
+    /* Makes the move factor times as fast, its curves included */
+
+    void start();
+    /* Go back to the first tick. Queues nothing, call fill_step_queues() before starting the step scheduler. */
+
+    bool fill_step_queues();
+    /* Queue the steps of the next ticks, as far as the queues of the hands stepping on them allow. Returns true if any tick was queued. */
+
+    bool finished();
+    /* Returns true if the steps of all ticks are queued */
+};
+
+extern Coordinator coordinator;
+
+#endif
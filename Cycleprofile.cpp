@@ -0,0 +1,112 @@
+#include "Cycleprofile.h"
+
+#ifdef CYCLE_PROFILE
+
+Cycleprofile cycle_profile;
+
+ISR(TIMER5_OVF_vect) {
+  cycle_profile.overflow();
+}
+
+static const char *const section_names[PROFILE_SECTIONS] = {"next_steps", "next_instruction", "step_interval", "step_interrupt", "timer_interrupt", "plan"};
+
+Cycleprofile::Cycleprofile() {
+  _overflows = 0;
+  _interrupt_cycles = 0;
+  _overhead = 0;
+  clear();
+}
+
+void Cycleprofile::begin() {
+  uint8_t sreg = SREG;
+  cli();
+
+  // Timer 5 in normal mode, free running without prescaler
+  TCCR5A = 0;
+  TCCR5B = _BV(CS50);
+  TCNT5 = 0;
+  _overflows = 0;
+  TIFR5 = _BV(TOV5); // Clear pending interrupt
+  TIMSK5 = _BV(TOIE5);
+  SREG = sreg;
+
+  // Measure nothing, which is reading the counter at the start and at the end
+  unsigned long start, interrupted;
+  this->start(start, interrupted);
+  _overhead = cycles() - start;
+}
+
+unsigned long Cycleprofile::cycles() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t low = TCNT5;
+  uint16_t high = _overflows;
+  if((TIFR5 & _BV(TOV5)) && low < 0x8000) high++; // Overflow happened but is not counted yet
+  SREG = sreg;
+  return (unsigned long)high << 16 | low;
+}
+
+void Cycleprofile::start(unsigned long &start, unsigned long &interrupted) {
+  uint8_t sreg = SREG;
+  cli();
+  interrupted = _interrupt_cycles;
+  start = cycles();
+  SREG = sreg;
+}
+
+void Cycleprofile::overflow() {
+  _overflows++;
+}
+
+void Cycleprofile::record(uint8_t section, unsigned long start, unsigned long interrupted) {
+  uint8_t sreg = SREG;
+  cli();
+  unsigned long elapsed = cycles() - start;
+  unsigned long interrupt = _interrupt_cycles - interrupted;
+  SREG = sreg;
+  elapsed = elapsed > interrupt + _overhead ? elapsed - interrupt - _overhead : 0;
+
+  // Sections of the main loop are written with interrupts enabled, an interrupt only writes its own section
+  if(section == PROFILE_STEP_INTERRUPT || section == PROFILE_TIMER_INTERRUPT) _interrupt_cycles += elapsed;
+  if(_calls[section] == 0 || elapsed < _min[section]) _min[section] = elapsed;
+  if(elapsed > _max[section]) _max[section] = elapsed;
+  _total[section] += elapsed;
+  _calls[section]++;
+}
+
+void Cycleprofile::clear() {
+  uint8_t sreg = SREG;
+  cli();
+  for(uint8_t section=0; section<PROFILE_SECTIONS; section++) {
+    _calls[section] = 0;
+    _min[section] = 0;
+    _max[section] = 0;
+    _total[section] = 0;
+  }
+  SREG = sreg;
+}
+
+void Cycleprofile::print_header() {
+  Serial.println(F("cycles,animation,section,calls,min,mean,max"));
+}
+
+void Cycleprofile::print(int animation) {
+  for(uint8_t section=0; section<PROFILE_SECTIONS; section++) {
+    // Step interrupt is stopped between animations, so the counts can be read without disabling interrupts
+    if(_calls[section] == 0) continue;
+    Serial.print(F("cycles,"));
+    Serial.print(animation);
+    Serial.print(F(","));
+    Serial.print(section_names[section]);
+    Serial.print(F(","));
+    Serial.print(_calls[section]);
+    Serial.print(F(","));
+    Serial.print(_min[section]);
+    Serial.print(F(","));
+    Serial.print((unsigned long)(_total[section] / _calls[section]));
+    Serial.print(F(","));
+    Serial.println(_max[section]);
+  }
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef Cycleprofile_h
+#define Cycleprofile_h
+
+#include <Arduino.h>
+
+// #define CYCLE_PROFILE // Add to count the CPU cycles of the step code and the planners, see Clockception::benchmark(). Takes timer 5 from the step timers.
+
+#ifdef CYCLE_PROFILE
+
+// Timer 5 runs free without prescaler, so one tick is one CPU cycle. Its overflows make it a 32 bit counter. Interrupts that come in the middle of a
+// section in the main loop count along, except the step interrupts: their own cycles are subtracted.
+
+enum
+{
+    PROFILE_NEXT_STEPS, // Clockhand::next_steps(), with the instruction and interval below
+    PROFILE_NEXT_INSTRUCTION, // Clockhand::get_next_instruction()
+    PROFILE_STEP_INTERVAL, // Clockhand::calculate_step_interval()
+    PROFILE_STEP_INTERRUPT, // Stepscheduler::service()
+    PROFILE_TIMER_INTERRUPT, // Stepscheduler::timer_overflow(), counts a pulse of a step timer
+    PROFILE_PLAN, // One call of a calculate_animation_*() planner
+    PROFILE_SECTIONS
+};
+
+class Cycleprofile
+{
+private:
+    volatile uint16_t _overflows; // High word of the cycle counter
+    volatile unsigned long _interrupt_cycles; // Cycles spent in the step interrupts in total, subtracted from the sections they interrupt
+    uint8_t _overhead; // Cycles of reading the counter twice, subtracted from each measurement
+
+    // Per section, since begin() or the last clear()
+    volatile unsigned long _calls[PROFILE_SECTIONS];
+    volatile unsigned long _min[PROFILE_SECTIONS];
+    volatile unsigned long _max[PROFILE_SECTIONS];
+    volatile unsigned long long _total[PROFILE_SECTIONS];
+
+public:
+    Cycleprofile();
+
+    void begin();
+    /* Starts timer 5 and measures the overhead of a measurement */
+
+    unsigned long cycles();
+    /* Returns the 32 bit cycle counter */
+
+    void start(unsigned long &start, unsigned long &interrupted);
+    /* Returns the cycle counter and the cycles spent in the step interrupts so far, taken at the same moment */
+
+    void overflow();
+    /* Counts timer overflows. Called from the timer overflow interrupt. */
+
+    void record(uint8_t section, unsigned long start, unsigned long interrupted);
+    /* Adds a call of a section that started with start() */
+
+    void clear();
+    /* Resets the counts of all sections */
+
+    void print_header();
+    void print(int animation);
+    /* Prints a CSV line per section that was called: cycles,animation,section,calls,min,mean,max */
+};
+
+extern Cycleprofile cycle_profile;
+
+class Cycleprobe
+{
+private:
+    uint8_t _section;
+    unsigned long _start;
+    unsigned long _interrupted;
+
+public:
+    Cycleprobe(uint8_t section) : _section(section) { cycle_profile.start(_start, _interrupted); }
+    ~Cycleprobe() { cycle_profile.record(_section, _start, _interrupted); }
+    /* Measures a section from here to the end of the scope */
+};
+
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+#include "Instructionpool.h"
+
+Instructionpool instruction_pool;
+
+Instructionpool::Instructionpool() {
+  _used = 0;
+}
+
+uint8_t Instructionpool::append(uint8_t last, uint8_t type, unsigned int steps, int speed) {
+  if(_used >= INSTRUCTION_POOL_SIZE) return NO_INSTRUCTION;
+
+  uint8_t index = _used++;
+  _instructions[index].steps = steps;
+  _instructions[index].speed = speed;
+  _instructions[index].type = type;
+  _instructions[index].next = NO_INSTRUCTION;
+  if(last != NO_INSTRUCTION) _instructions[last].next = index;
+  return index;
+}
+
+uint8_t Instructionpool::insert(uint8_t after, uint8_t type, unsigned int steps, int speed) {
+  uint8_t next = _instructions[after].next;
+  uint8_t index = append(after, type, steps, speed);
+  if(index != NO_INSTRUCTION) _instructions[index].next = next;
+  return index;
+}
+
+const Instruction &Instructionpool::get(uint8_t index) {
+  return _instructions[index];
+}
+
+void Instructionpool::set(uint8_t index, uint8_t type, unsigned int steps, int speed) {
+  _instructions[index].steps = steps;
+  _instructions[index].speed = speed;
+  _instructions[index].type = type;
+}
+
+uint8_t Instructionpool::next(uint8_t index) {
+  if(index == NO_INSTRUCTION) return NO_INSTRUCTION;
+  return _instructions[index].next;
+}
+
+uint8_t Instructionpool::free_instructions() {
+  return INSTRUCTION_POOL_SIZE - _used;
+}
+
+void Instructionpool::clear() {
+  _used = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef Instructionpool_h
+#define Instructionpool_h
+
+#include <Arduino.h>
+
+#define INSTRUCTION_POOL_SIZE 240 // Instructions of all hands together, at most 255
+#define NO_INSTRUCTION 0xFF
+
+// One instruction of a hand, packed in 6 bytes
+struct Instruction
+{
+    unsigned int steps; // Steps to take
+    int speed; // Step interval in micro seconds
+    uint8_t type; // Type of movement (constant, accel, decel, delay, switch direction, S-curve, ramp)
+    uint8_t next; // Index of the next instruction of the same hand, or NO_INSTRUCTION
+};
+
+class Instructionpool
+{
+private:
+    Instruction _instructions[INSTRUCTION_POOL_SIZE];
+    uint8_t _used; // Instructions are handed out in order until the pool is cleared
+
+public:
+    Instructionpool();
+
+    uint8_t append(uint8_t last, uint8_t type, unsigned int steps, int speed);
+    /* Store an instruction after instruction last (NO_INSTRUCTION to start a new list). Returns its index, or NO_INSTRUCTION if the pool is full. */
+
+    uint8_t insert(uint8_t after, uint8_t type, unsigned int steps, int speed);
+    /* Store an instruction between instruction after and the one that follows it. Returns its index, or NO_INSTRUCTION if the pool is full. */
+
+    const Instruction &get(uint8_t index);
+    /* Returns the instruction at index */
+
+    void set(uint8_t index, uint8_t type, unsigned int steps, int speed);
+    /* Changes the instruction at index, it stays in the same place in its list */
+
+    uint8_t next(uint8_t index);
+    /* Returns the index of the instruction after index */
+
+    uint8_t free_instructions();
+    /* Returns the amount of instructions that can still be stored */
+
+    void clear();
+    /* Release all instructions. Only call when no hand has instructions left. */
+};
+
+extern Instructionpool instruction_pool;
+
+#endif
@@ -0,0 +1,50 @@
+#include "Stepoutput.h"
+
+static volatile uint8_t * const output_registers[NR_OF_PORTS] = {
+  &PORTA, &PORTB, &PORTC, &PORTD, &PORTE, &PORTF, &PORTG, &PORTH, &PORTJ, &PORTK, &PORTL
+};
+
+void resolve_output(byte pin, uint8_t &port, uint8_t &mask) {
+  // Only place the pin table is used at run time, so it is kept in RAM once
+  port = pin_port(pin);
+  mask = pin_mask(pin);
+}
+
+void resolve_step_timer(byte pin, uint8_t &timer, uint8_t &channel) {
+  timer = NO_STEP_TIMER;
+  channel = 0;
+  for(uint8_t t=0; t<NR_OF_STEP_TIMERS; t++) {
+    for(uint8_t c=0; c<3; c++) {
+      if(step_timer_pins[t][c] != pin) continue;
+      timer = t;
+      channel = c;
+    }
+  }
+}
+
+void write_output(uint8_t port, uint8_t mask, bool level) {
+  // Ports H to L are not bit addressable, so this is a read-modify-write which the interrupt must not interleave
+  uint8_t sreg = SREG;
+  cli();
+  if(level) *output_registers[port] |= mask;
+  else *output_registers[port] &= ~mask;
+  SREG = sreg;
+}
+
+void pulse_outputs(uint8_t *port_masks) {
+  bool pulse = false;
+  for(uint8_t port=0; port<NR_OF_PORTS; port++) {
+    if(port_masks[port]) {
+      *output_registers[port] |= port_masks[port];
+      pulse = true;
+    }
+  }
+
+  if(!pulse) return; // Only delays were due
+
+  delayMicroseconds(STEP_PULSE_WIDTH); // One shared pulse width for all stepping hands
+
+  for(uint8_t port=0; port<NR_OF_PORTS; port++) {
+    if(port_masks[port]) *output_registers[port] &= ~port_masks[port];
+  }
+}
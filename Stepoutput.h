@@ -0,0 +1,84 @@
+#ifndef Stepoutput_h
+#define Stepoutput_h
+
+#include <Arduino.h>
+
+#define STEP_PULSE_WIDTH 2 // Micro seconds the step pins are kept high. delayMicroseconds(1) returns directly at 16 MHz, so 2 is the shortest real pulse.
+
+// Output ports of the Arduino Mega 2560 (there is no port I)
+enum
+{
+    PORT_A = 0,
+    PORT_B,
+    PORT_C,
+    PORT_D,
+    PORT_E,
+    PORT_F,
+    PORT_G,
+    PORT_H,
+    PORT_J,
+    PORT_K,
+    PORT_L,
+    NR_OF_PORTS,
+    NO_PORT = 0xFF
+};
+
+#define MEGA_PIN(port, bit) uint8_t((port) << 3 | (bit))
+#define NR_OF_MEGA_PINS 70
+
+// Port and bit of every digital pin of the Arduino Mega 2560, same as pins_arduino.h of the mega variant
+static constexpr uint8_t mega_pins[NR_OF_MEGA_PINS] = {
+  MEGA_PIN(PORT_E,0), MEGA_PIN(PORT_E,1), MEGA_PIN(PORT_E,4), MEGA_PIN(PORT_E,5), MEGA_PIN(PORT_G,5), // 0-4
+  MEGA_PIN(PORT_E,3), MEGA_PIN(PORT_H,3), MEGA_PIN(PORT_H,4), MEGA_PIN(PORT_H,5), MEGA_PIN(PORT_H,6), // 5-9
+  MEGA_PIN(PORT_B,4), MEGA_PIN(PORT_B,5), MEGA_PIN(PORT_B,6), MEGA_PIN(PORT_B,7), MEGA_PIN(PORT_J,1), // 10-14
+  MEGA_PIN(PORT_J,0), MEGA_PIN(PORT_H,1), MEGA_PIN(PORT_H,0), MEGA_PIN(PORT_D,3), MEGA_PIN(PORT_D,2), // 15-19
+  MEGA_PIN(PORT_D,1), MEGA_PIN(PORT_D,0), MEGA_PIN(PORT_A,0), MEGA_PIN(PORT_A,1), MEGA_PIN(PORT_A,2), // 20-24
+  MEGA_PIN(PORT_A,3), MEGA_PIN(PORT_A,4), MEGA_PIN(PORT_A,5), MEGA_PIN(PORT_A,6), MEGA_PIN(PORT_A,7), // 25-29
+  MEGA_PIN(PORT_C,7), MEGA_PIN(PORT_C,6), MEGA_PIN(PORT_C,5), MEGA_PIN(PORT_C,4), MEGA_PIN(PORT_C,3), // 30-34
+  MEGA_PIN(PORT_C,2), MEGA_PIN(PORT_C,1), MEGA_PIN(PORT_C,0), MEGA_PIN(PORT_D,7), MEGA_PIN(PORT_G,2), // 35-39
+  MEGA_PIN(PORT_G,1), MEGA_PIN(PORT_G,0), MEGA_PIN(PORT_L,7), MEGA_PIN(PORT_L,6), MEGA_PIN(PORT_L,5), // 40-44
+  MEGA_PIN(PORT_L,4), MEGA_PIN(PORT_L,3), MEGA_PIN(PORT_L,2), MEGA_PIN(PORT_L,1), MEGA_PIN(PORT_L,0), // 45-49
+  MEGA_PIN(PORT_B,3), MEGA_PIN(PORT_B,2), MEGA_PIN(PORT_B,1), MEGA_PIN(PORT_B,0), MEGA_PIN(PORT_F,0), // 50-54 (A0)
+  MEGA_PIN(PORT_F,1), MEGA_PIN(PORT_F,2), MEGA_PIN(PORT_F,3), MEGA_PIN(PORT_F,4), MEGA_PIN(PORT_F,5), // 55-59
+  MEGA_PIN(PORT_F,6), MEGA_PIN(PORT_F,7), MEGA_PIN(PORT_K,0), MEGA_PIN(PORT_K,1), MEGA_PIN(PORT_K,2), // 60-64 (A8)
+  MEGA_PIN(PORT_K,3), MEGA_PIN(PORT_K,4), MEGA_PIN(PORT_K,5), MEGA_PIN(PORT_K,6), MEGA_PIN(PORT_K,7)  // 65-69
+};
+
+constexpr uint8_t pin_port(int pin) {
+  return (pin >= 0 && pin < NR_OF_MEGA_PINS) ? uint8_t(mega_pins[pin] >> 3) : uint8_t(NO_PORT);
+}
+
+constexpr uint8_t pin_mask(int pin) {
+  return (pin >= 0 && pin < NR_OF_MEGA_PINS) ? uint8_t(1 << (mega_pins[pin] & 0x07)) : uint8_t(0);
+}
+
+// 16 bit timers whose compare outputs can give step pulses without the CPU, see Stepscheduler. Timer 1 times the other steps.
+enum
+{
+    STEP_TIMER_3 = 0,
+    STEP_TIMER_4,
+    STEP_TIMER_5,
+    NR_OF_STEP_TIMERS,
+    NO_STEP_TIMER = 0xFF
+};
+
+// Pins of the compare outputs A, B and C of each step timer
+static constexpr uint8_t step_timer_pins[NR_OF_STEP_TIMERS][3] = {
+  {5, 2, 3}, // OC3A, OC3B, OC3C
+  {6, 7, 8}, // OC4A, OC4B, OC4C
+  {46, 45, 44} // OC5A, OC5B, OC5C
+};
+
+void resolve_output(byte pin, uint8_t &port, uint8_t &mask);
+/* Look up port and bit mask of a pin, once at start up */
+
+void resolve_step_timer(byte pin, uint8_t &timer, uint8_t &channel);
+/* Look up the step timer and compare output (0 to 2 for A to C) of a pin, timer is NO_STEP_TIMER if the pin is not a compare output */
+
+void write_output(uint8_t port, uint8_t mask, bool level);
+/* Set or clear the pins in mask of an output port. Safe to use while the step interrupt is running. */
+
+void pulse_outputs(uint8_t *port_masks);
+/* Give one step pulse on all pins in port_masks (one mask per port) at the same time. Must be called with interrupts disabled. Returns directly if no pins are set. */
+
+#endif
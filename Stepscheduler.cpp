@@ -0,0 +1,377 @@
+#include "Stepscheduler.h"
+#include "Stepstatistics.h"
+#include "Cycleprofile.h"
+
+Stepscheduler step_scheduler;
+
+ISR(TIMER1_COMPA_vect) {
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_STEP_INTERRUPT);
+#endif
+  step_scheduler.service();
+}
+
+ISR(TIMER1_OVF_vect) {
+  step_scheduler.overflow();
+}
+
+ISR(TIMER3_OVF_vect) {
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_TIMER_INTERRUPT);
+#endif
+  step_scheduler.timer_overflow(STEP_TIMER_3);
+}
+
+ISR(TIMER4_OVF_vect) {
+#ifdef CYCLE_PROFILE
+  Cycleprobe probe(PROFILE_TIMER_INTERRUPT);
+#endif
+  step_scheduler.timer_overflow(STEP_TIMER_4);
+}
+
+#ifndef CYCLE_PROFILE // Timer 5 counts the cycles of the profile
+ISR(TIMER5_OVF_vect) {
+  step_scheduler.timer_overflow(STEP_TIMER_5);
+}
+#endif
+
+// Step timers run in fast PWM mode 14 with prescaler 8, like timer 1, and ICRn as TOP so a period is the step interval. The compare output is
+// inverted: it is set at the compare match and cleared at BOTTOM, so the pulse ends right after the overflow at TOP. Bits of the control registers
+// are at the same place in timers 1, 3, 4 and 5.
+#define STEP_TIMER_FUNCTIONS(n) \
+static void start_timer_##n(uint8_t outputs, uint16_t top, uint16_t compare, uint16_t counter) { \
+  TCCR##n##B = 0; \
+  TCCR##n##A = 0; /* Normal mode while the compare registers are written, fast PWM only takes them at BOTTOM */ \
+  OCR##n##A = compare; \
+  OCR##n##B = compare; \
+  OCR##n##C = compare; \
+  ICR##n = top; \
+  TCNT##n = counter; \
+  TIFR##n = _BV(TOV1); \
+  TIMSK##n = _BV(TOIE1); \
+  TCCR##n##A = outputs | _BV(WGM11); \
+  TCCR##n##B = _BV(WGM13) | _BV(WGM12) | _BV(CS11); \
+} \
+static uint8_t stop_timer_##n() { \
+  uint8_t pulses = (TIFR##n & _BV(TOV1)) ? 1 : 0; /* Pulse that ended, its overflow is not counted yet */ \
+  if(TCNT##n >= OCR##n##A) { \
+    delayMicroseconds(STEP_PULSE_WIDTH+1); /* Let a pulse end, a stopped timer keeps its output set */ \
+    pulses++; \
+  } \
+  TCCR##n##B = 0; \
+  TCCR##n##A = 0; \
+  TIMSK##n = 0; \
+  return pulses; \
+}
+
+STEP_TIMER_FUNCTIONS(3)
+STEP_TIMER_FUNCTIONS(4)
+STEP_TIMER_FUNCTIONS(5)
+
+static void (*const start_timers[NR_OF_STEP_TIMERS])(uint8_t, uint16_t, uint16_t, uint16_t) = {start_timer_3, start_timer_4, start_timer_5};
+static uint8_t (*const stop_timers[NR_OF_STEP_TIMERS])() = {stop_timer_3, stop_timer_4, stop_timer_5};
+
+Stepscheduler::Stepscheduler() {
+  _heap_size = 0;
+  _overflows = 0;
+  _running = false;
+  for(uint8_t hand=0; hand<STEP_SCHEDULER_HANDS; hand++) {
+    _queue_head[hand] = 0;
+    _queue_tail[hand] = 0;
+    _scheduled[hand] = false;
+    _deadlines[hand] = 0;
+    _run_steps[hand] = 1;
+    _dropped_steps[hand] = 0;
+    _hand_timers[hand] = NO_STEP_TIMER;
+    _hand_channels[hand] = 0;
+  }
+  for(uint8_t timer=0; timer<NR_OF_STEP_TIMERS; timer++) {
+    _timer_hands[timer] = NO_TIMER_HAND;
+    _timer_steps[timer] = 0;
+  }
+}
+
+void Stepscheduler::attach_hand(uint8_t hand, byte step_pin, byte dir_pin) {
+  resolve_output(step_pin, _step_ports[hand], _step_masks[hand]);
+  resolve_output(dir_pin, _dir_ports[hand], _dir_masks[hand]);
+  resolve_step_timer(step_pin, _hand_timers[hand], _hand_channels[hand]);
+#ifdef CYCLE_PROFILE
+  if(_hand_timers[hand] == STEP_TIMER_5) _hand_timers[hand] = NO_STEP_TIMER; // Counts the cycles
+#endif
+}
+
+uint8_t Stepscheduler::queue_free(uint8_t hand) {
+  // Head and tail only grow and wrap at 256, so the difference is the amount of queued steps
+  return STEP_QUEUE_LENGTH - uint8_t(_queue_head[hand] - _queue_tail[hand]);
+}
+
+bool Stepscheduler::queue_empty(uint8_t hand) {
+  return _queue_head[hand] == _queue_tail[hand];
+}
+
+void Stepscheduler::queue_steps(uint8_t hand, unsigned long interval, byte flags, unsigned int count) {
+  uint8_t head = _queue_head[hand];
+  uint8_t slot = head & (STEP_QUEUE_LENGTH-1);
+  _queue_intervals[hand][slot] = interval;
+  _queue_flags[hand][slot] = flags;
+  _queue_counts[hand][slot] = count;
+
+  uint8_t sreg = SREG;
+  cli();
+  _queue_head[hand] = head + 1; // Step is complete, now the interrupt may take it
+
+  if(_running && !_scheduled[hand] && !on_timer(hand)) {
+    // Queue of this hand ran empty, continue counting from its last step. If that is already past, take the step as soon as possible.
+    schedule(hand, _deadlines[hand], now_ticks());
+    arm_compare();
+  }
+  SREG = sreg;
+}
+
+void Stepscheduler::start() {
+  uint8_t sreg = SREG;
+  cli();
+
+  // Timer 1 in normal mode, free running with prescaler 8
+  TCCR1A = 0;
+  TCCR1B = _BV(CS11);
+  TCNT1 = 0;
+  _overflows = 0;
+  TIFR1 = _BV(TOV1) | _BV(OCF1A); // Clear pending interrupts
+
+  unsigned long now = now_ticks();
+  _heap_size = 0;
+  for(uint8_t hand=0; hand<STEP_SCHEDULER_HANDS; hand++) {
+    _scheduled[hand] = false;
+    _deadlines[hand] = now;
+    if(!queue_empty(hand)) schedule(hand, now, now);
+  }
+
+  _running = true;
+  arm_compare();
+  TIMSK1 = _BV(TOIE1) | _BV(OCIE1A);
+  SREG = sreg;
+}
+
+void Stepscheduler::stop() {
+  uint8_t sreg = SREG;
+  cli();
+  TIMSK1 = 0;
+  TCCR1B = 0;
+  for(uint8_t timer=0; timer<NR_OF_STEP_TIMERS; timer++) {
+    if(_timer_hands[timer] == NO_TIMER_HAND) continue;
+    uint8_t pulses = stop_timers[timer]();
+    _timer_steps[timer] = _timer_steps[timer] > pulses ? _timer_steps[timer] - pulses : 0;
+  }
+  _running = false;
+  _heap_size = 0;
+  for(uint8_t hand=0; hand<STEP_SCHEDULER_HANDS; hand++) {
+    _scheduled[hand] = false;
+    _dropped_steps[hand] = count_dropped_steps(hand);
+    _queue_tail[hand] = _queue_head[hand]; // Drop steps that were not taken
+  }
+  for(uint8_t timer=0; timer<NR_OF_STEP_TIMERS; timer++) _timer_hands[timer] = NO_TIMER_HAND;
+  SREG = sreg;
+}
+
+int Stepscheduler::dropped_steps(uint8_t hand) {
+  return _dropped_steps[hand];
+}
+
+int Stepscheduler::count_dropped_steps(uint8_t hand) {
+  // Newest queued step first, so the direction only flips when passing a step that wrote the direction pin
+  int steps = 0;
+  int8_t sign = 1;
+  for(uint8_t entry=_queue_head[hand]; entry!=_queue_tail[hand]; ) {
+    entry--;
+    uint8_t slot = entry & (STEP_QUEUE_LENGTH-1);
+    byte flags = _queue_flags[hand][slot];
+    unsigned int pulses = (flags & STEP_PULSE) ? _queue_counts[hand][slot] : 0;
+    if(entry == _queue_tail[hand] && on_timer(hand)) pulses = _timer_steps[_hand_timers[hand]]; // Counts of a run on a step timer are not taken down
+    steps += sign*int(pulses);
+    if(flags & STEP_SET_DIRECTION) sign = -sign;
+  }
+  return steps;
+}
+
+bool Stepscheduler::idle() {
+  for(uint8_t hand=0; hand<STEP_SCHEDULER_HANDS; hand++) {
+    if(!queue_empty(hand)) return false;
+  }
+  return true;
+}
+
+bool Stepscheduler::step_due_within(unsigned int us) {
+  uint8_t sreg = SREG;
+  cli();
+  bool due = _heap_size > 0 && long(_deadlines[_heap[0]] - now_ticks()) < long(us)*_ticks_per_us;
+  SREG = sreg;
+  return due;
+}
+
+void Stepscheduler::service() {
+  unsigned long now = now_ticks();
+
+  while(_heap_size > 0 && long(_deadlines[_heap[0]] - now) <= 0) {
+    uint8_t due_hands[STEP_SCHEDULER_HANDS];
+    uint8_t nr_of_due_hands = 0;
+    uint8_t port_masks[NR_OF_PORTS];
+    bool direction_written = false;
+    memset(port_masks, 0, sizeof(port_masks));
+
+    // Collect all hands that are due, so their steps are given in one pulse
+    while(_heap_size > 0 && long(_deadlines[_heap[0]] - now) <= 0) {
+      uint8_t hand = _heap[0];
+      heap_pop();
+      if(prepare_step(hand, port_masks)) direction_written = true;
+#ifdef STEP_STATISTICS
+      uint8_t slot = _queue_tail[hand] & (STEP_QUEUE_LENGTH-1);
+      if(_queue_flags[hand][slot] & STEP_PULSE) step_statistics.record_step(hand, (now - _deadlines[hand]) / _ticks_per_us, _queue_intervals[hand][slot]);
+#endif
+      due_hands[nr_of_due_hands++] = hand;
+    }
+
+    if(direction_written) delayMicroseconds(STEP_PULSE_WIDTH); // Direction setup time of the driver before the step
+    pulse_outputs(port_masks);
+
+    for(uint8_t i=0; i<nr_of_due_hands; i++) {
+      uint8_t hand = due_hands[i];
+      uint8_t slot = _queue_tail[hand] & (STEP_QUEUE_LENGTH-1);
+      _queue_counts[hand][slot] -= _run_steps[hand];
+      if(_queue_counts[hand][slot] == 0) _queue_tail[hand]++; // Run of steps is done, otherwise repeat it with the same interval
+
+      if(queue_empty(hand)) continue; // Wait for main loop to queue the next step, see queue_steps()
+      if(start_timer(hand)) continue; // Its step timer gives the rest of the run
+
+      // Next deadline is counted from the deadline of this step, so time spent in this interrupt does not add up
+      schedule(hand, _deadlines[hand], now);
+    }
+  }
+
+  arm_compare();
+}
+
+void Stepscheduler::overflow() {
+  _overflows++;
+}
+
+void Stepscheduler::timer_overflow(uint8_t timer) {
+  if(--_timer_steps[timer] > 0) return; // Timer gives the next pulse by itself
+
+  uint8_t hand = _timer_hands[timer];
+  stop_timers[timer]();
+  _timer_hands[timer] = NO_TIMER_HAND;
+  _queue_tail[hand]++; // Run is done
+  if(queue_empty(hand) || start_timer(hand)) return;
+
+  schedule(hand, _deadlines[hand], now_ticks());
+  arm_compare();
+}
+
+void Stepscheduler::schedule(uint8_t hand, unsigned long from, unsigned long now) {
+  uint8_t slot = _queue_tail[hand] & (STEP_QUEUE_LENGTH-1);
+  unsigned long interval_ticks = _queue_intervals[hand][slot]*_ticks_per_us;
+  unsigned long ticks = interval_ticks;
+  unsigned int steps = 1;
+  if(!(_queue_flags[hand][slot] & STEP_PULSE) && ticks > 0) {
+    // A delay takes no steps, so it is waited in one deadline. Deadlines are compared signed, so they must stay well within 2^31 ticks.
+    steps = _queue_counts[hand][slot];
+    if(steps > 0x40000000UL / ticks) steps = 0x40000000UL / ticks;
+    ticks *= steps;
+  }
+  _run_steps[hand] = steps;
+
+  unsigned long deadline = from + ticks;
+  // Running late, the hand loses the time instead of making up with a burst of steps. A deadline of now would keep it on top of the heap, so
+  // service() would step it again right away.
+  if(long(deadline - now) < 0) deadline = now + (interval_ticks > _min_compare_distance ? interval_ticks : _min_compare_distance);
+  _deadlines[hand] = deadline;
+  heap_push(hand);
+}
+
+bool Stepscheduler::start_timer(uint8_t hand) {
+  uint8_t timer = _hand_timers[hand];
+  if(timer == NO_STEP_TIMER || _timer_hands[timer] != NO_TIMER_HAND) return false;
+
+  uint8_t slot = _queue_tail[hand] & (STEP_QUEUE_LENGTH-1);
+  unsigned int count = _queue_counts[hand][slot];
+  unsigned long period = _queue_intervals[hand][slot]*_ticks_per_us;
+  if((_queue_flags[hand][slot] & (STEP_PULSE | STEP_SET_DIRECTION)) != STEP_PULSE || count < STEP_TIMER_MIN_STEPS) return false;
+  if(period < 2*_min_compare_distance || period > 0x10000UL) return false; // Counter of the timer is 16 bits
+
+  // First pulse is due one period after the step the hand just took. Start the counter where it would have been at that step.
+  unsigned long since_step = now_ticks() - _deadlines[hand];
+  if(since_step < _timer_pulse_ticks || since_step + _min_compare_distance > period) return false; // Counter would start in a pulse, or too late
+
+  _timer_hands[timer] = hand;
+  _timer_steps[timer] = count;
+  _deadlines[hand] += period*count; // Last pulse of the run, the interrupt counts on from there
+  start_timers[timer]((_BV(COM1A1) | _BV(COM1A0)) >> 2*_hand_channels[hand], period-1, period-_timer_pulse_ticks, since_step-_timer_pulse_ticks);
+  return true;
+}
+
+bool Stepscheduler::on_timer(uint8_t hand) {
+  return _hand_timers[hand] != NO_STEP_TIMER && _timer_hands[_hand_timers[hand]] == hand;
+}
+
+unsigned long Stepscheduler::now_ticks() {
+  uint16_t low = TCNT1;
+  uint16_t high = _overflows;
+  if((TIFR1 & _BV(TOV1)) && low < 0x8000) high++; // Overflow happened but is not counted yet
+  return (unsigned long)high << 16 | low;
+}
+
+void Stepscheduler::arm_compare() {
+  unsigned long now = now_ticks();
+  unsigned long distance = _max_compare_distance;
+
+  if(_heap_size > 0) {
+    long to_deadline = long(_deadlines[_heap[0]] - now);
+    if(to_deadline < long(_min_compare_distance)) distance = _min_compare_distance; // Compare must lie ahead of the counter, else it is missed for a full timer cycle
+    else if(to_deadline < long(_max_compare_distance)) distance = to_deadline;
+  }
+
+  OCR1A = uint16_t(now + distance);
+}
+
+bool Stepscheduler::prepare_step(uint8_t hand, uint8_t *port_masks) {
+  uint8_t slot = _queue_tail[hand] & (STEP_QUEUE_LENGTH-1);
+  byte flags = _queue_flags[hand][slot];
+
+  if(flags & STEP_PULSE) port_masks[_step_ports[hand]] |= _step_masks[hand];
+
+  if(flags & STEP_SET_DIRECTION) {
+    write_output(_dir_ports[hand], _dir_masks[hand], flags & STEP_DIRECTION_HIGH);
+    return true;
+  }
+  return false;
+}
+
+void Stepscheduler::heap_push(uint8_t hand) {
+  // Sift up from the last position
+  uint8_t i = _heap_size++;
+  while(i > 0) {
+    uint8_t parent = (i-1) >> 1;
+    if(long(_deadlines[_heap[parent]] - _deadlines[hand]) <= 0) break;
+    _heap[i] = _heap[parent];
+    i = parent;
+  }
+  _heap[i] = hand;
+  _scheduled[hand] = true;
+}
+
+void Stepscheduler::heap_pop() {
+  // Move last hand to the top and sift down
+  _scheduled[_heap[0]] = false;
+  uint8_t last = _heap[--_heap_size];
+  uint8_t i = 0;
+  while(true) {
+    uint8_t child = 2*i + 1;
+    if(child >= _heap_size) break;
+    if(child+1 < _heap_size && long(_deadlines[_heap[child+1]] - _deadlines[_heap[child]]) < 0) child++;
+    if(long(_deadlines[last] - _deadlines[_heap[child]]) <= 0) break;
+    _heap[i] = _heap[child];
+    i = child;
+  }
+  _heap[i] = last;
+}
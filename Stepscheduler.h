@@ -0,0 +1,132 @@
+#ifndef Stepscheduler_h
+#define Stepscheduler_h
+
+#include <Arduino.h>
+#include "Stepoutput.h"
+
+#define STEP_QUEUE_LENGTH 4 // Queued steps per hand, must be a power of two
+#define STEP_SCHEDULER_HANDS 18
+#define STEP_TIMER_MIN_STEPS 4 // Shortest run of steps that is given to a step timer, starting the timer costs about as much as a few steps
+#define NO_TIMER_HAND 0xFF
+
+class Stepscheduler
+{
+private:
+    // Timer 1 runs free with prescaler 8, so one tick is 0.5 us at 16 MHz
+    static const uint8_t _ticks_per_us = 2;
+    static const uint16_t _max_compare_distance = 0x8000; // Wake up at least every 16 ms to check far away deadlines
+    static const uint8_t _min_compare_distance = 16; // Deadlines closer than this are handled directly instead of arming the compare
+    static const uint8_t _timer_pulse_ticks = STEP_PULSE_WIDTH * _ticks_per_us; // Step pulse of a step timer
+
+    // Per hand queue of (runs of) steps, filled by the main loop and emptied by the interrupt
+    volatile unsigned long _queue_intervals[STEP_SCHEDULER_HANDS][STEP_QUEUE_LENGTH]; // Time in micro seconds to wait before this step
+    volatile byte _queue_flags[STEP_SCHEDULER_HANDS][STEP_QUEUE_LENGTH];
+    volatile unsigned int _queue_counts[STEP_SCHEDULER_HANDS][STEP_QUEUE_LENGTH]; // Times this step is repeated with the same interval
+    volatile uint8_t _queue_head[STEP_SCHEDULER_HANDS]; // Written by main loop only
+    volatile uint8_t _queue_tail[STEP_SCHEDULER_HANDS]; // Written by interrupt only
+
+    // Min-heap with the hands that have a step due, ordered by deadline
+    volatile unsigned long _deadlines[STEP_SCHEDULER_HANDS]; // Deadline of next step in timer ticks
+    volatile uint8_t _heap[STEP_SCHEDULER_HANDS];
+    volatile uint8_t _heap_size;
+    volatile bool _scheduled[STEP_SCHEDULER_HANDS]; // Hand is in the heap
+
+    volatile uint16_t _overflows; // High word of the timer tick counter
+    volatile unsigned int _run_steps[STEP_SCHEDULER_HANDS]; // Steps of the first queued run that the deadline covers, all of a delay at once
+
+    // A run of steps of a hand whose step pin is a compare output of timer 3, 4 or 5 is given by that timer, so the interrupt above is free during
+    // long cruises. One hand per timer at a time, the first hand with a long enough run gets it. The timer gives the pulses, its overflow interrupt
+    // only counts them. Steps of a step timer are on time, they are not in the step statistics.
+    uint8_t _hand_timers[STEP_SCHEDULER_HANDS]; // Step timer of each hand, NO_STEP_TIMER if its step pin is not a compare output
+    uint8_t _hand_channels[STEP_SCHEDULER_HANDS]; // Compare output of the step pin, 0 to 2 for A to C
+    volatile uint8_t _timer_hands[NR_OF_STEP_TIMERS]; // Hand each timer steps, NO_TIMER_HAND if it is free
+    volatile unsigned int _timer_steps[NR_OF_STEP_TIMERS]; // Pulses of the run still to end
+
+    int _dropped_steps[STEP_SCHEDULER_HANDS]; // Steps the last stop() dropped, see dropped_steps()
+
+    // Port and bit mask of the step and direction pin of each hand
+    uint8_t _step_ports[STEP_SCHEDULER_HANDS];
+    uint8_t _step_masks[STEP_SCHEDULER_HANDS];
+    uint8_t _dir_ports[STEP_SCHEDULER_HANDS];
+    uint8_t _dir_masks[STEP_SCHEDULER_HANDS];
+    bool _running;
+
+    unsigned long now_ticks();
+    /* Returns the 32 bit timer tick counter. Must be called with interrupts disabled. */
+
+    void heap_push(uint8_t hand);
+    void heap_pop();
+    /* Keep the hand with the earliest deadline on top of the heap */
+
+    bool prepare_step(uint8_t hand, uint8_t *port_masks);
+    /* Write direction of the first queued step of a hand and add its step pin to port_masks. Returns true if the direction pin was written. */
+
+    void arm_compare();
+    /* Set compare register to the earliest deadline */
+
+    void schedule(uint8_t hand, unsigned long from, unsigned long now);
+    /* Set the deadline of the first queued step of a hand one interval after from, or one interval after now if that is past, and put the hand
+    in the heap */
+
+    bool start_timer(uint8_t hand);
+    /* Give the first queued run of a hand to its step timer, right after the hand took a step. Returns false if the run stays with the interrupt. */
+
+    bool on_timer(uint8_t hand);
+    /* Returns true if a step timer is giving the steps of this hand */
+
+    int count_dropped_steps(uint8_t hand);
+    /* Returns the step pulses of a hand that are queued but not taken, see dropped_steps(). Must be called with interrupts disabled and the step
+    timers stopped. */
+
+public:
+    enum
+    {
+        STEP_PULSE = 0x01, // Take an actual step, otherwise only wait (delay)
+        STEP_SET_DIRECTION = 0x02, // Write direction pin before stepping
+        STEP_DIRECTION_HIGH = 0x04 // Level of the direction pin when STEP_SET_DIRECTION is set
+    };
+
+    Stepscheduler();
+
+    void attach_hand(uint8_t hand, byte step_pin, byte dir_pin);
+    /* Register the pins of a hand, so steps can be written directly to the ports from the interrupt */
+
+    uint8_t queue_free(uint8_t hand);
+    /* Returns the amount of steps that can still be queued for this hand */
+
+    bool queue_empty(uint8_t hand);
+    /* Returns true if all queued steps of this hand have been taken */
+
+    void queue_steps(uint8_t hand, unsigned long interval, byte flags, unsigned int count);
+    /* Add a run of count steps that will each be taken interval micro seconds after the previous step of this hand. Check queue_free() first. */
+
+    void start();
+    /* Start the timer interrupt. Steps that are already queued are scheduled from now. */
+
+    void stop();
+    /* Stop the timer interrupt and drop all queued steps */
+
+    int dropped_steps(uint8_t hand);
+    /* Returns the steps of a hand that the last stop() dropped, in the direction of its last queued step. Steps queued before a direction change
+    count negative. */
+
+    bool idle();
+    /* Returns true if no steps are queued for any hand */
+
+    bool step_due_within(unsigned int us);
+    /* Returns true if a step is due within us micro seconds, so the main loop can leave time to the interrupt */
+
+    void service();
+    /* Take all steps that are due. Called from the timer compare interrupt. */
+
+    void overflow();
+    /* Count timer overflows. Called from the timer overflow interrupt. */
+
+    void timer_overflow(uint8_t timer);
+    /* Count the end of a pulse of a step timer, after the last pulse of the run the interrupt takes the hand back. Called from the overflow interrupt
+    of the step timer. */
+};
+
+extern Stepscheduler step_scheduler;
+
+#endif
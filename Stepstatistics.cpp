@@ -0,0 +1,112 @@
+#include "Stepstatistics.h"
+
+#ifdef STEP_STATISTICS
+
+Stepstatistics step_statistics;
+
+static const uint8_t nibble_bits[16] PROGMEM = {0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4}; // Significant bits of 0 to 15
+
+Stepstatistics::Stepstatistics() {
+  clear();
+}
+
+uint8_t Stepstatistics::animation_slot(int animation) {
+  if(animation >= 1 && animation <= 13) return animation; // Long animations
+  if(animation >= 21 && animation <= 33) return animation - 7; // Short animations start in 20 range
+  return 0;
+}
+
+void Stepstatistics::record_step(uint8_t hand, unsigned long lateness, unsigned long interval) {
+  uint16_t late = lateness > 0xFFFF ? 0xFFFF : lateness;
+
+  // Bucket is the number of significant bits of the lateness, looked up per nibble of its highest byte that is set
+  uint8_t bucket = 0;
+  uint8_t bits = late;
+  if(late >> 8) {
+    bits = late >> 8;
+    bucket = 8;
+  }
+  if(bits >> 4) {
+    bits >>= 4;
+    bucket += 4;
+  }
+  bucket += pgm_read_byte(&nibble_bits[bits]);
+  if(bucket > LATENESS_BUCKETS-1) bucket = LATENESS_BUCKETS-1;
+  if(_lateness_histograms[hand][bucket] != 0xFFFF) _lateness_histograms[hand][bucket]++;
+
+  if(late > _max_lateness[hand]) _max_lateness[hand] = late;
+  if(late > _run_max_lateness) _run_max_lateness = late;
+  if(lateness > interval && _run_late_steps != 0xFFFF) _run_late_steps++;
+}
+
+void Stepstatistics::start_animation(int animation, unsigned long start) {
+  _slot = animation_slot(animation);
+  _run_max_lateness = 0;
+  _run_late_steps = 0;
+  _run_loops = 0;
+  _run_start = start;
+}
+
+void Stepstatistics::end_animation() {
+  unsigned long duration = millis() - _run_start;
+  unsigned long loop_rate = duration > 0 ? _run_loops * 1000 / duration : _run_loops;
+
+  // Step interrupt is stopped by now, so run statistics can be read without disabling interrupts
+  if(_run_max_lateness > _animation_max_lateness[_slot]) _animation_max_lateness[_slot] = _run_max_lateness;
+  unsigned long late_steps = (unsigned long)_animation_late_steps[_slot] + _run_late_steps;
+  _animation_late_steps[_slot] = late_steps > 0xFFFF ? 0xFFFF : late_steps;
+  if(_animation_runs[_slot] == 0 || loop_rate < _animation_loop_rate[_slot]) _animation_loop_rate[_slot] = loop_rate;
+  if(_animation_runs[_slot] != 0xFF) _animation_runs[_slot]++;
+}
+
+void Stepstatistics::print() {
+  Serial.println(F("Step lateness in us, bucket b counts steps late by 2^(b-1) up to 2^b us"));
+  Serial.println(F("hand max buckets 0 to 15"));
+  for(uint8_t hand=0; hand<STEP_STATISTICS_HANDS; hand++) {
+    Serial.print(hand);
+    Serial.print(F(" "));
+    Serial.print(_max_lateness[hand]);
+    for(uint8_t bucket=0; bucket<LATENESS_BUCKETS; bucket++) {
+      Serial.print(F(" "));
+      Serial.print(_lateness_histograms[hand][bucket]);
+    }
+    Serial.println();
+  }
+
+  Serial.println(F("animation runs max_lateness_us late_steps min_loops_per_s"));
+  for(uint8_t slot=0; slot<ANIMATION_SLOTS; slot++) {
+    if(_animation_runs[slot] == 0) continue;
+    Serial.print(slot <= 13 ? slot : slot + 7); // Back to the animation number
+    Serial.print(F(" "));
+    Serial.print(_animation_runs[slot]);
+    Serial.print(F(" "));
+    Serial.print(_animation_max_lateness[slot]);
+    Serial.print(F(" "));
+    Serial.print(_animation_late_steps[slot]);
+    Serial.print(F(" "));
+    Serial.println(_animation_loop_rate[slot]);
+  }
+}
+
+void Stepstatistics::clear() {
+  uint8_t sreg = SREG;
+  cli();
+  for(uint8_t hand=0; hand<STEP_STATISTICS_HANDS; hand++) {
+    for(uint8_t bucket=0; bucket<LATENESS_BUCKETS; bucket++) _lateness_histograms[hand][bucket] = 0;
+    _max_lateness[hand] = 0;
+  }
+  for(uint8_t slot=0; slot<ANIMATION_SLOTS; slot++) {
+    _animation_max_lateness[slot] = 0;
+    _animation_late_steps[slot] = 0;
+    _animation_loop_rate[slot] = 0;
+    _animation_runs[slot] = 0;
+  }
+  _slot = 0;
+  _run_max_lateness = 0;
+  _run_late_steps = 0;
+  _run_loops = 0;
+  _run_start = 0;
+  SREG = sreg;
+}
+
+#endif
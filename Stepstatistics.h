@@ -0,0 +1,63 @@
+#ifndef Stepstatistics_h
+#define Stepstatistics_h
+
+#include <Arduino.h>
+
+#define STEP_STATISTICS // Remove to compile the statistics out, they cost about 850 bytes of RAM and some cycles per step
+
+#ifdef STEP_STATISTICS
+
+#define STEP_STATISTICS_HANDS 18
+#define LATENESS_BUCKETS 16 // Bucket 0 is on time, bucket b is late by 2^(b-1) up to 2^b micro seconds, the last bucket is 16 ms or more
+#define ANIMATION_SLOTS 27 // No animation, LONG_1 to LONG_13 and SHORT_1 to SHORT_13
+
+class Stepstatistics
+{
+private:
+    // Since start up or last clear, counts saturate
+    volatile uint16_t _lateness_histograms[STEP_STATISTICS_HANDS][LATENESS_BUCKETS];
+    volatile uint16_t _max_lateness[STEP_STATISTICS_HANDS]; // Micro seconds
+
+    // Per animation, of all its runs together
+    uint16_t _animation_max_lateness[ANIMATION_SLOTS]; // Micro seconds
+    uint16_t _animation_late_steps[ANIMATION_SLOTS]; // Steps that were more than their interval late
+    unsigned long _animation_loop_rate[ANIMATION_SLOTS]; // Lowest run loop iterations per second of a run
+    uint8_t _animation_runs[ANIMATION_SLOTS];
+
+    // Current animation, written from the step interrupt
+    uint8_t _slot;
+    volatile uint16_t _run_max_lateness;
+    volatile uint16_t _run_late_steps;
+    unsigned long _run_loops;
+    unsigned long _run_start;
+
+    uint8_t animation_slot(int animation);
+    /* Returns the slot of an animation number */
+
+public:
+    Stepstatistics();
+
+    void record_step(uint8_t hand, unsigned long lateness, unsigned long interval);
+    /* Add a step that was taken lateness micro seconds after its deadline, interval micro seconds after the previous step. Called from the step interrupt. */
+
+    void start_animation(int animation, unsigned long start);
+    /* Start counting a run of an animation that started at millis() start */
+
+    void count_loop() { _run_loops++; }
+    /* Count an iteration of the run loop */
+
+    void end_animation();
+    /* Add the run to the statistics of its animation */
+
+    void print();
+    /* Print all statistics to serial */
+
+    void clear();
+    /* Reset all statistics */
+};
+
+extern Stepstatistics step_statistics;
+
+#endif
+
+#endif
@@ -0,0 +1,194 @@
+#include "Syncbus.h"
+#include "Telemetry.h"
+
+Syncbus sync_bus;
+
+Syncbus::Syncbus() {
+  _unit = 0;
+  _units = 1;
+  _frame_us = 40;
+  _frame_length = 0;
+  _last_heard = 0;
+  _announce_time = 0;
+  _announced = false;
+  _valid = false;
+  _started = false;
+  _start_time = 0;
+  _latency = 0;
+}
+
+void Syncbus::begin(uint8_t unit, uint8_t units, unsigned long baud) {
+  _unit = unit;
+  _units = units;
+  if(_unit == 0) return;
+
+  Serial1.begin(baud);
+  _frame_us = 10000000UL / baud; // Start bit, 8 data bits and stop bit
+  _latency = 2 * _frame_us; // Until it is measured: magic and type of the start frame on the wire, without the time the follower takes to read it
+  _last_heard = millis();
+}
+
+bool Syncbus::master() {
+  return _unit == 1;
+}
+
+bool Syncbus::follower() {
+  return _unit >= 2;
+}
+
+void Syncbus::service() {
+  if(!follower()) return; // The master only reads the bus while it measures latencies
+  while(Serial1.available() > 0) receive(Serial1.read());
+}
+
+void Syncbus::receive(uint8_t data) {
+  if(_frame_length == 0 && data != SYNC_MAGIC) return; // Wait for the start of a frame
+  if(_frame_length == 1 && data == SYNC_START) _start_time = micros(); // Timed on its type, everything else can wait
+  _frame[_frame_length++] = data;
+  if(_frame_length < 2) return; // Only the magic so far
+
+  uint8_t length;
+  switch(_frame[1]) {
+    case SYNC_ANNOUNCE: length = 10; break;
+    case SYNC_START: length = 3; break;
+    case SYNC_PING: length = 3; break;
+    case SYNC_LATENCY: length = 6; break;
+    default:
+      _frame_length = 0; // Not a frame for followers
+      return;
+  }
+  if(_frame_length < length) return;
+  _frame_length = 0;
+  _last_heard = millis();
+
+  if(_frame[1] == SYNC_START) {
+    if(!_valid || _frame[2] >= 60) return;
+    _announcement.second = _frame[2];
+    _started = true;
+    return;
+  }
+
+  if(_frame[1] == SYNC_PING) {
+    if(_frame[2] != _unit) return;
+    uint8_t pong[3] = {SYNC_MAGIC, SYNC_PONG, _unit};
+    Serial1.write(pong, 3); // Answer right away, the master times the round trip
+    return;
+  }
+
+  uint8_t checksum = 0;
+  for(uint8_t i=2; i<length-1; i++) checksum += _frame[i];
+  if(checksum != _frame[length-1]) return; // Damaged on the bus
+
+  if(_frame[1] == SYNC_ANNOUNCE) {
+    _announcement.hour = _frame[2];
+    _announcement.minute = _frame[3];
+    _announcement.second = 0;
+    _announcement.animation = _frame[4];
+    _announcement.seed = _frame[5] | (unsigned long)_frame[6] << 8 | (unsigned long)_frame[7] << 16 | (unsigned long)_frame[8] << 24;
+    _announced = true;
+    _valid = true;
+    _started = false;
+  }
+  else if(_frame[2] == _unit) { // SYNC_LATENCY
+    _latency = _frame[3] | _frame[4] << 8;
+    if(_latency > SYNC_START_DELAY) _latency = SYNC_START_DELAY;
+  }
+}
+
+void Syncbus::send_frame(uint8_t type, const uint8_t *data, uint8_t length) {
+  uint8_t frame[SYNC_FRAME_LENGTH];
+  frame[0] = SYNC_MAGIC;
+  frame[1] = type;
+  frame[length+2] = 0;
+  for(uint8_t i=0; i<length; i++) {
+    frame[i+2] = data[i];
+    frame[length+2] += data[i];
+  }
+  Serial1.write(frame, length+3);
+}
+
+unsigned long Syncbus::measure_round_trip(uint8_t unit) {
+  unsigned long shortest = 0;
+  for(uint8_t ping=0; ping<SYNC_PINGS; ping++) {
+    while(Serial1.available() > 0) Serial1.read(); // Late answers of a previous ping
+
+    uint8_t frame[3] = {SYNC_MAGIC, SYNC_PING, unit};
+    unsigned long sent = micros();
+    Serial1.write(frame, 3);
+
+    // Ping and pong have the same length, so half the round trip is the time one way
+    uint8_t received = 0;
+    unsigned long wait_start = millis();
+    while(received < 3 && millis() - wait_start <= SYNC_PING_TIMEOUT) {
+      if(Serial1.available() <= 0) continue;
+      uint8_t data = Serial1.read();
+      if(received == 0 && data != SYNC_MAGIC) continue;
+      if((received == 1 && data != SYNC_PONG) || (received == 2 && data != unit)) received = 0;
+      else received++;
+    }
+    unsigned long round_trip = micros() - sent;
+    if(received == 3 && (shortest == 0 || round_trip < shortest)) shortest = round_trip;
+  }
+  return shortest;
+}
+
+void Syncbus::measure_latencies() {
+  if(!master()) return;
+  for(uint8_t unit=2; unit<=_units; unit++) {
+    unsigned long round_trip = measure_round_trip(unit);
+    if(round_trip == 0) {
+      telemetry.log(TELEMETRY_BUS_LATENCY, unit, 0xFFFFFFFF); // No answer, the follower keeps its last latency
+      continue;
+    }
+
+    // The type of a start frame is read a byte before the end of a ping
+    unsigned int latency = round_trip / 2 > _frame_us ? round_trip / 2 - _frame_us : 0;
+    uint8_t data[3] = {unit, uint8_t(latency), uint8_t(latency >> 8)};
+    send_frame(SYNC_LATENCY, data, 3);
+    telemetry.log(TELEMETRY_BUS_LATENCY, unit, latency);
+  }
+}
+
+void Syncbus::announce(uint8_t hour, uint8_t minute, uint8_t animation, unsigned long seed) {
+  if(!master()) return;
+  uint8_t data[7] = {hour, minute, animation, uint8_t(seed), uint8_t(seed >> 8), uint8_t(seed >> 16), uint8_t(seed >> 24)};
+  send_frame(SYNC_ANNOUNCE, data, 7);
+  _announce_time = millis();
+}
+
+void Syncbus::start(uint8_t second) {
+  if(!master()) return;
+  while(millis() - _announce_time < SYNC_PLAN_TIME); // Only after a late announcement, at power up or when the time changed
+  Serial1.flush(); // Transmit buffer is empty, so the start frame goes on the wire right away
+  uint8_t frame[3] = {SYNC_MAGIC, SYNC_START, second};
+  unsigned long sent = micros();
+  Serial1.write(frame, 3);
+  while(micros() - sent < SYNC_START_DELAY); // Followers wait the same time from reading the frame, minus their latency
+}
+
+bool Syncbus::announced(Sync_announcement &announcement) {
+  if(!_announced) return false;
+  _announced = false;
+  announcement = _announcement;
+  return true;
+}
+
+bool Syncbus::started(Sync_announcement &announcement) {
+  if(!_started) return false;
+  announcement = _announcement;
+  return true;
+}
+
+void Syncbus::wait_for_start() {
+  while(micros() - _start_time < SYNC_START_DELAY - _latency);
+  _started = false;
+  _valid = false; // Next start needs a new announcement
+}
+
+void Syncbus::listen() {
+  _last_heard = millis();
+}
+
+bool Syncbus::master_silent() {
+  return millis() - _last_heard > SYNC_MASTER_TIMEOUT;
+}
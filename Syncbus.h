@@ -0,0 +1,108 @@
+#ifndef Syncbus_h
+#define Syncbus_h
+
+#include <Arduino.h>
+
+// Units side by side run the same animation at the same moment. The master sends frames on Serial1 to all followers, followers only answer pings.
+// Each frame starts with SYNC_MAGIC, then its type. Announce and latency frames end with a checksum, the sum of the bytes after the type.
+//   SYNC_ANNOUNCE: hour, minute, animation, seed as 4 bytes little endian. Sent while waiting for the minute, followers plan with it.
+//   SYNC_START: second of the RTC of the master, so it is short and always the same length. Sent at the minute, all units start SYNC_START_DELAY
+//     after the master sent it. Followers time it on its type byte.
+//   SYNC_PING and SYNC_PONG: unit. The master measures the round trip to a follower, the follower answers right away.
+//   SYNC_LATENCY: unit, micro seconds as 2 bytes. Time from sending a start frame until the follower reads its type.
+
+#define SYNC_MAGIC 0xC3
+#define SYNC_START_DELAY 3000 // Micro seconds, longer than the latency of any follower plus writing its RTC
+#define SYNC_PINGS 8 // Round trips measured per follower, the shortest counts
+#define SYNC_PLAN_TIME 1000 // Milli seconds from an announcement until the start at the earliest, followers plan in between
+#define SYNC_PING_TIMEOUT 5 // Milli seconds to wait for an answer, a follower that does not answer is left out
+#define SYNC_MASTER_TIMEOUT 65000 // Milli seconds without a frame of the master after which a follower runs on its own RTC
+#define SYNC_FRAME_LENGTH 10 // Longest frame, the announcement
+
+enum
+{
+    SYNC_ANNOUNCE = 'A',
+    SYNC_START = 'S',
+    SYNC_PING = 'P',
+    SYNC_PONG = 'R',
+    SYNC_LATENCY = 'L'
+};
+
+struct Sync_announcement
+{
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second; // Of the master at the start, an animation can start late when the previous one took long
+    uint8_t animation;
+    unsigned long seed; // Random seed, so random numbers of the animation are the same on all units
+};
+
+class Syncbus
+{
+private:
+    uint8_t _unit; // 0 runs on its own, 1 is the master, 2 and up are followers
+    uint8_t _units; // Units on the bus, master included
+    unsigned int _frame_us; // Time one byte takes on the bus
+
+    uint8_t _frame[SYNC_FRAME_LENGTH]; // Frame being received
+    uint8_t _frame_length;
+    unsigned long _last_heard; // millis() of the last frame of the master
+
+    Sync_announcement _announcement; // Last announcement of the master
+    unsigned long _announce_time; // Master: millis() of the last announcement
+    bool _announced; // Announcement arrived that was not picked up with announced() yet
+    bool _valid; // An announcement arrived since the last start, so a start can be followed
+    bool _started; // Start frame arrived
+    unsigned long _start_time; // micros() at which the type of the start frame was read
+    unsigned int _latency; // Micro seconds from the master sending a start frame until this follower reads its type
+
+    void receive(uint8_t data);
+    /* Adds a byte to the frame being received, handles the frame when it is complete */
+
+    void send_frame(uint8_t type, const uint8_t *data, uint8_t length);
+    /* Writes magic, type, data and the checksum of data to the bus */
+
+    unsigned long measure_round_trip(uint8_t unit);
+    /* Master: pings a follower and returns the shortest round trip in micro seconds, or 0 if it does not answer */
+
+public:
+    Syncbus();
+
+    void begin(uint8_t unit, uint8_t units, unsigned long baud);
+    /* Opens Serial1 if the unit is on a bus. Can be called again to change the unit. */
+
+    bool master();
+    bool follower();
+
+    void service();
+    /* Follower: reads frames of the master and answers pings. Called from tick(). */
+
+    void measure_latencies();
+    /* Master: measures the latency to each follower and sends it to them. Logs TELEMETRY_BUS_LATENCY for each follower. */
+
+    void announce(uint8_t hour, uint8_t minute, uint8_t animation, unsigned long seed);
+    /* Master: sends the animation of the next minute */
+
+    void start(uint8_t second);
+    /* Master: sends the start frame with the second of its RTC and returns SYNC_START_DELAY later, when the followers start too. Waits first until SYNC_PLAN_TIME after the
+       announcement. */
+
+    bool announced(Sync_announcement &announcement);
+    /* Follower: returns true once for each new announcement, with the announcement */
+
+    bool started(Sync_announcement &announcement);
+    /* Follower: returns true if the master started the announced animation, with the announcement and the second of the master */
+
+    void wait_for_start();
+    /* Follower: returns at the start time of the master */
+
+    void listen();
+    /* Follower: counts the silence of the master from now. Called after it played an animation with the master, which took as long there. */
+
+    bool master_silent();
+    /* Follower: returns true if the master sent nothing for SYNC_MASTER_TIMEOUT */
+};
+
+extern Syncbus sync_bus;
+
+#endif
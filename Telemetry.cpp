@@ -0,0 +1,62 @@
+#include "Telemetry.h"
+#include "Stepscheduler.h"
+
+Telemetry telemetry;
+
+Telemetry::Telemetry() {
+  _head = 0;
+  _tail = 0;
+  _dropped = 0;
+}
+
+void Telemetry::log(uint8_t type, uint8_t id, unsigned long value) {
+  // Head and tail only grow and wrap at 256, so the difference is the amount of waiting records
+  if(uint8_t(_head - _tail) >= TELEMETRY_BUFFER_LENGTH) {
+    if(_dropped != 0xFFFF) _dropped++;
+    return;
+  }
+
+  Telemetry_record &record = _records[_head & (TELEMETRY_BUFFER_LENGTH-1)];
+  record.type = type;
+  record.id = id;
+  record.value = value;
+  _head++;
+}
+
+void Telemetry::service() {
+  while(!empty() || _dropped > 0) {
+    if(step_scheduler.step_due_within(_step_margin)) return; // Copying into the serial buffer would delay the step interrupt
+
+    if(_dropped > 0) {
+      Telemetry_record dropped = {TELEMETRY_DROPPED, 0, _dropped};
+      if(!send(dropped)) return;
+      _dropped = 0;
+      continue;
+    }
+
+    if(!send(_records[_tail & (TELEMETRY_BUFFER_LENGTH-1)])) return;
+    _tail++;
+  }
+}
+
+bool Telemetry::empty() {
+  return _head == _tail;
+}
+
+bool Telemetry::send(const Telemetry_record &record) {
+  if(Serial.availableForWrite() < TELEMETRY_RECORD_SIZE) return false; // Wait until the port has sent enough, writing now would block
+
+  uint8_t bytes[TELEMETRY_RECORD_SIZE];
+  bytes[0] = TELEMETRY_SYNC;
+  bytes[1] = record.type;
+  bytes[2] = record.id;
+  bytes[3] = record.value;
+  bytes[4] = record.value >> 8;
+  bytes[5] = record.value >> 16;
+  bytes[6] = record.value >> 24;
+  bytes[7] = 0;
+  for(uint8_t i=1; i<TELEMETRY_RECORD_SIZE-1; i++) bytes[7] += bytes[i];
+
+  Serial.write(bytes, TELEMETRY_RECORD_SIZE);
+  return true;
+}
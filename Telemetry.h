@@ -0,0 +1,66 @@
+#ifndef Telemetry_h
+#define Telemetry_h
+
+#include <Arduino.h>
+
+#define TELEMETRY_BUFFER_LENGTH 32 // Records waiting to be sent, must be a power of two
+#define TELEMETRY_RECORD_SIZE 8
+#define TELEMETRY_SYNC 0xA5 // First byte of every record, never part of the text that is printed in between
+
+// Record as it is sent: sync, type, id, value as 4 bytes little endian, checksum. The checksum is the sum of type, id and value bytes.
+struct Telemetry_record
+{
+    uint8_t type;
+    uint8_t id;
+    unsigned long value;
+};
+
+enum
+{
+    TELEMETRY_ANIMATION_START = 1, // id is the animation, value the millis() at start
+    TELEMETRY_ANIMATION_STOP = 2, // id is the animation, value its duration in milli seconds
+    TELEMETRY_ANIMATION_LOOPS = 3, // id is the animation, value the iterations of the run loop
+    TELEMETRY_ANIMATION_SKIPPED = 4, // id is the animation, it did not fit in the instruction pool
+    TELEMETRY_ANIMATION_TIMEOUT = 5, // id is the animation, it was forced to finish
+    TELEMETRY_TIME = 6, // value is hour << 8 | minute at a new minute
+    TELEMETRY_TIME_SET = 7, // value is hour << 8 | minute, set with the buttons
+    TELEMETRY_HAND_POSITION = 8, // id is the hand, value its position in steps after an animation
+    TELEMETRY_POOL_FULL = 9, // id is the hand whose instruction did not fit in the pool
+    TELEMETRY_DROPPED = 10, // value is the amount of records dropped since the previous one, because the buffer was full
+    TELEMETRY_STEPS_UNDERFLOW = 11, // id is the hand, value the animation. Planning gave a part of a movement more steps than the whole.
+    TELEMETRY_BUS_LATENCY = 12, // id is the follower unit, value its latency in micro seconds as measured by the master, 0xFFFFFFFF if it did not answer
+    TELEMETRY_BUS_SILENT = 13, // Follower runs on its own RTC, the master sent nothing for SYNC_MASTER_TIMEOUT
+    TELEMETRY_TIME_DRIFT = 14, // value is the seconds the count of the square wave was ahead of the RTC, as a signed long. See Timebase.h.
+    TELEMETRY_MOVEMENT_PREDICTED = 15, // id is the animation, value the duration of the next movement in milli seconds as planned. TELEMETRY_ANIMATION_STOP gives the actual one.
+    TELEMETRY_MOVEMENT_SCALED = 16 // id is the animation, value the speed of the next movement in percent of the planned one, sped up to end within animation_budget
+};
+
+class Telemetry
+{
+private:
+    Telemetry_record _records[TELEMETRY_BUFFER_LENGTH];
+    uint8_t _head; // Next record to write
+    uint8_t _tail; // Next record to send
+    uint16_t _dropped; // Records dropped since the last TELEMETRY_DROPPED record, saturates
+
+    static const unsigned int _step_margin = 200; // Micro seconds that must be free of steps to hand a record to the serial port
+
+    bool send(const Telemetry_record &record);
+    /* Hand a record to the serial port if it fits in its transmit buffer. Returns false if it does not fit. */
+
+public:
+    Telemetry();
+
+    void log(uint8_t type, uint8_t id, unsigned long value);
+    /* Store a record to be sent later, or count it as dropped if the buffer is full. Never blocks. */
+
+    void service();
+    /* Send waiting records while the serial port has room for them and no step is due. Call often from the main loop. */
+
+    bool empty();
+    /* Returns true if all records have been sent */
+};
+
+extern Telemetry telemetry;
+
+#endif
@@ -0,0 +1,92 @@
+#include "Timebase.h"
+#include "Stepoutput.h"
+#include "Telemetry.h"
+
+Timebase time_base;
+
+ISR(PCINT2_vect) {
+  time_base.edge();
+}
+
+Timebase::Timebase() {
+  _rtc = 0;
+  _pin = 0;
+  _seconds = 0;
+  _edge_time = 0;
+  _check_time = 0;
+}
+
+void Timebase::begin(RTC_DS3231 *rtc, uint8_t pin) {
+  _rtc = rtc;
+  _pin = pin;
+  _rtc->writeSqwPinMode(DS3231_SquareWave1Hz);
+  pinMode(_pin, INPUT_PULLUP); // SQW is open drain
+
+  DateTime now = _rtc->now();
+  set((unsigned long)now.hour() * 3600 + now.minute() * 60 + now.second());
+  _check_time = millis();
+
+  // Pins A8 to A15 are port K, PCINT16 to PCINT23
+  PCMSK2 |= pin_mask(_pin);
+  PCIFR = _BV(PCIF2); // Clear a change from before
+  PCICR |= _BV(PCIE2);
+}
+
+void Timebase::set(unsigned long seconds) {
+  uint8_t sreg = SREG;
+  cli();
+  _seconds = seconds;
+  _edge_time = millis();
+  SREG = sreg;
+}
+
+void Timebase::edge() {
+  if(digitalRead(_pin) == HIGH) return; // Rising edge, halfway the second
+  unsigned long time = millis();
+  unsigned long since_edge = time - _edge_time;
+  unsigned long counted = since_edge >= TIMEBASE_EDGE_TIMEOUT ? (since_edge + 500) / 1000 : 1; // After a gap in the square wave, take over the seconds now() counted on with millis(), so the time does not jump back
+  _seconds = (_seconds + counted) % 86400UL;
+  _edge_time = time;
+}
+
+void Timebase::now(uint8_t &hour, uint8_t &minute, uint8_t &second) {
+  uint8_t sreg = SREG;
+  cli();
+  unsigned long seconds = _seconds;
+  unsigned long edge_time = _edge_time;
+  SREG = sreg;
+
+  unsigned long since_edge = millis() - edge_time;
+  if(since_edge >= TIMEBASE_EDGE_TIMEOUT) seconds = (seconds + since_edge / 1000) % 86400UL; // Square wave is missing
+  hour = seconds / 3600;
+  minute = seconds / 60 % 60;
+  second = seconds % 60;
+}
+
+void Timebase::adjust(uint8_t hour, uint8_t minute, uint8_t second) {
+  _rtc->adjust(DateTime(2000, 1, 1, hour, minute, second)); // Writing the seconds restarts the second of the RTC
+  set((unsigned long)hour * 3600 + minute * 60 + second);
+}
+
+void Timebase::check() {
+  if(millis() - _check_time < TIMEBASE_CHECK_INTERVAL) return;
+  uint8_t sreg = SREG;
+  cli();
+  unsigned long since_edge = millis() - _edge_time;
+  SREG = sreg;
+  if(since_edge >= TIMEBASE_CHECK_WINDOW && since_edge < TIMEBASE_EDGE_TIMEOUT) return; // RTC counts soon, wait for the next edge
+
+  uint8_t hour, minute, second;
+  now(hour, minute, second);
+  long counted = (long)hour * 3600 + minute * 60 + second;
+  DateTime rtc_now = _rtc->now();
+  long seconds = (long)rtc_now.hour() * 3600 + rtc_now.minute() * 60 + rtc_now.second();
+  _check_time = millis();
+
+  if(seconds == counted) return;
+  long drift = counted - seconds;
+  if(drift > 43200) drift -= 86400; // Around midnight
+  if(drift < -43200) drift += 86400;
+  telemetry.log(TELEMETRY_TIME_DRIFT, 0, (unsigned long)drift);
+  set(seconds);
+}
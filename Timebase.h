@@ -0,0 +1,49 @@
+#ifndef Timebase_h
+#define Timebase_h
+
+#include <Arduino.h>
+#include <RTClib.h>
+
+// Time of day without I2C. The DS3231 gives a 1 Hz square wave on SQW, its falling edge comes when the RTC counts a second. A pin change interrupt
+// counts the edges, so reading the time is a copy of a few bytes, also in the middle of an animation. The RTC itself is only read at start up and
+// every TIMEBASE_CHECK_INTERVAL, while the hands are idle, to correct a missed edge. Without edges the seconds are counted on with millis().
+
+#define TIMEBASE_CHECK_INTERVAL 3600000 // Milli seconds between reads of the RTC
+#define TIMEBASE_EDGE_TIMEOUT 1500 // Milli seconds without an edge after which the square wave counts as missing
+#define TIMEBASE_CHECK_WINDOW 500 // Milli seconds after an edge in which the RTC is read, far from its next count
+
+class Timebase
+{
+private:
+    RTC_DS3231 *_rtc;
+    uint8_t _pin;
+    volatile unsigned long _seconds; // Seconds of the day, counted by the interrupt
+    volatile unsigned long _edge_time; // millis() of the last falling edge, or of the last read or write of the RTC
+    unsigned long _check_time; // millis() of the last read of the RTC
+
+    void set(unsigned long seconds);
+    /* Sets the seconds of the day, counting on from now */
+
+public:
+    Timebase();
+
+    void begin(RTC_DS3231 *rtc, uint8_t pin);
+    /* Turns on the square wave of the RTC, reads its time and starts counting the edges on pin, one of A8 to A15 */
+
+    void edge();
+    /* Counts a second on a falling edge of the square wave. Called from the pin change interrupt. */
+
+    void now(uint8_t &hour, uint8_t &minute, uint8_t &second);
+    /* Time of day without I2C */
+
+    void adjust(uint8_t hour, uint8_t minute, uint8_t second);
+    /* Writes the time to the RTC, which starts a new second from now */
+
+    void check();
+    /* Reads the RTC once every TIMEBASE_CHECK_INTERVAL, just after an edge, and takes its time. Logs TELEMETRY_TIME_DRIFT if the count was off.
+       Call only while the hands are idle, a read takes about a milli second. */
+};
+
+extern Timebase time_base;
+
+#endif
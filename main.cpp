@@ -1,12 +1,16 @@
 #include "Clockception.h"
+#include "settings.h"
 
 Clockception clockception;
 
 void setup() {
-  Serial.begin(9600);
+  Serial.begin(serial_baud);
   Serial.println(F("Starting Clockception"));
   clockception.init();
   Serial.println(F("Clockception initiated"));
+#ifdef CYCLE_PROFILE
+  clockception.benchmark(); // Cycles per step and per planner
+#endif
 
   //Let user set hands straight and set time
   clockception.set_settings();
@@ -7,6 +7,17 @@ const int nr_of_hands = 18;
 const int hour_hand = nr_of_hands-2;
 const int minute_hand = nr_of_hands-1;
 
+const unsigned long serial_baud = 115200; // Telemetry records and text, see Telemetry.h
+
+// Each movement of an animation is sped up if it would end later than animation_budget milli seconds after the start of its minute, so the next minute
+// is shown in time. Hands are not sped up past their motor_max_speed below. A budget of 0 turns it off.
+const unsigned long animation_budget = 58000;
+
+// Units side by side start their animations together over Serial1, see Syncbus.h. Connect TX1 of the master to RX1 of all followers, TX1 of each follower through a diode to RX1 of the master, which has a pull-up.
+const uint8_t sync_unit = 0; // 0 runs on its own, 1 is the master, 2 and up are followers with a number of their own
+const uint8_t sync_units = 1; // Units on the bus, master included. Followers are numbered 2 up to this.
+const unsigned long sync_baud = 250000; // Exact on 16 MHz
+
 // Button pins
 const byte button_back_pin = 52;
 const byte button_set_pin = 50;
@@ -14,8 +25,9 @@ const byte button_forward_pin = 48;
 
 const byte stepper_driver_reset = 53;
 const byte unused_pin = A12; // For setting random seed
+const byte rtc_sqw_pin = A8; // 1 Hz square wave of the DS3231 (SQW), one of A8 to A15, see Timebase.h
 
-const int motors[18][2] = {
+constexpr int motors[18][2] = {
   {11,13}, // Step, direction
   {15,17},
   {3,5},
@@ -36,7 +48,12 @@ const int motors[18][2] = {
   {29,31}
 };
 
-const bool motor_inverted[18] = {false,true,false,true,false,true,false,true,false,true,false,true,false,true,false,true,false,true};
+constexpr bool motor_inverted[18] = {false,true,false,true,false,true,false,true,false,true,false,true,false,true,false,true,false,true};
+
+// Limits of the motors for calculate_animation_time_optimal(), the fastest speed and acceleration at which a hand does not miss steps. Measure them per motor,
+// a hand with a heavier or longer pointer may need lower ones. The default speed is the fastest the other planners are given.
+constexpr unsigned int motor_max_speed[18] = {1000,1000,1000,1000,1000,1000,1000,1000,1000,1000,1000,1000,1000,1000,1000,1000,1000,1000}; // Steps per second
+constexpr unsigned int motor_max_acceleration[18] = {500,500,500,500,500,500,500,500,500,500,500,500,500,500,500,500,500,500}; // Steps per second^2
 
 // //Voor klok nr. 2
 // // Button pins
@@ -46,8 +63,9 @@ const bool motor_inverted[18] = {false,true,false,true,false,true,false,true,fal
 
 // const byte stepper_driver_reset = 53;
 // const byte unused_pin = A12; // For setting random seed
+// const byte rtc_sqw_pin = A8; // 1 Hz square wave of the DS3231 (SQW), one of A8 to A15, see Timebase.h
 
-// const int motors[18][2] = {
+// constexpr int motors[18][2] = {
 //   {11,13}, // Step, direction
 //   {15,17},
 //   {3,5},
@@ -76,8 +94,9 @@ const bool motor_inverted[18] = {false,true,false,true,false,true,false,true,fal
 
 // const byte stepper_driver_reset = 31;
 // const byte unused_pin = A12; // For setting random seed
+// const byte rtc_sqw_pin = A8; // 1 Hz square wave of the DS3231 (SQW), one of A8 to A15, see Timebase.h
 
-// const int motors[18][2] = {
+// constexpr int motors[18][2] = {
 //   {3,2}, // Step, direction
 //   {5,4},
 //   {25,30},
@@ -98,7 +117,7 @@ const bool motor_inverted[18] = {false,true,false,true,false,true,false,true,fal
 //   {19,18}
 // };
 
-//const bool motor_inverted[18] = {false,true,false,true,false,true,false,true,false,true,false,true,false,true,false,true,false,true};
+//constexpr bool motor_inverted[18] = {false,true,false,true,false,true,false,true,false,true,false,true,false,true,false,true,false,true};
 
 /*
 Clock position numbers in program (to create patterns in the movements), seen from the front
@@ -110,7 +129,7 @@ Hour hand/minute hand
         8/9
 */
 
-int clock_frame_positions[nr_of_hands] = {
+const int clock_frame_positions[nr_of_hands] = {
     // Hour minute
     int(steps_per_revolution*0.375), int(steps_per_revolution*0.625), 
     int(steps_per_revolution*0.375), int(steps_per_revolution*0.875), 
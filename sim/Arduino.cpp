@@ -0,0 +1,573 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <poll.h>
+#include <unistd.h>
+#include "Simulation.h"
+#include "Stepoutput.h"
+
+// Virtual time it takes to call the Arduino core on a 16 MHz Mega, in ticks of 0.5 us
+static const unsigned long digital_write_ticks = 8;
+static const unsigned long digital_read_ticks = 8;
+static const unsigned long time_read_ticks = 2; // millis() and micros()
+static const unsigned long interrupt_ticks = 8; // Entering and leaving an interrupt
+static const unsigned long ticks_per_us = 2;
+static const unsigned long ticks_per_second = 2000000;
+static const unsigned long timer0_overflow_ticks = 2048;
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TCCR3A, TCCR3B, TIMSK3, TCCR4A, TCCR4B, TIMSK4, TCCR5A, TCCR5B, TIMSK5;
+volatile uint16_t OCR1A, OCR3A, OCR3B, OCR3C, ICR3, OCR4A, OCR4B, OCR4C, ICR4, OCR5A, OCR5B, OCR5C, ICR5;
+volatile uint8_t PCICR, PCMSK2;
+Timer_flags PCIFR = {0};
+volatile uint8_t SREG = 0x80; // Interrupts are enabled when setup() starts
+volatile uint8_t PORTA, PORTB, PORTC, PORTD, PORTE, PORTF, PORTG, PORTH, PORTJ, PORTK, PORTL;
+Timer_counter TCNT1 = {0, &TCCR1B, 0};
+Timer_counter TCNT3 = {0, &TCCR3B, &ICR3};
+Timer_counter TCNT4 = {0, &TCCR4B, &ICR4};
+Timer_counter TCNT5 = {0, &TCCR5B, &ICR5};
+Timer_flags TIFR1 = {0}, TIFR3 = {0}, TIFR4 = {0}, TIFR5 = {0};
+
+// Timers that give runs of steps on their compare outputs, in the order of STEP_TIMER_3 to STEP_TIMER_5
+struct Step_timer
+{
+    volatile uint8_t *control_a;
+    volatile uint8_t *mask;
+    Timer_flags *flags;
+    Timer_counter *counter;
+    volatile uint16_t *compare[3];
+    void (*overflow)(void);
+};
+static const Step_timer step_timers[NR_OF_STEP_TIMERS] = {
+  {&TCCR3A, &TIMSK3, &TIFR3, &TCNT3, {&OCR3A, &OCR3B, &OCR3C}, TIMER3_OVF_vect},
+  {&TCCR4A, &TIMSK4, &TIFR4, &TCNT4, {&OCR4A, &OCR4B, &OCR4C}, TIMER4_OVF_vect},
+  {&TCCR5A, &TIMSK5, &TIFR5, &TCNT5, {&OCR5A, &OCR5B, &OCR5C}, TIMER5_OVF_vect}
+};
+
+static volatile uint8_t * const ports[NR_OF_PORTS] = {
+  &PORTA, &PORTB, &PORTC, &PORTD, &PORTE, &PORTF, &PORTG, &PORTH, &PORTJ, &PORTK, &PORTL
+};
+
+static unsigned long long now = 0; // Virtual time in ticks
+
+unsigned long sim_millis_calls = 0;
+
+// Step pins that are recorded
+struct Watched_hand
+{
+    uint8_t step_port;
+    uint8_t step_mask;
+    uint8_t dir_port;
+    uint8_t dir_mask;
+    bool level;
+};
+static std::vector<Watched_hand> watched;
+static std::vector<Sim_step> steps;
+
+struct Button_press
+{
+    uint8_t pin;
+    unsigned long start;
+    unsigned long duration;
+};
+static std::vector<Button_press> button_presses;
+static int random_pin_value = 0;
+static uint32_t random_context = 1;
+
+static unsigned long rtc_seconds = 0; // Seconds of the day at rtc_time
+static unsigned long long rtc_time = 0;
+static bool rtc_square_wave = false;
+
+// Bus between units on Serial1. A message is a byte with the virtual time it arrives, or only the promise that nothing arrives before that time.
+struct Bus_message
+{
+    unsigned long long time;
+    int data; // -1 for a promise
+};
+
+struct Bus_input
+{
+    int fd;
+    unsigned long long known; // Nothing arrives on this input before this time
+    std::deque<Bus_message> bytes; // In order of arrival
+};
+
+static std::vector<Bus_input> bus_inputs;
+static std::vector<int> bus_outputs;
+static unsigned long bus_byte_ticks = 0; // Time a byte takes on the wire, 0 until Serial1.begin()
+static unsigned long long bus_free = 0; // Time at which the transmitter has sent all that was written
+static const unsigned long long bus_closed = ~0ULL;
+
+static unsigned long long bus_wake(unsigned long long target);
+
+///////////////////////////////////////////////////////////////////////////////// VIRTUAL CLOCK /////////////////////////////////////////////////////////////////////////
+
+static bool timer_running(const Timer_counter &counter) {
+  return *counter.control & (_BV(CS10) | _BV(CS11) | _BV(CS12));
+}
+
+uint16_t Timer_counter::top() {
+  return icr && (*control & _BV(WGM13)) ? *icr : 0xFFFF;
+}
+
+Timer_counter::operator uint16_t() {
+  return uint16_t((now - base) % (top() + 1UL));
+}
+
+Timer_counter &Timer_counter::operator=(uint16_t value) {
+  base = now - value;
+  return *this;
+}
+
+static unsigned long ticks_until(Timer_counter &counter, uint16_t value) {
+  // Ticks until the counter reaches value, a full period if it is there now
+  uint16_t current = counter;
+  unsigned long period = counter.top() + 1UL;
+  return value > current ? value - current : value + period - current;
+}
+
+static bool output_inverted(const Step_timer &timer, int channel) {
+  // Compare output is set at the compare match and cleared at BOTTOM
+  return ((*timer.control_a >> (COM1A0 - 2*channel)) & 0x03) == 0x03;
+}
+
+static void record_timer_step(int timer, int channel) {
+  // Pin of a compare output is driven by the timer, not by its port
+  uint8_t pin = step_timer_pins[timer][channel];
+  for(size_t hand=0; hand<watched.size(); hand++) {
+    Watched_hand &w = watched[hand];
+    if(w.step_port != pin_port(pin) || w.step_mask != pin_mask(pin)) continue;
+    Sim_step step = {now, uint8_t(hand), bool(*ports[w.dir_port] & w.dir_mask)};
+    steps.push_back(step);
+  }
+}
+
+static void record_steps() {
+  // Called before time moves on, so a step pulse is always seen while it is high
+  static uint8_t last_levels[NR_OF_PORTS];
+  bool changed = false;
+  for(uint8_t port=0; port<NR_OF_PORTS; port++) {
+    if(*ports[port] != last_levels[port]) changed = true;
+    last_levels[port] = *ports[port];
+  }
+  if(!changed) return;
+
+  for(size_t hand=0; hand<watched.size(); hand++) {
+    Watched_hand &w = watched[hand];
+    if(!w.step_mask) continue;
+    bool level = *ports[w.step_port] & w.step_mask;
+    if(level && !w.level) {
+      Sim_step step = {now, uint8_t(hand), bool(*ports[w.dir_port] & w.dir_mask)};
+      steps.push_back(step);
+    }
+    w.level = level;
+  }
+}
+
+static unsigned long long square_wave_edge() {
+  // Time of the next edge of the square wave of the RTC: falling when it counts a second, rising halfway
+  if(!rtc_square_wave || !PCMSK2) return ~0ULL;
+  unsigned long half = ticks_per_second / 2;
+  return now + half - (now - rtc_time) % half;
+}
+
+static void update_square_wave() {
+  // Square wave drives the port K pins that have a pin change interrupt
+  if(!rtc_square_wave || !PCMSK2) return;
+  bool high = (now - rtc_time) % ticks_per_second >= ticks_per_second / 2;
+  uint8_t level = high ? PORTK | PCMSK2 : PORTK & ~PCMSK2;
+  if(level == PORTK) return;
+  PORTK = level;
+  PCIFR.flags |= _BV(PCIF2);
+}
+
+static bool run_interrupts() {
+  // Pin change has a higher priority than timer 1, timer 1 than timers 3 to 5, and compare than overflow, like on the AVR. Returns true if an
+  // interrupt ran.
+  bool interrupted = false;
+  while(SREG & 0x80) {
+    void (*vector)(void) = 0;
+    if((PCIFR & _BV(PCIF2)) && (PCICR & _BV(PCIE2))) {
+      PCIFR.flags &= ~_BV(PCIF2);
+      vector = PCINT2_vect;
+    }
+    else if((TIFR1 & _BV(OCF1A)) && (TIMSK1 & _BV(OCIE1A))) {
+      TIFR1.flags &= ~_BV(OCF1A);
+      vector = TIMER1_COMPA_vect;
+    }
+    else if((TIFR1 & _BV(TOV1)) && (TIMSK1 & _BV(TOIE1))) {
+      TIFR1.flags &= ~_BV(TOV1);
+      vector = TIMER1_OVF_vect;
+    }
+    else {
+      for(int timer=0; timer<NR_OF_STEP_TIMERS && !vector; timer++) {
+        const Step_timer &t = step_timers[timer];
+        if(!(*t.flags & _BV(TOV1)) || !(*t.mask & _BV(TOIE1))) continue;
+        t.flags->flags &= ~_BV(TOV1);
+        vector = t.overflow;
+      }
+      if(!vector) break;
+    }
+
+    cli();
+    sim_advance(interrupt_ticks);
+    vector();
+    sei();
+    interrupted = true;
+  }
+  return interrupted;
+}
+
+static void advance_to(unsigned long long target, bool wake_on_interrupt) {
+  while(true) {
+    update_square_wave();
+    if(run_interrupts() && wake_on_interrupt) break;
+    if(now >= target) break;
+
+    // Jump to the next timer event or edge of the square wave, or to the target if that comes first
+    unsigned long long jump = target - now;
+    unsigned long long edge = square_wave_edge();
+    if(edge - now < jump) jump = edge - now;
+    if(timer_running(TCNT1)) {
+      unsigned long to_overflow = ticks_until(TCNT1, 0);
+      unsigned long to_compare = ticks_until(TCNT1, OCR1A);
+      if(to_overflow < jump) jump = to_overflow;
+      if(to_compare < jump) jump = to_compare;
+    }
+    for(int timer=0; timer<NR_OF_STEP_TIMERS; timer++) {
+      const Step_timer &t = step_timers[timer];
+      if(!timer_running(*t.counter)) continue;
+      unsigned long to_top = ticks_until(*t.counter, t.counter->top());
+      if(to_top < jump) jump = to_top;
+      for(int channel=0; channel<3; channel++) {
+        if(!output_inverted(t, channel)) continue;
+        unsigned long to_compare = ticks_until(*t.counter, *t.compare[channel]);
+        if(to_compare < jump) jump = to_compare;
+      }
+    }
+    now += jump;
+
+    if(timer_running(TCNT1)) {
+      uint16_t counter = TCNT1;
+      if(counter == 0) TIFR1.flags |= _BV(TOV1);
+      if(counter == OCR1A) TIFR1.flags |= _BV(OCF1A);
+    }
+    else TCNT1.base += jump; // Counter holds its value while the timer is stopped
+
+    for(int timer=0; timer<NR_OF_STEP_TIMERS; timer++) {
+      const Step_timer &t = step_timers[timer];
+      if(!timer_running(*t.counter)) {
+        t.counter->base += jump;
+        continue;
+      }
+      uint16_t counter = *t.counter;
+      if(counter == t.counter->top()) t.flags->flags |= _BV(TOV1);
+      for(int channel=0; channel<3; channel++) {
+        if(output_inverted(t, channel) && counter == *t.compare[channel]) record_timer_step(timer, channel);
+      }
+    }
+  }
+}
+
+void sim_advance(unsigned long ticks) {
+  record_steps();
+  advance_to(now + ticks, false);
+}
+
+void sleep_mode() {
+  // Idle sleep ends with the next interrupt, of timer 1, of timer 0 that counts millis() every 1024 us or of a byte received on the bus
+  record_steps();
+  advance_to(bus_wake((now / timer0_overflow_ticks + 1) * timer0_overflow_ticks), true);
+}
+
+unsigned long long sim_time() {
+  return now;
+}
+
+unsigned long millis() {
+  sim_millis_calls++;
+  sim_advance(time_read_ticks);
+  return now / (ticks_per_us * 1000);
+}
+
+unsigned long micros() {
+  sim_advance(time_read_ticks);
+  return now / ticks_per_us;
+}
+
+void delay(unsigned long ms) {
+  sim_advance(ms * 1000 * ticks_per_us);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim_advance(us * ticks_per_us);
+}
+
+///////////////////////////////////////////////////////////////////////////////// PINS /////////////////////////////////////////////////////////////////////////
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  if(pin_port(pin) == NO_PORT) return;
+  if(level) *ports[pin_port(pin)] |= pin_mask(pin);
+  else *ports[pin_port(pin)] &= ~pin_mask(pin);
+  sim_advance(digital_write_ticks);
+}
+
+int digitalRead(uint8_t pin) {
+  sim_advance(digital_read_ticks);
+
+  bool button = false;
+  unsigned long ms = now / (ticks_per_us * 1000);
+  for(size_t i=0; i<button_presses.size(); i++) {
+    if(button_presses[i].pin != pin) continue;
+    button = true;
+    if(ms >= button_presses[i].start && ms - button_presses[i].start < button_presses[i].duration) return LOW;
+  }
+  if(button) return HIGH; // Pulled up
+
+  if(pin_port(pin) == NO_PORT) return LOW;
+  return (*ports[pin_port(pin)] & pin_mask(pin)) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  return random_pin_value;
+}
+
+void sim_watch_step_pin(int hand, uint8_t step_pin, uint8_t dir_pin) {
+  if(hand >= int(watched.size())) watched.resize(hand+1);
+  Watched_hand w = {pin_port(step_pin), pin_mask(step_pin), pin_port(dir_pin), pin_mask(dir_pin), false};
+  watched[hand] = w;
+}
+
+const Sim_step *sim_steps(unsigned long &nr_of_steps) {
+  nr_of_steps = steps.size();
+  return steps.data();
+}
+
+void sim_clear_steps() {
+  steps.clear();
+}
+
+void sim_press_button(uint8_t pin, unsigned long start, unsigned long duration) {
+  Button_press press = {pin, start, duration};
+  button_presses.push_back(press);
+}
+
+void sim_set_random_pin(int value) {
+  random_pin_value = value;
+}
+
+///////////////////////////////////////////////////////////////////////////////// RTC /////////////////////////////////////////////////////////////////////////
+
+void sim_set_rtc(int hour, int minute, int second) {
+  rtc_seconds = (unsigned long)hour * 3600 + minute * 60 + second;
+  rtc_time = now;
+  if(rtc_square_wave) PORTK &= ~PCMSK2; // Writing the time starts a new second, without an edge
+}
+
+void sim_rtc_square_wave(bool on) {
+  rtc_square_wave = on;
+}
+
+unsigned long sim_rtc_seconds() {
+  return (rtc_seconds + (now - rtc_time) / ticks_per_second) % 86400;
+}
+
+///////////////////////////////////////////////////////////////////////////////// BUS /////////////////////////////////////////////////////////////////////////
+
+void sim_attach_bus(const int *inputs, int nr_of_inputs, const int *outputs, int nr_of_outputs) {
+  bus_inputs.clear();
+  for(int i=0; i<nr_of_inputs; i++) {
+    Bus_input input;
+    input.fd = inputs[i];
+    input.known = 0;
+    bus_inputs.push_back(input);
+  }
+  bus_outputs.assign(outputs, outputs + nr_of_outputs);
+}
+
+static void bus_send(const Bus_message &message) {
+  for(size_t i=0; i<bus_outputs.size(); i++) {
+    if(write(bus_outputs[i], &message, sizeof(message)) != ssize_t(sizeof(message))) continue; // Unit has finished
+  }
+}
+
+static void bus_receive(Bus_input &input) {
+  // Blocks until a message arrives
+  Bus_message message;
+  size_t received = 0;
+  while(received < sizeof(message)) {
+    ssize_t bytes = read(input.fd, (char *)&message + received, sizeof(message) - received);
+    if(bytes <= 0) {
+      input.known = bus_closed; // Unit has finished, nothing arrives any more
+      return;
+    }
+    received += bytes;
+  }
+  input.known = message.time;
+  if(message.data >= 0) input.bytes.push_back(message);
+}
+
+static bool bus_pending(const Bus_input &input) {
+  if(input.known == bus_closed) return false;
+  pollfd descriptor = {input.fd, POLLIN, 0};
+  return poll(&descriptor, 1, 0) > 0;
+}
+
+static void bus_wait_until(unsigned long long time, bool idle) {
+  // Read the inputs until nothing more can arrive at or before time. Before waiting, promise the other units how long nothing comes from this one:
+  // a byte takes bus_byte_ticks, and a unit that is idle does nothing until time or until a byte wakes it. Units that wait for each other always
+  // promise beyond where the other one waits, so they never wait forever.
+  unsigned long long promised = 0;
+  for(size_t i=0; i<bus_inputs.size(); i++) {
+    while(bus_pending(bus_inputs[i])) bus_receive(bus_inputs[i]);
+  }
+
+  while(true) {
+    // An idle unit wakes at the first byte it has, so it only needs to know up to there
+    unsigned long long until = time;
+    for(size_t i=0; idle && i<bus_inputs.size(); i++) {
+      for(size_t b=0; b<bus_inputs[i].bytes.size(); b++) {
+        if(bus_inputs[i].bytes[b].time > now && bus_inputs[i].bytes[b].time < until) until = bus_inputs[i].bytes[b].time;
+      }
+    }
+    Bus_input *slowest = 0;
+    for(size_t i=0; i<bus_inputs.size(); i++) {
+      if(!slowest || bus_inputs[i].known < slowest->known) slowest = &bus_inputs[i];
+    }
+    if(!slowest || slowest->known > until) return;
+
+    unsigned long long quiet = idle ? slowest->known : now; // Until then this unit sends nothing
+    if(quiet < now) quiet = now;
+    if(quiet < bus_free) quiet = bus_free;
+    if(quiet + bus_byte_ticks > promised) {
+      promised = quiet + bus_byte_ticks;
+      Bus_message promise = {promised, -1};
+      bus_send(promise);
+    }
+    bus_receive(*slowest);
+  }
+}
+
+static Bus_input *bus_first(unsigned long long time) {
+  // Input with the earliest byte that arrived at or before time
+  Bus_input *first = 0;
+  for(size_t i=0; i<bus_inputs.size(); i++) {
+    Bus_input &input = bus_inputs[i];
+    if(input.bytes.empty() || input.bytes.front().time > time) continue;
+    if(!first || input.bytes.front().time < first->bytes.front().time) first = &input;
+  }
+  return first;
+}
+
+static unsigned long long bus_wake(unsigned long long target) {
+  // The receive interrupt ends a sleep when a byte arrives before target
+  if(bus_byte_ticks == 0 || bus_inputs.empty()) return target;
+  bus_wait_until(target, true);
+  for(size_t i=0; i<bus_inputs.size(); i++) {
+    for(size_t b=0; b<bus_inputs[i].bytes.size(); b++) {
+      unsigned long long time = bus_inputs[i].bytes[b].time;
+      if(time > now && time < target) target = time;
+    }
+  }
+  return target;
+}
+
+///////////////////////////////////////////////////////////////////////////////// RANDOM /////////////////////////////////////////////////////////////////////////
+
+void randomSeed(unsigned long seed) {
+  if(seed != 0) random_context = seed;
+}
+
+long random(long howbig) {
+  // Park-Miller generator of avr-libc, so a seed gives the same animations as on the Arduino
+  if(howbig == 0) return 0;
+  long long x = int32_t(random_context);
+  if(x == 0) x = 123459876;
+  long long hi = x / 127773;
+  long long lo = x % 127773;
+  x = 16807 * lo - 2836 * hi;
+  if(x < 0) x += 0x7FFFFFFF;
+  random_context = uint32_t(x);
+  return long(x % howbig);
+}
+
+long random(long howsmall, long howbig) {
+  if(howsmall >= howbig) return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
+
+///////////////////////////////////////////////////////////////////////////////// SERIAL /////////////////////////////////////////////////////////////////////////
+
+void HardwareSerial::print(const char *text) {
+  if(echo) fputs(text, stdout);
+  if(capture) fputs(text, capture);
+}
+
+void HardwareSerial::print(char character) {
+  char text[2] = {character, 0};
+  print(text);
+}
+
+void HardwareSerial::print(long value, int base) {
+  char text[24];
+  snprintf(text, sizeof(text), base == HEX ? "%lX" : "%ld", value);
+  print(text);
+}
+
+void HardwareSerial::print(unsigned long value, int base) {
+  char text[24];
+  snprintf(text, sizeof(text), base == HEX ? "%lX" : "%lu", value);
+  print(text);
+}
+
+void HardwareSerial::print(double value, int digits) {
+  char text[64];
+  snprintf(text, sizeof(text), "%.*f", digits, value);
+  print(text);
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  if(this == &Serial1) bus_byte_ticks = 10 * ticks_per_second / baud; // Start bit, 8 data bits and stop bit
+}
+
+int HardwareSerial::available() {
+  if(this != &Serial1 || bus_byte_ticks == 0) return 0;
+  bus_wait_until(now, false);
+  int bytes = 0;
+  for(size_t i=0; i<bus_inputs.size(); i++) {
+    for(size_t b=0; b<bus_inputs[i].bytes.size() && bus_inputs[i].bytes[b].time <= now; b++) bytes++;
+  }
+  return bytes;
+}
+
+int HardwareSerial::read() {
+  if(this != &Serial1 || bus_byte_ticks == 0) return -1;
+  bus_wait_until(now, false);
+  Bus_input *input = bus_first(now);
+  if(!input) return -1;
+  int data = input->bytes.front().data;
+  input->bytes.pop_front();
+  return data;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  if(this == &Serial1) {
+    if(bus_byte_ticks == 0) return size;
+    for(size_t i=0; i<size; i++) { // Bytes go on the wire one after the other
+      bus_free = (now > bus_free ? now : bus_free) + bus_byte_ticks;
+      Bus_message message = {bus_free, buffer[i]};
+      bus_send(message);
+    }
+    return size;
+  }
+
+  // Binary records are only captured, they would garble the echo
+  if(capture) fwrite(buffer, 1, size, capture);
+  return size;
+}
@@ -0,0 +1,147 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+// Stand-in for the Arduino core, so the clock can run on a host computer against a virtual clock. See sim.cpp.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEC 10
+#define HEX 16
+#define A8 62
+#define A12 66
+#define F_CPU 16000000UL
+
+#define PROGMEM
+#define F(string) (string)
+#define pgm_read_byte(address) (*(address))
+#define pgm_read_word(address) (*(address))
+#define pgm_read_dword(address) (*(address))
+#define memcpy_P memcpy
+
+#define _BV(bit) (1 << (bit))
+#define ISR(vector) extern "C" void vector(void)
+
+// Pin change interrupt of A8 to A15, counts the square wave of the RTC
+#define PCIE2 2
+#define PCIF2 2
+
+// Timer 1 in normal mode, and timers 3, 4 and 5 in fast PWM mode 14 with inverted compare outputs, as the step scheduler uses them. The bits are at
+// the same place in all four.
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define COM1A0 6
+#define COM1A1 7
+#define TOIE1 0
+#define OCIE1A 1
+#define TOV1 0
+#define OCF1A 1
+
+// Timer 5 free running without prescaler, as the cycle profile uses it instead of a step timer. The virtual clock has no prescalers and counts it
+// in ticks of 0.5 us like the other timers.
+#define CS50 0
+#define TOIE5 0
+#define TOV5 0
+
+class Timer_counter
+{
+public:
+    unsigned long long base; // Virtual time at which the counter was zero. Moves along while the timer is stopped, so the counter holds its value.
+    volatile uint8_t *control; // TCCRnB, for the mode
+    volatile uint16_t *icr; // TOP in mode 14, 0 for timer 1
+
+    uint16_t top();
+    operator uint16_t();
+    Timer_counter &operator=(uint16_t value);
+};
+
+class Timer_flags
+{
+public:
+    uint8_t flags;
+    operator uint8_t() { return flags; }
+    Timer_flags &operator=(uint8_t value) { flags &= ~value; return *this; } // Flags are cleared by writing a one
+};
+
+extern Timer_counter TCNT1, TCNT3, TCNT4, TCNT5;
+extern Timer_flags TIFR1, TIFR3, TIFR4, TIFR5;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TCCR3A, TCCR3B, TIMSK3, TCCR4A, TCCR4B, TIMSK4, TCCR5A, TCCR5B, TIMSK5;
+extern volatile uint16_t OCR1A, OCR3A, OCR3B, OCR3C, ICR3, OCR4A, OCR4B, OCR4C, ICR4, OCR5A, OCR5B, OCR5C, ICR5;
+extern volatile uint8_t PCICR, PCMSK2;
+extern Timer_flags PCIFR;
+extern volatile uint8_t SREG;
+extern volatile uint8_t PORTA, PORTB, PORTC, PORTD, PORTE, PORTF, PORTG, PORTH, PORTJ, PORTK, PORTL;
+
+extern "C" void TIMER1_COMPA_vect(void);
+extern "C" void TIMER1_OVF_vect(void);
+extern "C" void TIMER3_OVF_vect(void);
+extern "C" void TIMER4_OVF_vect(void);
+extern "C" void TIMER5_OVF_vect(void);
+extern "C" void PCINT2_vect(void);
+
+inline void cli() { SREG &= ~0x80; }
+inline void sei() { SREG |= 0x80; }
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void randomSeed(unsigned long seed);
+long random(long howbig);
+long random(long howsmall, long howbig);
+
+class HardwareSerial
+{
+public:
+    bool echo; // Print to stdout, silent otherwise
+    FILE *capture; // Everything that is sent, text and telemetry records, is also written here if set
+
+    void begin(unsigned long baud);
+    void flush() {}
+    int available();
+    int read();
+    int availableForWrite() { return 63; } // Port sends instantly
+
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t write(uint8_t data) { return write(&data, 1); }
+
+    void print(const char *text);
+    void print(char character);
+    void print(unsigned char value, int base = DEC) { print((unsigned long)value, base); }
+    void print(int value, int base = DEC) { print((long)value, base); }
+    void print(unsigned int value, int base = DEC) { print((unsigned long)value, base); }
+    void print(long value, int base = DEC);
+    void print(unsigned long value, int base = DEC);
+    void print(double value, int digits = 2);
+
+    void println() { print("\n"); }
+    template<typename T> void println(T value) { print(value); println(); }
+    template<typename T> void println(T value, int format) { print(value, format); println(); }
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1; // Bus between units, see sim_attach_bus()
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef RTClib_h
+#define RTClib_h
+
+// Stand-in for the RTClib library. The RTC is scripted with sim_set_rtc() and runs on with the virtual clock.
+
+#include "Simulation.h"
+
+enum Ds3231SqwPinMode
+{
+    DS3231_OFF = 0x1C,
+    DS3231_SquareWave1Hz = 0x00
+};
+
+class DateTime
+{
+private:
+    uint8_t _hour;
+    uint8_t _minute;
+    uint8_t _second;
+
+public:
+    DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t minute = 0, uint8_t second = 0) : _hour(hour), _minute(minute), _second(second) {}
+
+    uint8_t hour() const { return _hour; }
+    uint8_t minute() const { return _minute; }
+    uint8_t second() const { return _second; }
+};
+
+class RTC_DS3231
+{
+public:
+    static const unsigned long i2c_ticks = 2000; // A read or write of the time over I2C at 100 kHz takes about a milli second
+
+    bool begin() { return true; }
+
+    DateTime now() {
+        sim_advance(i2c_ticks);
+        unsigned long seconds = sim_rtc_seconds();
+        return DateTime(2000, 1, 1, seconds / 3600, seconds / 60 % 60, seconds % 60);
+    }
+
+    void adjust(const DateTime &time) {
+        sim_advance(i2c_ticks);
+        sim_set_rtc(time.hour(), time.minute(), time.second());
+    }
+
+    void writeSqwPinMode(Ds3231SqwPinMode mode) { sim_rtc_square_wave(mode == DS3231_SquareWave1Hz); }
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef Simulation_h
+#define Simulation_h
+
+// Controls of the virtual Arduino, used by sim.cpp and the stand-in RTClib
+
+#include <Arduino.h>
+
+extern unsigned long sim_millis_calls; // Calls of millis(), the run loop of an animation calls it once per iteration
+
+void sim_advance(unsigned long ticks);
+/* Move the virtual clock forward in ticks of 0.5 us, the resolution of timer 1. Interrupts that become due are run. */
+
+unsigned long long sim_time();
+/* Returns the virtual time in ticks since start */
+
+void sim_watch_step_pin(int hand, uint8_t step_pin, uint8_t dir_pin);
+/* Record a timestamp with the direction for each rising edge of the step pin */
+
+void sim_press_button(uint8_t pin, unsigned long start, unsigned long duration);
+/* Hold a button (pulled up, so reading low) from start during duration, both in milli seconds */
+
+void sim_set_random_pin(int value);
+/* Value returned by analogRead(), used as random seed */
+
+struct Sim_step
+{
+    unsigned long long time; // Ticks
+    uint8_t hand;
+    bool direction;
+};
+
+const Sim_step *sim_steps(unsigned long &nr_of_steps);
+/* Returns all recorded steps */
+
+void sim_clear_steps();
+
+void sim_set_rtc(int hour, int minute, int second);
+/* Set the scripted RTC, which runs on from there with the virtual clock */
+
+unsigned long sim_rtc_seconds();
+/* Returns the seconds of the day the scripted RTC is at */
+
+void sim_rtc_square_wave(bool on);
+/* Turn the 1 Hz square wave of the scripted RTC on or off. It drives the port K pins enabled in PCMSK2, falling when the RTC counts a second. */
+
+void sim_attach_bus(const int *inputs, int nr_of_inputs, const int *outputs, int nr_of_outputs);
+/* Connect Serial1 to other processes that simulate units of a wall, see wall.cpp. Bytes written go to all outputs, bytes are read from all inputs.
+Each byte carries the virtual time it arrives, and reading waits for the other units to reach the virtual time of the reader. Virtual time of all units
+starts at zero together. Without a bus Serial1 reads nothing and writes go nowhere. */
+
+#endif
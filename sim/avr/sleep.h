@@ -0,0 +1,13 @@
+#ifndef sleep_h
+#define sleep_h
+
+#include <stdint.h>
+
+// Stand-in for avr/sleep.h, sleeping moves the virtual clock to the next interrupt
+
+#define SLEEP_MODE_IDLE 0
+
+inline void set_sleep_mode(uint8_t mode) {}
+void sleep_mode();
+
+#endif
@@ -0,0 +1,456 @@
+// Checks parts of the step engine against a reference on the host, and fails when they differ:
+// - intervals: every step interval the fixed point engine of Clockhand gives for the planned animations is compared with the float formulas it
+//   replaced, which may differ by at most 1 us. The first movement of every animation is planned at several times of the clock, and the
+//   planners are run on random targets and speeds.
+// - s_curve: S-curve moves on random targets and limits take all their steps, and stay within their speed and acceleration limits.
+// - time_optimal: calculate_animation_time_optimal() on random targets keeps together what its sync policy says, within 1 ms.
+// - blend: Clockhand::blend_junctions() on the planned animations and on random chains of planners keeps the steps of every hand and does not
+//   make any of them take longer.
+//
+// Build from the root of the repository:
+//   g++ -std=gnu++11 -O2 -Isim -I. -o clockcheck sim/check.cpp sim/Arduino.cpp Accelerationcurve.cpp Clockception.cpp Clockhand.cpp Instructionpool.cpp Coordinator.cpp Button.cpp Stepscheduler.cpp Stepoutput.cpp Stepstatistics.cpp Telemetry.cpp Animationscript.cpp Syncbus.cpp Timebase.cpp Cycleprofile.cpp
+//
+// Usage:
+//   clockcheck [-s seed] [-n runs] [check...]
+// with the checks above, all of them without arguments. -n sets the number of random plans per check. Exits with 1 if a check failed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include "Simulation.h"
+#include "Clockception.h"
+#include "Accelerationcurve.h"
+#include "Instructionpool.h"
+#include "settings.h"
+
+// Movement types of the instructions, as in Clockhand.h
+enum
+{
+    ACCELERATE = 0,
+    CRUISE = 1,
+    DECELERATE = 2,
+    DELAY = 3,
+    SWITCH_DIRECTION = 4,
+    S_CURVE = 5,
+    RAMP = 6
+};
+
+// Sync policies of calculate_animation_time_optimal(), as in Clockception.h
+enum
+{
+    SYNC_START = 0,
+    SYNC_ARRIVE = 1,
+    SYNC_INDEPENDENT = 2
+};
+
+static const int animation_numbers[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33};
+static const long minimum_step_interval = 250; // See Clockhand::begin()
+static const long not_checked = -1;
+
+Clockception clockception;
+
+static void usage() {
+  fprintf(stderr, "usage: clockcheck [-s seed] [-n runs] [check...]\n");
+  fprintf(stderr, "checks: intervals s_curve time_optimal blend\n");
+}
+
+static float random_fraction(int percent) {
+  return random(0, percent + 1) / 100.0;
+}
+
+///////////////////////////////////////////////////////////////////////////////// INTERVALS /////////////////////////////////////////////////////////////////////////
+
+static unsigned long reference_curve_interval(const Clockhand &hand, float position, bool stretched) {
+  // Hands had a copy of the default curve scaled with their speed factor, in whole micro seconds. A curve stretched over more steps than it has
+  // intervals is interpolated between them.
+  int index = position;
+  if(index > 99) index = 99;
+  float interval = acceleration_curve_interval(index);
+  if(stretched && index < 99) interval -= (interval - acceleration_curve_interval(index + 1)) * (position - index);
+  return (unsigned long)int(interval * hand._acceleration_speed_factor);
+}
+
+static void reference_intervals(const Clockhand &hand, std::vector<long> &intervals, std::vector<long> &margins) {
+  // Step intervals as calculate_step_interval() worked them out in float before the fixed point engine, per step of the instructions that are set.
+  // Movement types that came after it are not checked, but their steps are counted. The engine interpolates a stretched curve to whole micro
+  // seconds of the default curve with 16 bits of the fraction, less than 1.1 of those apart. Scaled with the curve and rounded to a whole micro
+  // second, a deceleration then multiplies that with its own factor and rounds once more. That is the margin of the step.
+  for(uint8_t index=const_cast<Clockhand &>(hand).first_instruction(); index!=NO_INSTRUCTION; index=instruction_pool.next(index)) {
+    const Instruction &instruction = instruction_pool.get(index);
+    float step_factor = 100/float(instruction.steps);
+    bool stretched = instruction.steps > 100;
+
+    for(unsigned int step=0; step<instruction.steps; step++) {
+      long interval;
+      if(instruction.type == ACCELERATE) interval = reference_curve_interval(hand, step * step_factor, stretched);
+      else if(instruction.type == DECELERATE) interval = (unsigned long)(reference_curve_interval(hand, (instruction.steps - step) * step_factor, stretched) * hand._accel_vs_decel_speed_factor);
+      else if(instruction.type == CRUISE) interval = instruction.speed + 4;
+      else if(instruction.type == DELAY) interval = instruction.speed;
+      else if(instruction.type == SWITCH_DIRECTION) interval = 0;
+      else interval = not_checked;
+
+      if(interval != not_checked && interval < minimum_step_interval) interval = minimum_step_interval;
+      intervals.push_back(interval);
+      bool curve = instruction.type == ACCELERATE || instruction.type == DECELERATE;
+      float decel_factor = instruction.type == DECELERATE ? hand._accel_vs_decel_speed_factor : 1;
+      margins.push_back(curve && stretched ? 1 + long(ceil((1.1 * hand._acceleration_speed_factor + 1) * decel_factor)) : 1);
+    }
+
+    if(instruction.type == SWITCH_DIRECTION) { // The instruction after a switch is skipped, see Clockhand::get_next_instruction()
+      index = instruction_pool.next(index);
+      if(index == NO_INSTRUCTION) break;
+    }
+  }
+  if(!intervals.empty()) intervals[0] = 0; // First step is taken at the start of the movement
+}
+
+static bool compare_intervals(const char *plan, unsigned long &checked_steps, long &worst, unsigned long &interpolated_steps) {
+  bool ok = true;
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    std::vector<long> reference, margins;
+    reference_intervals(*clockception.get_hand(hand), reference, margins);
+
+    // Step through a copy, like Clockhand::planned_duration(), so the plan stays as it is
+    Clockhand copy = *clockception.get_hand(hand);
+    unsigned long interval;
+    byte flags;
+    unsigned int count;
+    size_t step = 0;
+    copy.start_movement();
+    while(copy.next_steps(interval, flags, count)) {
+      for(unsigned int i=0; i<count; i++, step++) {
+        if(step >= reference.size()) break;
+        if(reference[step] == not_checked) continue;
+        long difference = labs(long(interval) - reference[step]);
+        checked_steps++;
+        if(margins[step] > 1) interpolated_steps++;
+        else if(difference > worst) worst = difference;
+        if(difference > margins[step] && ok) {
+          printf("  %s: hand %d step %lu is %lu us, the float formula gives %ld us, %ld us apart at most\n", plan, hand, (unsigned long)step, interval,
+                 reference[step], margins[step]);
+          ok = false;
+        }
+      }
+    }
+    if(step != reference.size()) {
+      printf("  %s: hand %d takes %lu steps, its instructions have %lu\n", plan, hand, (unsigned long)step, (unsigned long)reference.size());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+static void set_random_targets() {
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    clockception.get_hand(hand)->target_position = random(0, steps_per_revolution);
+    clockception.get_hand(hand)->set_direction(random(0, 2));
+  }
+}
+
+static bool check_intervals(int runs) {
+  bool ok = true;
+  unsigned long checked_steps = 0;
+  unsigned long interpolated_steps = 0;
+  long worst = 0;
+  char plan[64];
+
+  // First movement of each animation, as planned ahead
+  for(unsigned int i=0; i<sizeof(animation_numbers)/sizeof(animation_numbers[0]); i++) {
+    for(int minute=0; minute<720; minute+=97) {
+      clockception.plan_animation(animation_numbers[i], minute / 60, minute % 60);
+      snprintf(plan, sizeof(plan), "animation %d at %02d:%02d", animation_numbers[i], minute / 60, minute % 60);
+      ok = compare_intervals(plan, checked_steps, worst, interpolated_steps) && ok;
+    }
+  }
+  clockception.plan_animation(0, 0, 0); // There is no animation 0, this only drops the last plan
+
+  // Planners on random targets, speeds and curve fractions
+  for(int run=0; run<runs; run++) {
+    set_random_targets();
+    char extra_rotations = random(0, 2);
+    unsigned int max_speed = random(100, 1000);
+    float accel = random_fraction(60);
+    float decel = random_fraction(60);
+    switch(run % 4) {
+      case 0:
+        clockception.calculate_animation_equal_duration(extra_rotations, max_speed, accel, decel);
+        break;
+      case 1:
+        clockception.calculate_animation_with_delays(extra_rotations, max_speed, accel, decel, random(0, 2));
+        break;
+      case 2:
+        clockception.calculate_animation_with_delays(extra_rotations, max_speed, 1.0, 0.0, true);
+        clockception.calculate_run_with_same_speed(random(1, 2*steps_per_revolution), max_speed);
+        clockception.show_time_equal_duration(random(0, 24), random(0, 60), 0, max_speed, 0.0, decel);
+        break;
+      case 3:
+        clockception.show_time_with_delays(random(0, 24), random(0, 60), extra_rotations, max_speed, accel, decel);
+        break;
+    }
+    snprintf(plan, sizeof(plan), "random plan %d", run);
+    ok = compare_intervals(plan, checked_steps, worst, interpolated_steps) && ok;
+    clockception.clear_all_instructions();
+  }
+
+  printf("intervals: %lu steps, largest difference %ld us, %lu of them interpolated: %s\n", checked_steps, worst, interpolated_steps, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////// S-CURVE /////////////////////////////////////////////////////////////////////////
+
+static double step_times(Clockhand hand, std::vector<double> &times) {
+  // Time of every step in micro seconds from the start of the movement, from a copy so the plan stays as it is. Returns the end of the last
+  // instruction, a delay included.
+  unsigned long interval;
+  byte flags;
+  unsigned int count;
+  double time = 0;
+  hand.start_movement();
+  while(hand.next_steps(interval, flags, count)) {
+    for(unsigned int i=0; i<count; i++) {
+      time += interval;
+      if(flags & Stepscheduler::STEP_PULSE) times.push_back(time);
+    }
+  }
+  return time;
+}
+
+static double peak_acceleration(const std::vector<double> &times, unsigned int limit) {
+  // Velocity of each interval is taken at its middle. Intervals are whole micro seconds, which changes a velocity v by up to v^2/1000000 steps/s,
+  // so the acceleration is measured over a window long enough to keep that below 1 % of the limit, and at least 20 ms.
+  double peak = 0;
+  size_t j = 2;
+  for(size_t i=1; i+1<times.size(); i++) {
+    double middle_i = (times[i-1] + times[i]) / 2;
+    double velocity_i = 1000000.0 / (times[i] - times[i-1]);
+    double window = 100 * velocity_i * velocity_i / limit;
+    if(window < 20000) window = 20000;
+    if(j <= i) j = i+1;
+    while(j < times.size() && (times[j-1] + times[j]) / 2 - middle_i < window) j++;
+    if(j >= times.size()) break;
+    double middle_j = (times[j-1] + times[j]) / 2;
+    double velocity_j = 1000000.0 / (times[j] - times[j-1]);
+    double acceleration = fabs(velocity_j - velocity_i) / (middle_j - middle_i) * 1000000.0;
+    if(acceleration > peak) peak = acceleration;
+  }
+  return peak;
+}
+
+static bool check_s_curve(int runs) {
+  // Speed and acceleration as the steps are taken, with whole micro second intervals, must stay at or below the limits
+  bool ok = true;
+  unsigned long moves = 0;
+  double worst_speed = 0;
+  double worst_acceleration = 0;
+
+  for(int run=0; run<runs; run++) {
+    set_random_targets();
+    char extra_rotations = random(0, 2);
+    unsigned int max_speed = random(100, 1001);
+    unsigned int acceleration = random(100, 5001);
+    unsigned long jerk = random(1, 501) * 100UL;
+    clockception.calculate_animation_s_curve(extra_rotations, max_speed, acceleration, jerk);
+
+    for(int hand=0; hand<nr_of_hands; hand++) {
+      const Clockhand &planned = *clockception.get_hand(hand);
+      if(planned.steps_to_take == 0) continue;
+      std::vector<double> times;
+      step_times(planned, times);
+      moves++;
+
+      double fastest = 0;
+      for(size_t i=1; i<times.size(); i++) {
+        double speed = 1000000.0 / (times[i] - times[i-1]);
+        if(speed > fastest) fastest = speed;
+      }
+      double speed_part = fastest / max_speed;
+      double acceleration_part = peak_acceleration(times, acceleration) / acceleration;
+      if(speed_part > worst_speed) worst_speed = speed_part;
+      if(acceleration_part > worst_acceleration) worst_acceleration = acceleration_part;
+
+      bool arrives = times.size() == (size_t)planned.steps_to_take && planned.virtual_position == planned.target_position;
+      if(ok && (!arrives || !(speed_part <= 1) || !(acceleration_part <= 1))) {
+        printf("  run %d hand %d: %lu of %u steps to %d, %.0f steps/s of %u, %.0f steps/s^2 of %u with jerk %lu\n", run, hand, (unsigned long)times.size(),
+               planned.steps_to_take, planned.target_position, fastest, max_speed, acceleration_part * acceleration, acceleration, jerk);
+        ok = false;
+      }
+    }
+    clockception.clear_all_instructions();
+  }
+
+  printf("s_curve: %lu moves, top speed %.1f %% and acceleration %.1f %% of the limits: %s\n", moves, 100 * worst_speed, 100 * worst_acceleration, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////// TIME OPTIMAL /////////////////////////////////////////////////////////////////////////
+
+static bool check_time_optimal(int runs) {
+  // What the sync policy keeps together: the end of the plan with SYNC_START, so the next movement starts together, the last step with
+  // SYNC_ARRIVE and the first step with SYNC_INDEPENDENT. A delay step is at least the minimum step interval, so 1 ms covers its rounding.
+  static const double skew_margin = 1000;
+  static const char *const policies[3] = {"start", "arrive", "independent"};
+  bool ok = true;
+  double worst[3] = {0, 0, 0};
+
+  for(int run=0; run<runs; run++) {
+    set_random_targets();
+    uint8_t sync = run % 3;
+    clockception.calculate_animation_time_optimal(random(0, 2), sync);
+
+    double earliest = 0, latest = 0;
+    int earliest_hand = -1, latest_hand = -1;
+    for(int hand=0; hand<nr_of_hands; hand++) {
+      const Clockhand &planned = *clockception.get_hand(hand);
+      if(planned.steps_to_take == 0 && sync != SYNC_START) continue;
+      std::vector<double> times;
+      double end = step_times(planned, times);
+      if(times.size() != (size_t)planned.steps_to_take || planned.virtual_position != planned.target_position) {
+        printf("  run %d hand %d: %lu of %u steps to %d\n", run, hand, (unsigned long)times.size(), planned.steps_to_take, planned.target_position);
+        ok = false;
+      }
+      double kept = sync == SYNC_START ? end : times.empty() ? 0 : sync == SYNC_ARRIVE ? times.back() : times.front();
+      if(earliest_hand < 0 || kept < earliest) {
+        earliest = kept;
+        earliest_hand = hand;
+      }
+      if(latest_hand < 0 || kept > latest) {
+        latest = kept;
+        latest_hand = hand;
+      }
+    }
+
+    double skew = latest - earliest;
+    if(skew > worst[sync]) worst[sync] = skew;
+    if(ok && skew > skew_margin) {
+      printf("  run %d sync %s: hand %d (%u steps) at %.3f s, hand %d (%u steps) at %.3f s\n", run, policies[sync],
+             earliest_hand, clockception.get_hand(earliest_hand)->steps_to_take, earliest / 1e6,
+             latest_hand, clockception.get_hand(latest_hand)->steps_to_take, latest / 1e6);
+      ok = false;
+    }
+    clockception.clear_all_instructions();
+  }
+
+  printf("time_optimal: %d plans, largest skew %.3f ms start, %.3f ms arrive, %.3f ms independent: %s\n", runs, worst[0] / 1000, worst[1] / 1000,
+         worst[2] / 1000, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////// BLEND /////////////////////////////////////////////////////////////////////////
+
+static bool compare_blend(const char *plan, unsigned long &hands, double &gained) {
+  // Each hand is stepped through before and after blend_junctions(), it must take the same steps and not take longer. Ramp intervals are
+  // rounded to whole micro seconds, 1 ms covers that.
+  static const double margin = 1000;
+  bool ok = true;
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    Clockhand *planned = clockception.get_hand(hand);
+    std::vector<double> times_before, times_after;
+    double before = step_times(*planned, times_before);
+    planned->blend_junctions();
+    double after = step_times(*planned, times_after);
+    hands++;
+    if(before - after > gained) gained = before - after;
+    if(ok && (times_after.size() != times_before.size() || after > before + margin)) {
+      printf("  %s: hand %d takes %lu steps in %.3f s, %lu steps in %.3f s without the blend\n", plan, hand, (unsigned long)times_after.size(),
+             after / 1e6, (unsigned long)times_before.size(), before / 1e6);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+static bool check_blend(int runs) {
+  bool ok = true;
+  unsigned long hands = 0;
+  double gained = 0;
+  char plan[64];
+
+  for(unsigned int i=0; i<sizeof(animation_numbers)/sizeof(animation_numbers[0]); i++) {
+    for(int minute=0; minute<720; minute+=97) {
+      clockception.plan_animation(animation_numbers[i], minute / 60, minute % 60);
+      snprintf(plan, sizeof(plan), "animation %d at %02d:%02d", animation_numbers[i], minute / 60, minute % 60);
+      ok = compare_blend(plan, hands, gained) && ok;
+    }
+  }
+  clockception.plan_animation(0, 0, 0);
+
+  // Chains of planners, the joins blend_junctions() rewrites
+  for(int run=0; run<runs; run++) {
+    set_random_targets();
+    unsigned int max_speed = random(100, 1000);
+    clockception.calculate_animation_with_delays(random(0, 2), max_speed, random_fraction(100), random_fraction(60), random(0, 2));
+    clockception.calculate_run_with_same_speed(random(1, 2*steps_per_revolution), random(100, 1000));
+    if(run % 2) clockception.calculate_run_with_same_speed(random(1, 2*steps_per_revolution), random(100, 1000));
+    clockception.show_time_equal_duration(random(0, 24), random(0, 60), 0, max_speed, random_fraction(60), random_fraction(60));
+    snprintf(plan, sizeof(plan), "random plan %d", run);
+    ok = compare_blend(plan, hands, gained) && ok;
+    clockception.clear_all_instructions();
+  }
+
+  printf("blend: %lu hands, none longer, largest gain %.3f s: %s\n", hands, gained / 1e6, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////// MAIN /////////////////////////////////////////////////////////////////////////
+
+struct Check
+{
+    const char *name;
+    bool (*run)(int runs);
+};
+
+static const Check checks[] = {
+  {"intervals", check_intervals},
+  {"s_curve", check_s_curve},
+  {"time_optimal", check_time_optimal},
+  {"blend", check_blend}
+};
+static const int nr_of_checks = sizeof(checks) / sizeof(checks[0]);
+
+static int find_check(const char *name) {
+  for(int i=0; i<nr_of_checks; i++) {
+    if(strcmp(checks[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  unsigned long seed = 1;
+  int runs = 200;
+
+  int i = 1;
+  for(; i<argc && argv[i][0] == '-'; i++) {
+    if(i+1 >= argc) {
+      usage();
+      return 1;
+    }
+    if(strcmp(argv[i], "-s") == 0) seed = strtoul(argv[++i], 0, 10);
+    else if(strcmp(argv[i], "-n") == 0) runs = atoi(argv[++i]);
+    else {
+      usage();
+      return 1;
+    }
+  }
+  std::vector<int> selected;
+  for(int j=i; j<argc; j++) {
+    int check = find_check(argv[j]);
+    if(check < 0) {
+      fprintf(stderr, "unknown check %s\n", argv[j]);
+      usage();
+      return 1;
+    }
+    selected.push_back(check);
+  }
+  if(selected.empty()) {
+    for(int check=0; check<nr_of_checks; check++) selected.push_back(check);
+  }
+
+  sim_set_rtc(6, 29, 55);
+  clockception.init();
+  randomSeed(seed);
+
+  bool ok = true;
+  for(size_t j=0; j<selected.size(); j++) ok = checks[selected[j]].run(runs) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+// Turns what the clock sends over serial into a readable log. Text is passed through, telemetry records (see Telemetry.h) are printed one per line.
+//
+// Build from the root of the repository:
+//   g++ -std=gnu++11 -O2 -Isim -I. -o telemetrydecode sim/decode.cpp
+//
+// Usage:
+//   telemetrydecode [serial.bin]
+// reads standard input without a file, e.g. straight from the serial port at serial_baud of settings.h.
+
+#include <stdio.h>
+#include "Telemetry.h"
+
+static void print_record(const uint8_t *bytes) {
+  uint8_t type = bytes[1];
+  uint8_t id = bytes[2];
+  unsigned long value = (unsigned long)bytes[3] | (unsigned long)bytes[4] << 8 | (unsigned long)bytes[5] << 16 | (unsigned long)bytes[6] << 24;
+
+  switch(type) {
+    case TELEMETRY_ANIMATION_START: printf("animation %u start at %lu ms\n", id, value); break;
+    case TELEMETRY_ANIMATION_STOP: printf("animation %u stop after %lu ms\n", id, value); break;
+    case TELEMETRY_ANIMATION_LOOPS: printf("animation %u ran %lu loops\n", id, value); break;
+    case TELEMETRY_ANIMATION_SKIPPED: printf("animation %u skipped, does not fit in the instruction pool\n", id); break;
+    case TELEMETRY_ANIMATION_TIMEOUT: printf("animation %u forced to finish\n", id); break;
+    case TELEMETRY_TIME: printf("time %02lu:%02lu\n", value >> 8, value & 0xFF); break;
+    case TELEMETRY_TIME_SET: printf("time set to %02lu:%02lu\n", value >> 8, value & 0xFF); break;
+    case TELEMETRY_HAND_POSITION: printf("hand %u at position %lu\n", id, value); break;
+    case TELEMETRY_POOL_FULL: printf("hand %u instruction pool is full\n", id); break;
+    case TELEMETRY_DROPPED: printf("%lu records dropped\n", value); break;
+    case TELEMETRY_STEPS_UNDERFLOW: printf("hand %u steps underflow in animation %lu\n", id, value); break;
+    case TELEMETRY_BUS_LATENCY:
+      if(value == 0xFFFFFFFF) printf("unit %u does not answer on the bus\n", id);
+      else printf("unit %u latency %lu us\n", id, value);
+      break;
+    case TELEMETRY_BUS_SILENT: printf("master is silent, running on own RTC\n"); break;
+    case TELEMETRY_TIME_DRIFT: printf("time was %ld s off from the RTC\n", long(int32_t(value))); break;
+    case TELEMETRY_MOVEMENT_PREDICTED: printf("animation %u movement planned for %lu ms\n", id, value); break;
+    case TELEMETRY_MOVEMENT_SCALED: printf("animation %u movement sped up to %lu%% to fit the budget\n", id, value); break;
+    default: printf("unknown record type %u id %u value %lu\n", type, id, value); break;
+  }
+}
+
+int main(int argc, char **argv) {
+  FILE *input = stdin;
+  if(argc > 1) {
+    input = fopen(argv[1], "rb");
+    if(!input) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+
+  // Text never contains the sync byte, so a record starts at every sync byte. Records with a bad checksum are skipped.
+  uint8_t bytes[TELEMETRY_RECORD_SIZE];
+  int length = 0;
+  int c;
+  while((c = fgetc(input)) != EOF) {
+    if(length == 0) {
+      if(c == TELEMETRY_SYNC) bytes[length++] = c;
+      else putchar(c);
+      continue;
+    }
+
+    bytes[length++] = c;
+    if(length < TELEMETRY_RECORD_SIZE) continue;
+    length = 0;
+
+    uint8_t checksum = 0;
+    for(int i=1; i<TELEMETRY_RECORD_SIZE-1; i++) checksum += bytes[i];
+    if(checksum == bytes[TELEMETRY_RECORD_SIZE-1]) print_record(bytes);
+    else printf("record with bad checksum\n");
+    fflush(stdout);
+  }
+
+  if(input != stdin) fclose(input);
+  return 0;
+}
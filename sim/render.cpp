@@ -0,0 +1,212 @@
+// Renders an animation of the clock to SVG frames, to preview it without flashing the Arduino. The animation runs once against the virtual clock,
+// like clocksim, which gives the time and direction of every step. Frames are then drawn from those steps at a fixed frame rate, spread over threads.
+//
+// Build from the root of the repository:
+//   g++ -std=gnu++11 -O2 -pthread -Isim -I. -o clockrender sim/render.cpp sim/Arduino.cpp Accelerationcurve.cpp Clockception.cpp Clockhand.cpp Instructionpool.cpp Coordinator.cpp Button.cpp Stepscheduler.cpp Stepoutput.cpp Stepstatistics.cpp Telemetry.cpp Animationscript.cpp Syncbus.cpp Timebase.cpp Cycleprofile.cpp
+//
+// Usage:
+//   clockrender [-t hh:mm:ss] [-s seed] [-r fps] [-j jobs] [-w width] [-o prefix] animation
+// with the animation as in clocksim. Writes prefix_00000.svg and on, frame 0 at the start of the animation and the last one after its last step.
+// The prefix is the name of the animation by default. Turn the frames into a video with e.g. ffmpeg -framerate 60 -i long_1_%05d.svg long_1.mp4
+//
+// The firmware uses globals, so it runs on the main thread only. The threads only read the steps it recorded.
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "Simulation.h"
+#include "Clockception.h"
+#include "Clockgeometry.h"
+#include "settings.h"
+
+struct Animation
+{
+    const char *name;
+    int number;
+};
+
+static const Animation animations[] = {
+  {"long_1", 1}, {"long_2", 2}, {"long_3", 3}, {"long_4", 4}, {"long_5", 5}, {"long_6", 6}, {"long_7", 7},
+  {"long_8", 8}, {"long_9", 9}, {"long_10", 10}, {"long_11", 11}, {"long_12", 12}, {"long_13", 13},
+  {"short_1", 21}, {"short_2", 22}, {"short_3", 23}, {"short_4", 24}, {"short_5", 25}, {"short_6", 26}, {"short_7", 27},
+  {"short_8", 28}, {"short_9", 29}, {"short_10", 30}, {"short_11", 31}, {"short_12", 32}, {"short_13", 33}
+};
+static const int nr_of_animations = sizeof(animations) / sizeof(animations[0]);
+
+static const double ticks_per_s = 2000000.0;
+
+// Clocks are drawn at their place in Clockgeometry.h
+static const int nr_of_clocks = nr_of_hands / 2;
+static const double clock_radius = 0.6;
+static const double hand_length = 0.52;
+
+Clockception clockception;
+
+// Position of a hand after each of its steps, so a frame looks up a hand with a binary search on the times
+struct Hand_track
+{
+    int start_position;
+    std::vector<unsigned long long> times; // Ticks since the start of the animation
+    std::vector<int> positions;
+};
+
+static std::vector<Hand_track> tracks(nr_of_hands);
+
+static int find_animation(const char *name) {
+  for(int i=0; i<nr_of_animations; i++) {
+    if(strcmp(animations[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: clockrender [-t hh:mm:ss] [-s seed] [-r fps] [-j jobs] [-w width] [-o prefix] animation\n");
+  fprintf(stderr, "animations:");
+  for(int i=0; i<nr_of_animations; i++) fprintf(stderr, " %s", animations[i].name);
+  fprintf(stderr, "\n");
+}
+
+static void record_tracks(unsigned long long start) {
+  unsigned long nr_of_steps;
+  const Sim_step *steps = sim_steps(nr_of_steps);
+  std::vector<int> positions(nr_of_hands);
+  for(int hand=0; hand<nr_of_hands; hand++) positions[hand] = tracks[hand].start_position;
+
+  for(unsigned long i=0; i<nr_of_steps; i++) {
+    int hand = steps[i].hand;
+    bool clockwise = steps[i].direction != motor_inverted[hand]; // Level of the direction pin, see Clockhand::set_direction()
+    positions[hand] = (positions[hand] + (clockwise ? 1 : steps_per_revolution - 1)) % steps_per_revolution;
+    tracks[hand].times.push_back(steps[i].time - start);
+    tracks[hand].positions.push_back(positions[hand]);
+  }
+}
+
+static int position_at(const Hand_track &track, unsigned long long time) {
+  size_t taken = std::upper_bound(track.times.begin(), track.times.end(), time) - track.times.begin();
+  return taken == 0 ? track.start_position : track.positions[taken-1];
+}
+
+static bool write_frame(const char *prefix, int frame, unsigned long long time, int width) {
+  char name[512];
+  snprintf(name, sizeof(name), "%s_%05d.svg", prefix, frame);
+  FILE *svg = fopen(name, "w");
+  if(!svg) {
+    perror(name);
+    return false;
+  }
+
+  fprintf(svg, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"-3 -3 6 6\">\n", width, width);
+  fprintf(svg, "<rect x=\"-3\" y=\"-3\" width=\"6\" height=\"6\" fill=\"#202020\"/>\n");
+  for(int clock=0; clock<nr_of_clocks; clock++) {
+    double clock_x = clock_places[clock].x;
+    double clock_y = clock_places[clock].y;
+    fprintf(svg, "<circle cx=\"%g\" cy=\"%g\" r=\"%g\" fill=\"#f0f0f0\"/>\n", clock_x, clock_y, clock_radius);
+    for(int hand=2*clock; hand<2*clock+2; hand++) {
+      // Position 0 points up, positions count clockwise seen from the front
+      double angle = 2 * M_PI * position_at(tracks[hand], time) / steps_per_revolution;
+      fprintf(svg, "<line x1=\"%g\" y1=\"%g\" x2=\"%.4f\" y2=\"%.4f\" stroke=\"#%s\" stroke-width=\"0.07\" stroke-linecap=\"round\"/>\n",
+              clock_x, clock_y, clock_x + hand_length * sin(angle), clock_y - hand_length * cos(angle),
+              hand % 2 == 0 ? "202020" : "404040");
+    }
+  }
+  fprintf(svg, "<text x=\"-2.9\" y=\"2.9\" font-size=\"0.2\" fill=\"#f0f0f0\">%.3f s</text>\n</svg>\n", time / ticks_per_s);
+  return fclose(svg) == 0;
+}
+
+static void render_frames(const char *prefix, int first, int step, int nr_of_frames, double fps, unsigned long long end, int width, bool *ok) {
+  for(int frame=first; frame<nr_of_frames; frame+=step) {
+    unsigned long long time = std::min(end, (unsigned long long)(frame / fps * ticks_per_s));
+    if(!write_frame(prefix, frame, time, width)) {
+      *ok = false;
+      return;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int hour = 6, minute = 29, second = 55;
+  unsigned long seed = 1;
+  double fps = 60;
+  int jobs = int(sysconf(_SC_NPROCESSORS_ONLN));
+  int width = 600;
+  const char *prefix = 0;
+
+  int i = 1;
+  for(; i<argc && argv[i][0] == '-'; i++) {
+    if(i+1 >= argc) {
+      usage();
+      return 1;
+    }
+    if(strcmp(argv[i], "-t") == 0) sscanf(argv[++i], "%d:%d:%d", &hour, &minute, &second);
+    else if(strcmp(argv[i], "-s") == 0) seed = strtoul(argv[++i], 0, 10);
+    else if(strcmp(argv[i], "-r") == 0) fps = atof(argv[++i]);
+    else if(strcmp(argv[i], "-j") == 0) jobs = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-w") == 0) width = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-o") == 0) prefix = argv[++i];
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if(i != argc-1 || fps <= 0) {
+    usage();
+    return 1;
+  }
+  int animation = find_animation(argv[i]);
+  if(animation < 0) {
+    fprintf(stderr, "unknown animation %s\n", argv[i]);
+    usage();
+    return 1;
+  }
+  if(!prefix) prefix = animations[animation].name;
+  if(jobs < 1) jobs = 1;
+
+  sim_set_rtc(hour, minute, second);
+  sim_set_random_pin(seed);
+  for(int hand=0; hand<nr_of_hands; hand++) sim_watch_step_pin(hand, motors[hand][0], motors[hand][1]);
+
+  // Same start up as setup() and run() in main.cpp
+  clockception.init();
+  randomSeed(analogRead(unused_pin));
+  clockception.wait_for_new_minute();
+
+  for(int hand=0; hand<nr_of_hands; hand++) tracks[hand].start_position = clockception.get_hand(hand)->current_position;
+  sim_clear_steps();
+  unsigned long long start = sim_time();
+  clockception.play_animation(animations[animation].number);
+  record_tracks(start);
+
+  unsigned long long end = 0;
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    if(!tracks[hand].times.empty()) end = std::max(end, tracks[hand].times.back());
+    int position = position_at(tracks[hand], end);
+    if(position != int(clockception.get_hand(hand)->current_position)) {
+      fprintf(stderr, "hand %d ends at %d in the frames, the firmware has it at %u\n", hand, position, clockception.get_hand(hand)->current_position);
+    }
+  }
+  int nr_of_frames = int(ceil(end / ticks_per_s * fps)) + 1;
+
+  struct timespec host_start, host_end;
+  clock_gettime(CLOCK_MONOTONIC, &host_start);
+  std::vector<std::thread> workers;
+  bool *ok = new bool[jobs];
+  for(int job=0; job<jobs; job++) {
+    ok[job] = true;
+    workers.push_back(std::thread(render_frames, prefix, job, jobs, nr_of_frames, fps, end, width, &ok[job]));
+  }
+  bool all_ok = true;
+  for(int job=0; job<jobs; job++) {
+    workers[job].join();
+    all_ok = all_ok && ok[job];
+  }
+  delete[] ok;
+  clock_gettime(CLOCK_MONOTONIC, &host_end);
+
+  double host_seconds = (host_end.tv_sec - host_start.tv_sec) + (host_end.tv_nsec - host_start.tv_nsec) / 1e9;
+  printf("%s: %.3f s, %d frames at %g fps on %d threads in %.2f s\n", animations[animation].name, end / ticks_per_s, nr_of_frames, fps, jobs, host_seconds);
+  return all_ok ? 0 : 1;
+}
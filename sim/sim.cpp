@@ -0,0 +1,206 @@
+// Runs animations of the clock on a host computer against a virtual clock, far faster than real time.
+// Clockception, Clockhand, Button and the step scheduler are compiled unchanged against the stand-ins in this folder.
+//
+// Build from the root of the repository:
+//   g++ -std=gnu++11 -O2 -Isim -I. -o clocksim sim/sim.cpp sim/Arduino.cpp Accelerationcurve.cpp Clockception.cpp Clockhand.cpp Instructionpool.cpp Coordinator.cpp Button.cpp Stepscheduler.cpp Stepoutput.cpp Stepstatistics.cpp Telemetry.cpp Animationscript.cpp Syncbus.cpp Timebase.cpp Cycleprofile.cpp
+//
+// Usage:
+//   clocksim [-t hh:mm:ss] [-s seed] [-b pin:start_ms:duration_ms] [-o steps.csv] [-T serial.bin] [-v] [-S] [-p] [-P] animation...
+// with animations as long_1 to long_13 and short_1 to short_13. Each animation starts on a new minute of the scripted RTC, like run() does.
+// -p plans each animation while waiting for its minute, like run() does, instead of when the minute starts.
+// -P plays the fixed set of Clockception::benchmark() first and prints its cycle profile, if CYCLE_PROFILE is defined in Cycleprofile.h. The
+// counts are virtual time in ticks of 0.5 us, so they only cover the calls into the Arduino core; they check that the profile builds and runs.
+// -S prints the step statistics of the firmware at the end, as sent over serial on the Arduino.
+// -T writes everything the firmware sends over serial, text and telemetry records, to a file. Read it with telemetrydecode, see decode.cpp.
+//
+// Only calls into the Arduino core take virtual time, so the loop rate is an upper bound of the real one. Compare it between changes, not with the hardware.
+
+#include <stdio.h>
+#include <time.h>
+#include "Simulation.h"
+#include "Clockception.h"
+#include "Stepstatistics.h"
+#include "Telemetry.h"
+#include "settings.h"
+
+struct Animation
+{
+    const char *name;
+    int number;
+};
+
+static const Animation animations[] = {
+  {"long_1", 1}, {"long_2", 2}, {"long_3", 3}, {"long_4", 4}, {"long_5", 5}, {"long_6", 6}, {"long_7", 7},
+  {"long_8", 8}, {"long_9", 9}, {"long_10", 10}, {"long_11", 11}, {"long_12", 12}, {"long_13", 13},
+  {"short_1", 21}, {"short_2", 22}, {"short_3", 23}, {"short_4", 24}, {"short_5", 25}, {"short_6", 26}, {"short_7", 27},
+  {"short_8", 28}, {"short_9", 29}, {"short_10", 30}, {"short_11", 31}, {"short_12", 32}, {"short_13", 33}
+};
+static const int nr_of_animations = sizeof(animations) / sizeof(animations[0]);
+
+static const double ticks_per_us = 2.0;
+
+Clockception clockception;
+
+static int find_animation(const char *name) {
+  for(int i=0; i<nr_of_animations; i++) {
+    if(strcmp(animations[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: clocksim [-t hh:mm:ss] [-s seed] [-b pin:start_ms:duration_ms] [-o steps.csv] [-T serial.bin] [-v] [-S] [-p] [-P] [animation...]\n");
+  fprintf(stderr, "animations:");
+  for(int i=0; i<nr_of_animations; i++) fprintf(stderr, " %s", animations[i].name);
+  fprintf(stderr, "\n");
+}
+
+static void report(const char *name, unsigned long long start, unsigned long long end, unsigned long loops, double host_seconds, FILE *csv) {
+  unsigned long nr_of_steps;
+  const Sim_step *steps = sim_steps(nr_of_steps);
+  double duration = (end - start) / ticks_per_us; // Micro seconds
+  unsigned long seconds = sim_rtc_seconds();
+
+  printf("%s at %02lu:%02lu:%02lu: %.3f s, %lu steps, %.0f loops/s, %.0fx real time\n", name, seconds / 3600, seconds / 60 % 60, seconds % 60,
+         duration / 1e6, nr_of_steps, duration > 0 ? loops / (duration / 1e6) : 0.0, host_seconds > 0 ? duration / 1e6 / host_seconds : 0.0);
+  printf("  hand position  steps   first_us    last_us\n");
+
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    unsigned long hand_steps = 0;
+    unsigned long long first = 0, last = 0;
+    for(unsigned long i=0; i<nr_of_steps; i++) {
+      if(steps[i].hand != hand) continue;
+      if(hand_steps++ == 0) first = steps[i].time;
+      last = steps[i].time;
+    }
+    printf("  %4d %8u %6lu %10.1f %10.1f\n", hand, clockception.get_hand(hand)->current_position, hand_steps,
+           hand_steps ? (first - start) / ticks_per_us : 0.0, hand_steps ? (last - start) / ticks_per_us : 0.0);
+  }
+
+  if(csv) {
+    for(unsigned long i=0; i<nr_of_steps; i++) {
+      fprintf(csv, "%s,%u,%.1f,%d\n", name, steps[i].hand, (steps[i].time - start) / ticks_per_us, steps[i].direction);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  int hour = 6, minute = 29, second = 55;
+  unsigned long seed = 1;
+  FILE *csv = 0;
+  bool statistics = false;
+  bool plan_ahead = false;
+  bool benchmark = false;
+  int first_animation = argc;
+
+  for(int i=1; i<argc; i++) {
+    if(argv[i][0] != '-') {
+      first_animation = i;
+      break;
+    }
+    if(strcmp(argv[i], "-v") == 0) Serial.echo = true;
+    else if(strcmp(argv[i], "-S") == 0) statistics = true;
+    else if(strcmp(argv[i], "-p") == 0) plan_ahead = true;
+    else if(strcmp(argv[i], "-P") == 0) benchmark = true;
+    else if(i+1 >= argc) {
+      usage();
+      return 1;
+    }
+    else if(strcmp(argv[i], "-t") == 0) sscanf(argv[++i], "%d:%d:%d", &hour, &minute, &second);
+    else if(strcmp(argv[i], "-s") == 0) seed = strtoul(argv[++i], 0, 10);
+    else if(strcmp(argv[i], "-b") == 0) {
+      unsigned int pin;
+      unsigned long start, duration;
+      if(sscanf(argv[++i], "%u:%lu:%lu", &pin, &start, &duration) != 3) {
+        usage();
+        return 1;
+      }
+      sim_press_button(pin, start, duration);
+    }
+    else if(strcmp(argv[i], "-T") == 0) {
+      Serial.capture = fopen(argv[++i], "wb");
+      if(!Serial.capture) {
+        perror(argv[i]);
+        return 1;
+      }
+    }
+    else if(strcmp(argv[i], "-o") == 0) {
+      csv = fopen(argv[++i], "w");
+      if(!csv) {
+        perror(argv[i]);
+        return 1;
+      }
+      fprintf(csv, "animation,hand,time_us,direction\n");
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  if(first_animation >= argc && !benchmark) {
+    usage();
+    return 1;
+  }
+  for(int i=first_animation; i<argc; i++) {
+    if(find_animation(argv[i]) < 0) {
+      fprintf(stderr, "unknown animation %s\n", argv[i]);
+      usage();
+      return 1;
+    }
+  }
+
+  sim_set_rtc(hour, minute, second);
+  sim_set_random_pin(seed);
+  for(int hand=0; hand<nr_of_hands; hand++) sim_watch_step_pin(hand, motors[hand][0], motors[hand][1]);
+
+  // Same start up as setup() and run() in main.cpp
+  clockception.init();
+  randomSeed(analogRead(unused_pin));
+
+  if(benchmark) {
+#ifdef CYCLE_PROFILE
+    bool echo = Serial.echo;
+    Serial.echo = true;
+    clockception.benchmark();
+    Serial.echo = echo;
+#else
+    fprintf(stderr, "the cycle profile is compiled out, see Cycleprofile.h\n");
+#endif
+  }
+
+  for(int i=first_animation; i<argc; i++) {
+    const Animation &animation = animations[find_animation(argv[i])];
+    if(plan_ahead) {
+      unsigned long next = sim_rtc_seconds() + 60;
+      clockception.plan_animation(animation.number, next / 3600 % 24, next / 60 % 60);
+    }
+    clockception.wait_for_new_minute();
+
+    sim_clear_steps();
+    unsigned long long start = sim_time();
+    unsigned long loops = sim_millis_calls;
+    clock_t host_start = clock();
+
+    clockception.play_animation(animation.number);
+
+    double host_seconds = double(clock() - host_start) / CLOCKS_PER_SEC;
+    report(animation.name, start, sim_time(), sim_millis_calls - loops, host_seconds, csv);
+  }
+
+  if(statistics) {
+#ifdef STEP_STATISTICS
+    Serial.echo = true;
+    step_statistics.print();
+#else
+    fprintf(stderr, "step statistics are compiled out, see Stepstatistics.h\n");
+#endif
+  }
+
+  if(csv) fclose(csv);
+  if(Serial.capture) {
+    while(!telemetry.empty()) telemetry.service(); // Records of the last animation
+    fclose(Serial.capture);
+  }
+  return 0;
+}
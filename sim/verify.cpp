@@ -0,0 +1,379 @@
+// Plays every animation at every time of the clock (00:00 to 11:59, 720 minutes) against the virtual clock and checks the result:
+// - hands end on the clock frame and the time, of the minute the animation started or of the minute it ended in,
+// - the animation ends within animation_budget of settings.h after the start of its minute, the time its movements are fitted in, so the
+//   next minute is shown in time. Short 3, 6 and 9 are known exceptions, they wait for a new minute in between by design and start a new
+//   budget there, so they have to end animation_budget after the start of that minute,
+// - planning gave no movement more steps than the hand takes (TELEMETRY_STEPS_UNDERFLOW of the firmware),
+// - no instructions are left when the animation returns, and it was not skipped or forced to finish,
+// - the firmware did not crash, e.g. on a division by zero. The other animations of that minute are still checked.
+// Random animations are seeded per minute, so a failure can be replayed with clocksim -t hh:mm:00 after the same seed.
+//
+// Build from the root of the repository:
+//   g++ -std=gnu++11 -O2 -Isim -I. -o clockverify sim/verify.cpp sim/Arduino.cpp Accelerationcurve.cpp Clockception.cpp Clockhand.cpp Instructionpool.cpp Coordinator.cpp Button.cpp Stepscheduler.cpp Stepoutput.cpp Stepstatistics.cpp Telemetry.cpp Animationscript.cpp Syncbus.cpp Timebase.cpp Cycleprofile.cpp
+//
+// Usage:
+//   clockverify [-s seed] [-j jobs] [-e every] [-q] [-v] [animation...]
+// with animations as in clocksim, all of them without arguments. The minutes are spread over jobs worker processes, one per core by default.
+// -e every checks only every so many minutes. -q checks only the minutes in quick_minutes[], around the turns of the hour and of the
+// 12 hours where the hands wrap, for a check on each change: 312 runs, about 20 s on one core. -v lists each failing run.
+// All 720 minutes are 18720 runs and take 15 to 30 minutes on one core, depending on the machine. Run those before a release, on all cores.
+//
+// The firmware uses globals and an interrupt stand-in, so workers are processes, not threads. A worker checks the animations of one minute
+// and sends its results back through a pipe. A worker that dies is replaced by one that goes on with the next animation.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <vector>
+#include "Simulation.h"
+#include "Clockception.h"
+#include "Instructionpool.h"
+#include "Telemetry.h"
+#include "Timebase.h"
+#include "settings.h"
+
+struct Animation
+{
+    const char *name;
+    int number;
+    uint8_t minutes; // Minutes the animation may run into, 2 for the ones that wait for a new minute in between
+};
+
+static const Animation animations[] = {
+  {"long_1", 1, 1}, {"long_2", 2, 1}, {"long_3", 3, 1}, {"long_4", 4, 1}, {"long_5", 5, 1}, {"long_6", 6, 1}, {"long_7", 7, 1},
+  {"long_8", 8, 1}, {"long_9", 9, 1}, {"long_10", 10, 1}, {"long_11", 11, 1}, {"long_12", 12, 1}, {"long_13", 13, 1},
+  {"short_1", 21, 1}, {"short_2", 22, 1}, {"short_3", 23, 2}, {"short_4", 24, 1}, {"short_5", 25, 1}, {"short_6", 26, 2}, {"short_7", 27, 1},
+  {"short_8", 28, 1}, {"short_9", 29, 2}, {"short_10", 30, 1}, {"short_11", 31, 1}, {"short_12", 32, 1}, {"short_13", 33, 1}
+};
+static const int nr_of_animations = sizeof(animations) / sizeof(animations[0]);
+
+static const int nr_of_minutes = 720;
+static const int quick_minutes[] = {0, 1, 12, 30, 59, 60, 359, 360, 361, 659, 660, 719}; // Hours 0, 6 and 11 and the minutes on both sides
+static const int nr_of_quick_minutes = sizeof(quick_minutes) / sizeof(quick_minutes[0]);
+static const double ticks_per_ms = 2000.0;
+
+Clockception clockception;
+
+// Outcome of one animation at one minute, as sent from a worker
+struct Result
+{
+    uint8_t animation; // Index in animations[]
+    uint16_t minute; // Minutes since 00:00
+    uint32_t duration_ms; // From the start of the minute until play_animation() returned
+    uint8_t off_target; // Hands that are not on the frame or the time
+    uint8_t underflows;
+    uint8_t timeouts;
+    uint8_t skipped;
+    uint8_t instructions_left;
+    uint8_t crashed;
+};
+
+// Worst case of one animation over all minutes
+struct Summary
+{
+    unsigned int runs;
+    uint32_t worst_ms;
+    uint16_t worst_minute;
+    unsigned int over_budget;
+    unsigned int off_target;
+    unsigned int underflows;
+    unsigned int timeouts;
+    unsigned int skipped;
+    unsigned int instructions_left;
+    unsigned int crashed;
+};
+
+// Animations of one minute, from first on, for one worker
+struct Task
+{
+    int minute;
+    size_t first;
+};
+
+struct Worker
+{
+    pid_t pid;
+    Task task;
+    size_t received; // Results read from the pipe
+};
+
+///////////////////////////////////////////////////////////////////////////////// TELEMETRY /////////////////////////////////////////////////////////////////////////
+
+static char *serial_buffer = 0;
+static size_t serial_length = 0;
+static size_t serial_read = 0; // Bytes of serial_buffer that were counted
+
+static void count_records(Result &result) {
+  // Same framing as telemetrydecode, see decode.cpp
+  while(!telemetry.empty()) telemetry.service();
+  fflush(Serial.capture);
+
+  const uint8_t *bytes = (const uint8_t *)serial_buffer;
+  while(serial_read + TELEMETRY_RECORD_SIZE <= serial_length) {
+    if(bytes[serial_read] != TELEMETRY_SYNC) {
+      serial_read++;
+      continue;
+    }
+    const uint8_t *record = bytes + serial_read;
+    uint8_t checksum = 0;
+    for(int i=1; i<TELEMETRY_RECORD_SIZE-1; i++) checksum += record[i];
+    if(checksum != record[TELEMETRY_RECORD_SIZE-1]) {
+      serial_read++;
+      continue;
+    }
+    serial_read += TELEMETRY_RECORD_SIZE;
+
+    switch(record[1]) {
+      case TELEMETRY_STEPS_UNDERFLOW: result.underflows++; break;
+      case TELEMETRY_ANIMATION_TIMEOUT: result.timeouts++; break;
+      case TELEMETRY_ANIMATION_SKIPPED: result.skipped++; break;
+      case TELEMETRY_DROPPED: result.underflows++; break; // Could have been an underflow, count it rather than miss one
+    }
+  }
+  serial_read = serial_length;
+}
+
+///////////////////////////////////////////////////////////////////////////////// ONE RUN /////////////////////////////////////////////////////////////////////////
+
+static int expected_position(int hand, int minute_of_day) {
+  // Same calculation as Clockception::set_time_positions()
+  int hour = minute_of_day / 60;
+  int minute = minute_of_day % 60;
+  if(hand < nr_of_hands-2) return clock_frame_positions[hand];
+  if(hand == nr_of_hands-2) return int(float(hour % 12) / 12 * float(steps_per_revolution) + floor(float(minute) / 60 / 12 * float(steps_per_revolution)));
+  return int(minute / float(60) * steps_per_revolution);
+}
+
+static int hands_off_target(int minute_of_day) {
+  int off = 0;
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    int position = clockception.normalize(clockception.get_hand(hand)->current_position, steps_per_revolution, 0);
+    if(position != expected_position(hand, minute_of_day)) off++;
+  }
+  return off;
+}
+
+static Result run(int animation, int minute_of_day, unsigned long seed) {
+  Result result = {uint8_t(animation), uint16_t(minute_of_day), 0, 0, 0, 0, 0, 0, 0};
+  count_records(result); // Skip what the previous run left
+  result.underflows = result.timeouts = result.skipped = 0;
+
+  // The clock shows the previous minute, as after the animation before
+  int previous = (minute_of_day + nr_of_minutes - 1) % nr_of_minutes;
+  for(int hand=0; hand<nr_of_hands; hand++) {
+    Clockhand *clock_hand = clockception.get_hand(hand);
+    clock_hand->current_position = expected_position(hand, previous);
+    clock_hand->virtual_position = clock_hand->current_position;
+  }
+  clockception.clear_all_instructions();
+
+  // Like wait_for_new_minute() on the new minute. Set through the firmware, which counts the seconds of the RTC itself.
+  time_base.adjust(minute_of_day / 60, minute_of_day % 60, 0);
+  unsigned long long start = sim_time();
+  clockception.get_time();
+  randomSeed(seed * nr_of_minutes + minute_of_day + 1);
+
+  clockception.play_animation(animations[animation].number);
+
+  result.duration_ms = uint32_t((sim_time() - start) / ticks_per_ms);
+  result.instructions_left = instruction_pool.free_instructions() < INSTRUCTION_POOL_SIZE;
+  int end_minute = (sim_rtc_seconds() / 60) % nr_of_minutes;
+  int off = hands_off_target(minute_of_day);
+  if(off && end_minute != minute_of_day) {
+    int off_end = hands_off_target(end_minute);
+    if(off_end < off) off = off_end;
+  }
+  result.off_target = off;
+  count_records(result);
+  return result;
+}
+
+static void worker(const Task &task, const std::vector<int> &selected, unsigned long seed, int output) {
+  Serial.capture = open_memstream(&serial_buffer, &serial_length);
+  sim_set_rtc(0, 0, 0);
+  clockception.init();
+
+  for(size_t i=task.first; i<selected.size(); i++) {
+    Result result = run(selected[i], task.minute, seed);
+    if(write(output, &result, sizeof(result)) != sizeof(result)) _exit(1);
+  }
+  _exit(0);
+}
+
+static bool start_worker(const Task &task, const std::vector<int> &selected, unsigned long seed, std::vector<Worker> &workers, std::vector<pollfd> &pipes) {
+  int fds[2];
+  if(pipe(fds) != 0) {
+    perror("pipe");
+    return false;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid < 0) {
+    perror("fork");
+    return false;
+  }
+  if(pid == 0) {
+    close(fds[0]);
+    worker(task, selected, seed, fds[1]);
+  }
+  close(fds[1]);
+
+  Worker w = {pid, task, 0};
+  pollfd p = {fds[0], POLLIN, 0};
+  workers.push_back(w);
+  pipes.push_back(p);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////// REPORT /////////////////////////////////////////////////////////////////////////
+
+static bool over_budget(const Result &result) {
+  return result.duration_ms > 60000UL * (animations[result.animation].minutes - 1) + animation_budget;
+}
+
+static bool failed(const Result &result) {
+  return over_budget(result) || result.off_target || result.underflows || result.timeouts || result.skipped || result.instructions_left || result.crashed;
+}
+
+static void add(Summary &summary, const Result &result, bool verbose) {
+  if(summary.runs++ == 0 || result.duration_ms > summary.worst_ms) {
+    summary.worst_ms = result.duration_ms;
+    summary.worst_minute = result.minute;
+  }
+  if(over_budget(result)) summary.over_budget++;
+  if(result.off_target) summary.off_target++;
+  if(result.underflows) summary.underflows++;
+  if(result.timeouts) summary.timeouts++;
+  if(result.skipped) summary.skipped++;
+  if(result.instructions_left) summary.instructions_left++;
+  if(result.crashed) summary.crashed++;
+
+  if(verbose && result.crashed) printf("%s at %02d:%02d: crashed\n", animations[result.animation].name, result.minute / 60, result.minute % 60);
+  else if(verbose && failed(result)) {
+    printf("%s at %02d:%02d: %.3f s, %u hands off target, %u underflows%s%s%s\n", animations[result.animation].name, result.minute / 60, result.minute % 60,
+           result.duration_ms / 1000.0, result.off_target, result.underflows, result.timeouts ? ", forced to finish" : "", result.skipped ? ", skipped" : "",
+           result.instructions_left ? ", instructions left" : "");
+  }
+}
+
+static void print_table(const Summary *summaries, const std::vector<int> &selected) {
+  printf("animation   runs  worst_s   at   late  off_target  underflow  timeout  skipped  left  crash\n");
+  for(size_t i=0; i<selected.size(); i++) {
+    const Summary &s = summaries[selected[i]];
+    printf("%-10s %5u %8.3f %02d:%02d %5u %11u %10u %8u %8u %5u %6u\n", animations[selected[i]].name, s.runs, s.worst_ms / 1000.0, s.worst_minute / 60, s.worst_minute % 60,
+           s.over_budget, s.off_target, s.underflows, s.timeouts, s.skipped, s.instructions_left, s.crashed);
+  }
+}
+
+static int find_animation(const char *name) {
+  for(int i=0; i<nr_of_animations; i++) {
+    if(strcmp(animations[i].name, name) == 0) return i;
+  }
+  return -1;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: clockverify [-s seed] [-j jobs] [-e every] [-q] [-v] [animation...]\n");
+}
+
+int main(int argc, char **argv) {
+  unsigned long seed = 1;
+  int jobs = int(sysconf(_SC_NPROCESSORS_ONLN));
+  int every = 1;
+  bool quick = false;
+  bool verbose = false;
+  std::vector<int> selected;
+
+  for(int i=1; i<argc; i++) {
+    if(strcmp(argv[i], "-v") == 0) verbose = true;
+    else if(strcmp(argv[i], "-q") == 0) quick = true;
+    else if(argv[i][0] == '-' && i+1 >= argc) {
+      usage();
+      return 1;
+    }
+    else if(strcmp(argv[i], "-s") == 0) seed = strtoul(argv[++i], 0, 10);
+    else if(strcmp(argv[i], "-j") == 0) jobs = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-e") == 0) every = atoi(argv[++i]);
+    else if(argv[i][0] == '-') {
+      usage();
+      return 1;
+    }
+    else {
+      int animation = find_animation(argv[i]);
+      if(animation < 0) {
+        fprintf(stderr, "unknown animation %s\n", argv[i]);
+        return 1;
+      }
+      selected.push_back(animation);
+    }
+  }
+  if(selected.empty()) {
+    for(int i=0; i<nr_of_animations; i++) selected.push_back(i);
+  }
+  if(jobs < 1) jobs = 1;
+  if(every < 1) every = 1;
+  std::vector<Task> tasks;
+  for(int minute=0; minute<nr_of_minutes; minute+=every) {
+    Task task = {minute, 0};
+    if(!quick) tasks.push_back(task);
+  }
+  for(int i=0; quick && i<nr_of_quick_minutes; i++) {
+    Task task = {quick_minutes[i], 0};
+    tasks.push_back(task);
+  }
+  size_t next_task = 0;
+
+  Summary summaries[nr_of_animations];
+  memset(summaries, 0, sizeof(summaries));
+  unsigned long runs = 0, failures = 0;
+  std::vector<Worker> workers;
+  std::vector<pollfd> pipes;
+
+  while(next_task < tasks.size() || !workers.empty()) {
+    while(next_task < tasks.size() && int(workers.size()) < jobs) {
+      if(!start_worker(tasks[next_task++], selected, seed, workers, pipes)) return 2;
+    }
+
+    if(poll(pipes.data(), pipes.size(), -1) < 0) {
+      perror("poll");
+      return 2;
+    }
+    for(size_t i=0; i<workers.size(); i++) {
+      if(!pipes[i].revents) continue;
+      Worker &w = workers[i];
+      Result result;
+      ssize_t length = read(pipes[i].fd, &result, sizeof(result)); // Writes of a result are atomic on a pipe
+      if(length == sizeof(result)) {
+        add(summaries[result.animation], result, verbose);
+        w.received++;
+        runs++;
+        if(failed(result)) failures++;
+        continue;
+      }
+
+      // Worker is done, or died in the animation after the last result
+      int status;
+      close(pipes[i].fd);
+      waitpid(w.pid, &status, 0);
+      size_t next = w.task.first + w.received;
+      if(next < selected.size()) {
+        Result crash = {uint8_t(selected[next]), uint16_t(w.task.minute), 0, 0, 0, 0, 0, 0, 1};
+        add(summaries[crash.animation], crash, verbose);
+        runs++;
+        failures++;
+        if(next+1 < selected.size()) {
+          Task rest = {w.task.minute, next+1};
+          tasks.push_back(rest);
+        }
+      }
+      workers.erase(workers.begin() + i);
+      pipes.erase(pipes.begin() + i);
+      i--;
+    }
+  }
+
+  print_table(summaries, selected);
+  printf("%lu runs on %d jobs, %lu failed\n", runs, jobs, failures);
+  return failures ? 1 : 0;
+}
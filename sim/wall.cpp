@@ -0,0 +1,288 @@
+// Runs the units of a wall side by side, one process per unit, connected by the bus of Syncbus.h on Serial1. The RTC of each follower is set seconds
+// apart from the master and each unit reads its own random seed, like units that drift apart. Reports for each movement the moment every unit
+// started it relative to the master, and whether the units made the same movement: the same steps of the same hands at the same times after the start,
+// give or take the jitter of interrupts that come at other moments on each unit, like the square wave of its RTC.
+// A movement is what an animation runs from one TELEMETRY_ANIMATION_START record to the next, most animations have one or two.
+//
+// Build from the root of the repository:
+//   g++ -std=gnu++11 -O2 -Isim -I. -o clockwall sim/wall.cpp sim/Arduino.cpp Accelerationcurve.cpp Clockception.cpp Clockhand.cpp Instructionpool.cpp Coordinator.cpp Button.cpp Stepscheduler.cpp Stepoutput.cpp Stepstatistics.cpp Telemetry.cpp Animationscript.cpp Syncbus.cpp Timebase.cpp Cycleprofile.cpp
+//
+// Usage:
+//   clockwall [-u units] [-m minutes] [-t hh:mm:ss] [-d seconds] [-s seed] [-n]
+// -u units on the bus, master included, 3 by default. -m minutes that run() runs, 3 by default. -t time of the RTC of the master.
+// -d sets the RTC of the followers up to so many seconds apart from the master, 20 by default. -n runs the units on their own, without bus.
+// Exits with 1 if units start more than a milli second apart, make different movements or take steps more than 100 us apart.
+//
+// Each unit runs against its own virtual clock. All clocks start at zero together, and a unit that reads the bus waits until the other units are
+// that far, see sim_attach_bus().
+
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <vector>
+#include <algorithm>
+#include "Simulation.h"
+#include "Clockception.h"
+#include "Syncbus.h"
+#include "Telemetry.h"
+#include "settings.h"
+
+static const double ticks_per_us = 2.0;
+static const double max_skew_us = 1000;
+static const double max_jitter_us = 100;
+
+Clockception clockception;
+
+// Animation as one unit made it
+struct Movement
+{
+    unsigned long long start; // Ticks of the first step
+    std::vector<Sim_step> steps; // Ordered by hand, times after the start
+};
+
+static void usage() {
+  fprintf(stderr, "usage: clockwall [-u units] [-m minutes] [-t hh:mm:ss] [-d seconds] [-s seed] [-n]\n");
+}
+
+static std::vector<unsigned long long> movement_starts(FILE *serial) {
+  // Ticks at which the firmware started to run the hands, from its TELEMETRY_ANIMATION_START records. Gaps between steps do not tell,
+  // some animations stand still for most of a minute.
+  std::vector<unsigned long long> starts;
+  uint8_t bytes[TELEMETRY_RECORD_SIZE];
+  int length = 0, c;
+  rewind(serial);
+  while((c = fgetc(serial)) != EOF) {
+    if(length == 0 && c != TELEMETRY_SYNC) continue; // Text
+    bytes[length++] = c;
+    if(length < TELEMETRY_RECORD_SIZE) continue;
+    length = 0;
+    uint8_t checksum = 0;
+    for(int i=1; i<TELEMETRY_RECORD_SIZE-1; i++) checksum += bytes[i];
+    if(checksum != bytes[TELEMETRY_RECORD_SIZE-1] || bytes[1] != TELEMETRY_ANIMATION_START) continue;
+    unsigned long ms = bytes[3] | (unsigned long)bytes[4] << 8 | (unsigned long)bytes[5] << 16 | (unsigned long)bytes[6] << 24;
+    starts.push_back(ms * 1000ULL * ticks_per_us);
+  }
+  return starts;
+}
+
+static bool step_order(const Sim_step &a, const Sim_step &b) {
+  // Steps of one hand keep their order, steps of different hands at about the same time can swap between units
+  if(a.hand != b.hand) return a.hand < b.hand;
+  return a.time < b.time;
+}
+
+static std::vector<Movement> movements(const std::vector<unsigned long long> &starts) {
+  unsigned long nr_of_steps;
+  const Sim_step *steps = sim_steps(nr_of_steps);
+  std::vector<Movement> result(starts.size());
+  unsigned long i = 0;
+  for(size_t m=0; m<starts.size(); m++) {
+    unsigned long long end = m+1 < starts.size() ? starts[m+1] : ~0ULL;
+    Movement &movement = result[m];
+    movement.start = i < nr_of_steps && steps[i].time < end ? steps[i].time : starts[m];
+    for(; i<nr_of_steps && steps[i].time < end; i++) {
+      Sim_step step = steps[i];
+      step.time -= movement.start;
+      movement.steps.push_back(step);
+    }
+    std::sort(movement.steps.begin(), movement.steps.end(), step_order);
+  }
+  return result;
+}
+
+static void write_movements(const std::vector<Movement> &movements, FILE *result) {
+  uint32_t count = movements.size();
+  fwrite(&count, sizeof(count), 1, result);
+  for(size_t m=0; m<movements.size(); m++) {
+    count = movements[m].steps.size();
+    fwrite(&movements[m].start, sizeof(movements[m].start), 1, result);
+    fwrite(&count, sizeof(count), 1, result);
+    fwrite(movements[m].steps.data(), sizeof(Sim_step), count, result);
+  }
+}
+
+static std::vector<Movement> read_movements(FILE *result) {
+  // Nothing, or what was written so far, from a unit that crashed
+  std::vector<Movement> movements;
+  uint32_t count;
+  if(fread(&count, sizeof(count), 1, result) != 1) return movements;
+  for(uint32_t m=0; m<count; m++) {
+    Movement movement;
+    uint32_t steps;
+    if(fread(&movement.start, sizeof(movement.start), 1, result) != 1 || fread(&steps, sizeof(steps), 1, result) != 1) break;
+    movement.steps.resize(steps);
+    if(fread(movement.steps.data(), sizeof(Sim_step), steps, result) != steps) break;
+    movements.push_back(movement);
+  }
+  return movements;
+}
+
+static bool same_movement(const Movement &a, const Movement &b, double &jitter) {
+  // Same steps of the same hands in the same directions. Returns in jitter how far the times of the steps are apart at most.
+  jitter = 0;
+  if(a.steps.size() != b.steps.size()) return false;
+  for(size_t i=0; i<a.steps.size(); i++) {
+    if(a.steps[i].hand != b.steps[i].hand || a.steps[i].direction != b.steps[i].direction) return false;
+    double difference = fabs(double(a.steps[i].time) - double(b.steps[i].time)) / ticks_per_us;
+    if(difference > jitter) jitter = difference;
+  }
+  return true;
+}
+
+static void run_unit(int unit, int units, bool bus, int hour, int minute, int second, long offset, unsigned long seed, int minutes) {
+  long seconds = ((long)hour * 3600 + minute * 60 + second + offset + 86400) % 86400;
+  sim_set_rtc(seconds / 3600, seconds / 60 % 60, seconds % 60);
+  sim_set_random_pin(seed * 31 + unit);
+  for(int hand=0; hand<nr_of_hands; hand++) sim_watch_step_pin(hand, motors[hand][0], motors[hand][1]);
+
+  Serial.capture = tmpfile(); // Telemetry tells where movements start
+  clockception.init();
+  sync_bus.begin(bus ? unit : 0, units, sync_baud);
+  clockception.run(minutes);
+  while(!telemetry.empty()) telemetry.service();
+}
+
+int main(int argc, char **argv) {
+  int units = 3, minutes = 3;
+  int hour = 6, minute = 29, second = 30;
+  long spread = 20;
+  unsigned long seed = 1;
+  bool bus = true;
+
+  for(int i=1; i<argc; i++) {
+    if(strcmp(argv[i], "-n") == 0) bus = false;
+    else if(i+1 >= argc) {
+      usage();
+      return 1;
+    }
+    else if(strcmp(argv[i], "-u") == 0) units = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-m") == 0) minutes = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-t") == 0) sscanf(argv[++i], "%d:%d:%d", &hour, &minute, &second);
+    else if(strcmp(argv[i], "-d") == 0) spread = atol(argv[++i]);
+    else if(strcmp(argv[i], "-s") == 0) seed = strtoul(argv[++i], 0, 10);
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if(units < 1 || units > 250 || minutes < 1) {
+    usage();
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN); // A unit that finished closes its end of the bus
+
+  // Master sends to every follower, every follower sends to the master
+  std::vector<int> to_follower(2*units), to_master(2*units);
+  for(int unit=2; unit<=units; unit++) {
+    if(pipe(&to_follower[2*(unit-1)]) != 0 || pipe(&to_master[2*(unit-1)]) != 0) {
+      perror("pipe");
+      return 1;
+    }
+  }
+
+  std::vector<pid_t> pids(units + 1);
+  std::vector<FILE *> results(units + 1);
+  srand(seed);
+  for(int unit=1; unit<=units; unit++) {
+    long offset = unit == 1 ? 0 : rand() % (2*spread + 1) - spread;
+    int result_pipe[2];
+    if(pipe(result_pipe) != 0) {
+      perror("pipe");
+      return 1;
+    }
+
+    pids[unit] = fork();
+    if(pids[unit] < 0) {
+      perror("fork");
+      return 1;
+    }
+    if(pids[unit] == 0) {
+      close(result_pipe[0]);
+      std::vector<int> inputs, outputs;
+      for(int follower=2; follower<=units; follower++) {
+        int *down = &to_follower[2*(follower-1)];
+        int *up = &to_master[2*(follower-1)];
+        if(unit == 1) {
+          inputs.push_back(up[0]);
+          outputs.push_back(down[1]);
+          close(up[1]);
+          close(down[0]);
+        }
+        else if(unit == follower) {
+          inputs.push_back(down[0]);
+          outputs.push_back(up[1]);
+          close(up[0]);
+          close(down[1]);
+        }
+        else { // Ends of other followers, open ends would keep the bus from closing
+          close(up[0]);
+          close(up[1]);
+          close(down[0]);
+          close(down[1]);
+        }
+      }
+      if(bus) sim_attach_bus(inputs.data(), inputs.size(), outputs.data(), outputs.size());
+      run_unit(unit, units, bus, hour, minute, second, offset, seed, minutes);
+
+      // Close the bus first, the other units may still be running and wait for this one while the parent reads another unit
+      for(size_t i=0; i<inputs.size(); i++) close(inputs[i]);
+      for(size_t i=0; i<outputs.size(); i++) close(outputs[i]);
+      FILE *result = fdopen(result_pipe[1], "wb");
+      write_movements(movements(movement_starts(Serial.capture)), result);
+      fclose(result);
+      _exit(0);
+    }
+
+    close(result_pipe[1]);
+    results[unit] = fdopen(result_pipe[0], "rb");
+    printf("unit %d: RTC %+ld s\n", unit, offset);
+  }
+  for(int unit=2; unit<=units; unit++) {
+    for(int end=0; end<2; end++) {
+      close(to_follower[2*(unit-1)+end]);
+      close(to_master[2*(unit-1)+end]);
+    }
+  }
+
+  // Results come when a unit has finished, read them all before waiting so no unit blocks on a full pipe
+  std::vector<std::vector<Movement> > unit_movements(units + 1);
+  for(int unit=1; unit<=units; unit++) {
+    unit_movements[unit] = read_movements(results[unit]);
+    fclose(results[unit]);
+  }
+  bool failed = false;
+  for(int unit=1; unit<=units; unit++) {
+    int status;
+    waitpid(pids[unit], &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("unit %d crashed\n", unit);
+      failed = true;
+    }
+  }
+
+  printf(" movement   steps  start of the followers after the master in us\n");
+  double worst = 0, worst_jitter = 0;
+  for(size_t m=0; m<unit_movements[1].size(); m++) {
+    const Movement &master = unit_movements[1][m];
+    printf("%9zu %7zu ", m + 1, master.steps.size());
+    for(int unit=2; unit<=units; unit++) {
+      if(m >= unit_movements[unit].size()) {
+        printf(" %12s", "missing");
+        failed = true;
+        continue;
+      }
+      const Movement &movement = unit_movements[unit][m];
+      double skew = (double(movement.start) - double(master.start)) / ticks_per_us;
+      double jitter;
+      bool same = same_movement(master, movement, jitter) && jitter <= max_jitter_us;
+      printf(" %12.1f%s", skew, same ? "" : "*");
+      if(fabs(skew) > worst) worst = fabs(skew);
+      if(same && jitter > worst_jitter) worst_jitter = jitter;
+      if(!same || fabs(skew) > max_skew_us) failed = true;
+    }
+    printf("\n");
+  }
+  printf("* movement differs from the master. Worst start skew %.1f us, steps of the same movements at most %.1f us apart.\n", worst, worst_jitter);
+  return failed ? 1 : 0;
+}